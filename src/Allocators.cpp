@@ -0,0 +1,222 @@
+#include "Allocators.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include <sfz/Logging.hpp>
+
+// Statics
+// ------------------------------------------------------------------------------------------------
+
+// Stored in front of each allocation made by a TrackingAllocator
+struct AllocationHeader final {
+	uint64_t size;
+	uint32_t tagIdx;
+	uint32_t headerSize; // Offset from the start of the backing allocation
+};
+static_assert(sizeof(AllocationHeader) == 16, "AllocationHeader is padded");
+
+static void addAllocation(AllocationTagStats& stats, uint64_t size) noexcept
+{
+	stats.numLiveAllocations += 1;
+	stats.numAllocations += 1;
+	stats.liveBytes += size;
+	stats.peakBytes = sfz::max(stats.peakBytes, stats.liveBytes);
+}
+
+static void removeAllocation(AllocationTagStats& stats, uint64_t size) noexcept
+{
+	sfz_assert(stats.numLiveAllocations > 0 && stats.liveBytes >= size);
+	stats.numLiveAllocations -= 1;
+	stats.liveBytes -= size;
+}
+
+// CountingAllocator
+// ------------------------------------------------------------------------------------------------
+
+void CountingAllocator::beginFrame() noexcept
+{
+	mNumAllocationsLastFrame = mNumAllocations.exchange(0, std::memory_order_relaxed);
+	mNumDeallocationsLastFrame = mNumDeallocations.exchange(0, std::memory_order_relaxed);
+}
+
+void* CountingAllocator::allocate(sfz::DbgInfo dbg, uint64_t size, uint64_t alignment) noexcept
+{
+	mNumAllocations.fetch_add(1, std::memory_order_relaxed);
+	return mBacking->allocate(dbg, size, alignment);
+}
+
+void CountingAllocator::deallocate(void* pointer) noexcept
+{
+	if (pointer == nullptr) return;
+	mNumDeallocations.fetch_add(1, std::memory_order_relaxed);
+	mBacking->deallocate(pointer);
+}
+
+// TrackingAllocator: Constructors & destructors
+// ------------------------------------------------------------------------------------------------
+
+void TrackingAllocator::init(const char* name, sfz::Allocator* backing) noexcept
+{
+	this->destroy();
+	mName = name;
+	mBacking = backing;
+	mTags.init(64, backing, sfz_dbg("TrackingAllocator::mTags"));
+	mTotal = {};
+	mTotal.tag = name;
+}
+
+void TrackingAllocator::destroy() noexcept
+{
+	if (mTotal.numLiveAllocations != 0) {
+		SFZ_WARNING("Memory", "\"%s\" destroyed with %u live allocations (%llu bytes)",
+			mName, mTotal.numLiveAllocations, (unsigned long long)mTotal.liveBytes);
+	}
+	mTags.destroy();
+	mTotal = {};
+	mName = "";
+	mBacking = nullptr;
+}
+
+// TrackingAllocator: Methods
+// ------------------------------------------------------------------------------------------------
+
+AllocationTagStats TrackingAllocator::snapshot(
+	sfz::Array<AllocationTagStats>* tagsOut) const noexcept
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	if (tagsOut != nullptr) {
+		const uint32_t firstOut = tagsOut->size();
+		tagsOut->add(mTags.data(), mTags.size());
+		std::sort(tagsOut->begin() + firstOut, tagsOut->end(),
+			[](const AllocationTagStats& lhs, const AllocationTagStats& rhs) {
+			return lhs.liveBytes > rhs.liveBytes;
+		});
+	}
+	return mTotal;
+}
+
+void* TrackingAllocator::allocate(sfz::DbgInfo dbg, uint64_t size, uint64_t alignment) noexcept
+{
+	const uint32_t headerSize = uint32_t(sfz::max(alignment, uint64_t(sizeof(AllocationHeader))));
+	uint8_t* base = static_cast<uint8_t*>(mBacking->allocate(dbg, headerSize + size, alignment));
+	if (base == nullptr) return nullptr;
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	uint32_t tagIdx = 0;
+	while (tagIdx < mTags.size()) {
+		const AllocationTagStats& tag = mTags[tagIdx];
+		if (tag.tag == dbg.staticMsg && tag.file == dbg.file && tag.line == dbg.line) break;
+		tagIdx += 1;
+	}
+	if (tagIdx == mTags.size()) {
+		AllocationTagStats& tag = mTags.add(AllocationTagStats());
+		tag.tag = dbg.staticMsg;
+		tag.file = dbg.file;
+		tag.line = dbg.line;
+	}
+	addAllocation(mTags[tagIdx], size);
+	addAllocation(mTotal, size);
+
+	AllocationHeader header;
+	header.size = size;
+	header.tagIdx = tagIdx;
+	header.headerSize = headerSize;
+	memcpy(base + headerSize - sizeof(AllocationHeader), &header, sizeof(AllocationHeader));
+	return base + headerSize;
+}
+
+void TrackingAllocator::deallocate(void* pointer) noexcept
+{
+	if (pointer == nullptr) return;
+	uint8_t* ptr = static_cast<uint8_t*>(pointer);
+	AllocationHeader header;
+	memcpy(&header, ptr - sizeof(AllocationHeader), sizeof(AllocationHeader));
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		removeAllocation(mTags[header.tagIdx], header.size);
+		removeAllocation(mTotal, header.size);
+	}
+	mBacking->deallocate(ptr - header.headerSize);
+}
+
+// FrameArena: Constructors & destructors
+// ------------------------------------------------------------------------------------------------
+
+void FrameArena::init(uint64_t bytesPerFrame, sfz::Allocator* backing) noexcept
+{
+	this->destroy();
+	mBacking = backing;
+	mBytesPerFrame = bytesPerFrame;
+	for (uint8_t*& buffer : mBuffers) {
+		buffer = static_cast<uint8_t*>(
+			backing->allocate(sfz_dbg("FrameArena::mBuffers"), bytesPerFrame, 64));
+	}
+	mCurrentBuffer = 0;
+	mOffset.store(0);
+	mNumOverflows.store(0);
+	mPeakBytesUsed = 0;
+}
+
+void FrameArena::destroy() noexcept
+{
+	if (mBacking != nullptr) {
+		for (uint8_t*& buffer : mBuffers) {
+			mBacking->deallocate(buffer);
+			buffer = nullptr;
+		}
+	}
+	mBacking = nullptr;
+	mBytesPerFrame = 0;
+	mCurrentBuffer = 0;
+	mOffset.store(0);
+	mNumOverflows.store(0);
+	mPeakBytesUsed = 0;
+}
+
+// FrameArena: Methods
+// ------------------------------------------------------------------------------------------------
+
+void FrameArena::beginFrame() noexcept
+{
+	mPeakBytesUsed = sfz::max(mPeakBytesUsed, mOffset.load(std::memory_order_relaxed));
+	mCurrentBuffer = (mCurrentBuffer + 1) % FRAME_ARENA_NUM_BUFFERS;
+	mOffset.store(0, std::memory_order_relaxed);
+	mNumOverflows.store(0, std::memory_order_relaxed);
+}
+
+void* FrameArena::allocate(sfz::DbgInfo dbg, uint64_t size, uint64_t alignment) noexcept
+{
+	sfz_assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+	const uintptr_t buffer = uintptr_t(mBuffers[mCurrentBuffer]);
+	uint64_t offset = mOffset.load(std::memory_order_relaxed);
+	while (buffer != 0) {
+		const uint64_t alignedOffset =
+			((buffer + offset + alignment - 1) & ~uintptr_t(alignment - 1)) - buffer;
+		const uint64_t newOffset = alignedOffset + size;
+		if (newOffset > mBytesPerFrame) break;
+		if (mOffset.compare_exchange_weak(offset, newOffset, std::memory_order_relaxed)) {
+			return reinterpret_cast<void*>(buffer + alignedOffset);
+		}
+	}
+	mNumOverflows.fetch_add(1, std::memory_order_relaxed);
+	return mBacking->allocate(dbg, size, alignment);
+}
+
+void FrameArena::deallocate(void* pointer) noexcept
+{
+	if (pointer == nullptr) return;
+
+	// Arena memory is reclaimed when its buffer is reset, only overflows are freed individually
+	if (ownsMemory(pointer)) return;
+	mBacking->deallocate(pointer);
+}
+
+bool FrameArena::ownsMemory(const void* pointer) const noexcept
+{
+	const uint8_t* ptr = static_cast<const uint8_t*>(pointer);
+	for (const uint8_t* buffer : mBuffers) {
+		if (buffer != nullptr && ptr >= buffer && ptr < (buffer + mBytesPerFrame)) return true;
+	}
+	return false;
+}
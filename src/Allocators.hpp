@@ -0,0 +1,165 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+
+#include <skipifzero.hpp>
+#include <skipifzero_arrays.hpp>
+
+// CountingAllocator
+// ------------------------------------------------------------------------------------------------
+
+// Forwards all calls to another allocator, counting them per frame.
+class CountingAllocator final : public sfz::Allocator {
+public:
+	// Constructors & destructors
+	// --------------------------------------------------------------------------------------------
+
+	CountingAllocator() noexcept = default;
+	CountingAllocator(const CountingAllocator&) = delete;
+	CountingAllocator& operator= (const CountingAllocator&) = delete;
+	CountingAllocator(CountingAllocator&&) = delete;
+	CountingAllocator& operator= (CountingAllocator&&) = delete;
+	~CountingAllocator() noexcept = default;
+
+	void init(sfz::Allocator* backing) noexcept { mBacking = backing; }
+
+	// Methods
+	// --------------------------------------------------------------------------------------------
+
+	// Starts counting a new frame, the counts of the previous one are kept until the next call.
+	void beginFrame() noexcept;
+
+	uint32_t numAllocationsLastFrame() const { return mNumAllocationsLastFrame; }
+	uint32_t numDeallocationsLastFrame() const { return mNumDeallocationsLastFrame; }
+
+	void* allocate(sfz::DbgInfo dbg, uint64_t size, uint64_t alignment = 32) noexcept override;
+	void deallocate(void* pointer) noexcept override;
+
+private:
+	sfz::Allocator* mBacking = nullptr;
+	std::atomic_uint32_t mNumAllocations{0};
+	std::atomic_uint32_t mNumDeallocations{0};
+	uint32_t mNumAllocationsLastFrame = 0;
+	uint32_t mNumDeallocationsLastFrame = 0;
+};
+
+// TrackingAllocator
+// ------------------------------------------------------------------------------------------------
+
+// Allocations made from the same place (same sfz_dbg() tag, file and line).
+struct AllocationTagStats final {
+	const char* tag = nullptr; // sfz_dbg() message, might be empty
+	const char* file = nullptr;
+	uint32_t line = 0;
+	uint32_t numLiveAllocations = 0;
+	uint64_t numAllocations = 0; // Total, including freed ones
+	uint64_t liveBytes = 0;
+	uint64_t peakBytes = 0;
+};
+
+// Forwards all calls to another allocator, keeping track of live bytes, peak bytes and number of
+// allocations, both in total and per allocation site. Meant to be given to a single subsystem so
+// that its memory use can be reported and compared against a budget.
+//
+// The size and site of each allocation is stored in a small header in front of it. Thread-safe,
+// the statistics are protected by a mutex.
+class TrackingAllocator final : public sfz::Allocator {
+public:
+	// Constructors & destructors
+	// --------------------------------------------------------------------------------------------
+
+	TrackingAllocator() noexcept = default;
+	TrackingAllocator(const TrackingAllocator&) = delete;
+	TrackingAllocator& operator= (const TrackingAllocator&) = delete;
+	TrackingAllocator(TrackingAllocator&&) = delete;
+	TrackingAllocator& operator= (TrackingAllocator&&) = delete;
+	~TrackingAllocator() noexcept { this->destroy(); }
+
+	// The name must be a string literal.
+	void init(const char* name, sfz::Allocator* backing) noexcept;
+	void destroy() noexcept;
+
+	// Methods
+	// --------------------------------------------------------------------------------------------
+
+	const char* name() const { return mName; }
+
+	// Copies the statistics of all allocation sites (sorted by live bytes) and returns the total.
+	AllocationTagStats snapshot(sfz::Array<AllocationTagStats>* tagsOut) const noexcept;
+
+	void* allocate(sfz::DbgInfo dbg, uint64_t size, uint64_t alignment = 32) noexcept override;
+	void deallocate(void* pointer) noexcept override;
+
+private:
+	const char* mName = "";
+	sfz::Allocator* mBacking = nullptr;
+	mutable std::mutex mMutex;
+	sfz::Array<AllocationTagStats> mTags;
+	AllocationTagStats mTotal;
+};
+
+// FrameArena
+// ------------------------------------------------------------------------------------------------
+
+constexpr uint32_t FRAME_ARENA_NUM_BUFFERS = 3;
+
+// Linear allocator for data that only lives for a frame. Allocating bumps an offset into the
+// current frame's buffer and deallocating does nothing, all of it is reclaimed at once when the
+// buffer is reused. There is one buffer per frame in flight, so data allocated during a frame
+// stays valid for the following FRAME_ARENA_NUM_BUFFERS - 1 frames.
+//
+// Allocations that do not fit are forwarded to the backing allocator (and counted as overflows),
+// so the arena never fails but the budget should be large enough that it never overflows.
+//
+// Several threads may allocate at the same time, but beginFrame() must not be called
+// concurrently with allocations.
+class FrameArena final : public sfz::Allocator {
+public:
+	// Constructors & destructors
+	// --------------------------------------------------------------------------------------------
+
+	FrameArena() noexcept = default;
+	FrameArena(const FrameArena&) = delete;
+	FrameArena& operator= (const FrameArena&) = delete;
+	FrameArena(FrameArena&&) = delete;
+	FrameArena& operator= (FrameArena&&) = delete;
+	~FrameArena() noexcept { this->destroy(); }
+
+	void init(uint64_t bytesPerFrame, sfz::Allocator* backing) noexcept;
+	void destroy() noexcept;
+
+	// Methods
+	// --------------------------------------------------------------------------------------------
+
+	// Switches to the buffer of the oldest frame and resets it.
+	void beginFrame() noexcept;
+
+	uint64_t bytesPerFrame() const { return mBytesPerFrame; }
+	uint64_t bytesUsed() const { return mOffset.load(std::memory_order_relaxed); }
+	uint64_t peakBytesUsed() const { return mPeakBytesUsed; }
+	uint32_t numOverflows() const { return mNumOverflows.load(std::memory_order_relaxed); }
+
+	void* allocate(sfz::DbgInfo dbg, uint64_t size, uint64_t alignment = 32) noexcept override;
+	void deallocate(void* pointer) noexcept override;
+
+private:
+	bool ownsMemory(const void* pointer) const noexcept;
+
+	sfz::Allocator* mBacking = nullptr;
+	uint8_t* mBuffers[FRAME_ARENA_NUM_BUFFERS] = {};
+	uint64_t mBytesPerFrame = 0;
+	uint32_t mCurrentBuffer = 0;
+	std::atomic_uint64_t mOffset{0};
+	std::atomic_uint32_t mNumOverflows{0}; // This frame
+	uint64_t mPeakBytesUsed = 0;
+};
+
+// Reinitializes an array holding data for the current frame only. It gets room for 25% more
+// elements than it held last frame (and at least minCapacity), so it rarely has to grow.
+template<typename T>
+void initFrameArray(sfz::Array<T>& array, uint32_t minCapacity, FrameArena& arena)
+{
+	const uint32_t capacity = sfz::max(minCapacity, array.size() + array.size() / 4);
+	array.init(capacity, &arena, sfz_dbg(""));
+}
@@ -0,0 +1,239 @@
+#include "Benchmark.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include <sfz/Logging.hpp>
+
+using sfz::vec3;
+
+// Statics
+// ------------------------------------------------------------------------------------------------
+
+static CameraKeyframe keyframe(float timeSecs, vec3 pos, vec3 dir) noexcept
+{
+	CameraKeyframe frame;
+	frame.timeSecs = timeSecs;
+	frame.pos = pos;
+	frame.dir = sfz::normalize(dir);
+	return frame;
+}
+
+static bool endsWith(const char* str, const char* suffix) noexcept
+{
+	const size_t strLen = strlen(str);
+	const size_t suffixLen = strlen(suffix);
+	return strLen >= suffixLen && strcmp(str + strLen - suffixLen, suffix) == 0;
+}
+
+// Camera path
+// ------------------------------------------------------------------------------------------------
+
+float CameraPath::durationSecs() const noexcept
+{
+	if (keyframes.isEmpty()) return 0.0f;
+	return keyframes.last().timeSecs - keyframes.first().timeSecs;
+}
+
+void CameraPath::evaluate(float timeSecs, vec3& posOut, vec3& dirOut) const noexcept
+{
+	sfz_assert(!keyframes.isEmpty());
+	const float duration = durationSecs();
+	if (keyframes.size() == 1 || !(duration > 0.0f)) {
+		posOut = keyframes.first().pos;
+		dirOut = keyframes.first().dir;
+		return;
+	}
+
+	const float t = keyframes.first().timeSecs + std::fmod(sfz::max(timeSecs, 0.0f), duration);
+	uint32_t idx = 0;
+	while (idx + 2 < keyframes.size() && keyframes[idx + 1].timeSecs <= t) idx += 1;
+	const CameraKeyframe& prev = keyframes[idx];
+	const CameraKeyframe& next = keyframes[idx + 1];
+	const float segmentSecs = next.timeSecs - prev.timeSecs;
+	const float alpha =
+		segmentSecs > 0.0f ? sfz::clamp((t - prev.timeSecs) / segmentSecs, 0.0f, 1.0f) : 1.0f;
+
+	posOut = prev.pos + (next.pos - prev.pos) * alpha;
+	const vec3 dir = prev.dir + (next.dir - prev.dir) * alpha;
+	dirOut = sfz::length(dir) > 0.001f ? sfz::normalize(dir) : next.dir;
+}
+
+bool loadCameraPath(const char* path, CameraPath& pathOut, sfz::Allocator* allocator) noexcept
+{
+	FILE* file = fopen(path, "r");
+	if (file == nullptr) {
+		SFZ_ERROR("Benchmark", "Could not open camera path \"%s\"", path);
+		return false;
+	}
+
+	pathOut.keyframes.init(64, allocator, sfz_dbg(""));
+	char line[256] = {};
+	uint32_t lineNumber = 0;
+	bool success = true;
+	while (fgets(line, sizeof(line), file) != nullptr) {
+		lineNumber += 1;
+		const char* begin = line;
+		while (*begin == ' ' || *begin == '\t') begin += 1;
+		if (*begin == '#' || *begin == '\n' || *begin == '\r' || *begin == '\0') continue;
+
+		float t = 0.0f;
+		vec3 pos, dir;
+		const int numRead = sscanf(begin, "%f %f %f %f %f %f %f",
+			&t, &pos.x, &pos.y, &pos.z, &dir.x, &dir.y, &dir.z);
+		if (numRead != 7 || !(sfz::length(dir) > 0.0f) ||
+			(!pathOut.keyframes.isEmpty() && t < pathOut.keyframes.last().timeSecs)) {
+			SFZ_ERROR("Benchmark", "Invalid keyframe on line %u of \"%s\"", lineNumber, path);
+			success = false;
+			break;
+		}
+		pathOut.keyframes.add(keyframe(t, pos, dir));
+	}
+	fclose(file);
+
+	if (success && pathOut.keyframes.isEmpty()) {
+		SFZ_ERROR("Benchmark", "Camera path \"%s\" has no keyframes", path);
+		success = false;
+	}
+	if (!success) pathOut.keyframes.destroy();
+	return success;
+}
+
+CameraPath createDefaultCameraPath(sfz::Allocator* allocator) noexcept
+{
+	// Down the atrium, up to the gallery and back along the other side
+	CameraPath path;
+	path.keyframes.init(8, allocator, sfz_dbg(""));
+	path.keyframes.add(keyframe(0.0f, vec3(-12.0f, 2.0f, 0.0f), vec3(1.0f, 0.0f, 0.0f)));
+	path.keyframes.add(keyframe(4.0f, vec3(8.0f, 2.0f, 0.0f), vec3(1.0f, 0.1f, 0.3f)));
+	path.keyframes.add(keyframe(6.0f, vec3(11.0f, 3.0f, -3.0f), vec3(-0.2f, 0.0f, 1.0f)));
+	path.keyframes.add(keyframe(8.0f, vec3(10.0f, 6.0f, 3.0f), vec3(-1.0f, -0.2f, 0.0f)));
+	path.keyframes.add(keyframe(12.0f, vec3(-10.0f, 6.0f, 3.0f), vec3(-1.0f, -0.3f, -0.4f)));
+	path.keyframes.add(keyframe(14.0f, vec3(-13.0f, 3.0f, -2.0f), vec3(0.5f, -0.1f, 1.0f)));
+	path.keyframes.add(keyframe(16.0f, vec3(-12.0f, 2.0f, 0.0f), vec3(1.0f, 0.0f, 0.0f)));
+	return path;
+}
+
+// Benchmark phases
+// ------------------------------------------------------------------------------------------------
+
+const char* toString(BenchmarkPhase phase) noexcept
+{
+	switch (phase) {
+	case BenchmarkPhase::INPUT: return "input";
+	case BenchmarkPhase::FIXED_UPDATE: return "fixed_update";
+	case BenchmarkPhase::STREAMING: return "streaming";
+	case BenchmarkPhase::LIGHT_LIST: return "light_list";
+	case BenchmarkPhase::RENDER_LIST: return "render_list";
+	case BenchmarkPhase::PASS_GBUFFER: return "pass_gbuffer";
+	case BenchmarkPhase::PASS_SHADOW_CASCADE_1: return "pass_shadow_cascade_1";
+	case BenchmarkPhase::PASS_SHADOW_CASCADE_2: return "pass_shadow_cascade_2";
+	case BenchmarkPhase::PASS_SHADOW_CASCADE_3: return "pass_shadow_cascade_3";
+	case BenchmarkPhase::SHADING: return "shading";
+	case BenchmarkPhase::SUBMIT: return "submit";
+	case BenchmarkPhase::FRAME: return "frame_total";
+	case BenchmarkPhase::COUNT: break;
+	}
+	return "<INVALID>";
+}
+
+// BenchmarkRecorder: Constructors & destructors
+// ------------------------------------------------------------------------------------------------
+
+void BenchmarkRecorder::init(
+	uint32_t numFrames, float deltaSecs, sfz::Allocator* allocator) noexcept
+{
+	this->destroy();
+	mNumFrames = numFrames;
+	mDeltaSecs = deltaSecs;
+	mAllocator = allocator;
+	mFrames.init(numFrames, allocator, sfz_dbg(""));
+	mCurrent = {};
+}
+
+void BenchmarkRecorder::destroy() noexcept
+{
+	mFrames.destroy();
+	mNumFrames = 0;
+	mDeltaSecs = 0.0f;
+	mAllocator = nullptr;
+	mCurrent = {};
+}
+
+// BenchmarkRecorder: Methods
+// ------------------------------------------------------------------------------------------------
+
+void BenchmarkRecorder::beginFrame() noexcept
+{
+	mCurrent = {};
+}
+
+void BenchmarkRecorder::endFrame() noexcept
+{
+	if (isDone()) return;
+	mFrames.add(mCurrent);
+}
+
+bool BenchmarkRecorder::writeResults(const char* path) const noexcept
+{
+	FILE* file = fopen(path, "w");
+	if (file == nullptr) {
+		SFZ_ERROR("Benchmark", "Could not open \"%s\" for writing", path);
+		return false;
+	}
+
+	if (endsWith(path, ".json")) {
+		fprintf(file, "{\n\t\"deltaSecs\": %.6f,\n\t\"numFrames\": %u,\n\t\"frames\": [\n",
+			mDeltaSecs, mFrames.size());
+		for (uint32_t i = 0; i < mFrames.size(); i++) {
+			fprintf(file, "\t\t{ \"frame\": %u", i);
+			for (uint32_t phase = 0; phase < NUM_BENCHMARK_PHASES; phase++) {
+				fprintf(file, ", \"%s\": %.4f",
+					toString(BenchmarkPhase(phase)), mFrames[i].phaseMs[phase]);
+			}
+			fprintf(file, " }%s\n", (i + 1) < mFrames.size() ? "," : "");
+		}
+		fprintf(file, "\t]\n}\n");
+	}
+	else {
+		fprintf(file, "frame");
+		for (uint32_t phase = 0; phase < NUM_BENCHMARK_PHASES; phase++) {
+			fprintf(file, ",%s", toString(BenchmarkPhase(phase)));
+		}
+		fprintf(file, "\n");
+		for (uint32_t i = 0; i < mFrames.size(); i++) {
+			fprintf(file, "%u", i);
+			for (uint32_t phase = 0; phase < NUM_BENCHMARK_PHASES; phase++) {
+				fprintf(file, ",%.4f", mFrames[i].phaseMs[phase]);
+			}
+			fprintf(file, "\n");
+		}
+	}
+
+	const bool success = ferror(file) == 0;
+	fclose(file);
+	if (!success) SFZ_ERROR("Benchmark", "Failed to write \"%s\"", path);
+	return success;
+}
+
+void BenchmarkRecorder::logSummary() const noexcept
+{
+	if (mFrames.isEmpty()) return;
+	sfz::Array<float> sorted;
+	sorted.init(mFrames.size(), mAllocator, sfz_dbg(""));
+	SFZ_INFO("Benchmark", "%u frames, timings in ms (mean / p95 / max):", mFrames.size());
+	for (uint32_t phase = 0; phase < NUM_BENCHMARK_PHASES; phase++) {
+		sorted.clear();
+		float sum = 0.0f;
+		for (const BenchmarkFrame& frame : mFrames) {
+			sorted.add(frame.phaseMs[phase]);
+			sum += frame.phaseMs[phase];
+		}
+		std::sort(sorted.begin(), sorted.end());
+		const uint32_t p95Idx = sfz::min(uint32_t(sorted.size() * 0.95f), sorted.size() - 1);
+		SFZ_INFO("Benchmark", "  %-22s %8.3f %8.3f %8.3f", toString(BenchmarkPhase(phase)),
+			sum / float(sorted.size()), sorted[p95Idx], sorted.last());
+	}
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <chrono>
+
+#include <skipifzero.hpp>
+#include <skipifzero_arrays.hpp>
+#include <skipifzero_math.hpp>
+
+// Camera path
+// ------------------------------------------------------------------------------------------------
+
+struct CameraKeyframe final {
+	float timeSecs = 0.0f;
+	sfz::vec3 pos = sfz::vec3(0.0f);
+	sfz::vec3 dir = sfz::vec3(0.0f, 0.0f, -1.0f);
+};
+
+// A camera path through keyframes sorted by time, positions and directions are linearly
+// interpolated between them. The path loops once it reaches its last keyframe.
+struct CameraPath final {
+	sfz::Array<CameraKeyframe> keyframes;
+
+	float durationSecs() const noexcept;
+	void evaluate(float timeSecs, sfz::vec3& posOut, sfz::vec3& dirOut) const noexcept;
+};
+
+// Loads a camera path from a text file with one keyframe per line: "time px py pz dx dy dz".
+// Empty lines and lines starting with '#' are ignored. Keyframes must be sorted by time.
+bool loadCameraPath(const char* path, CameraPath& pathOut, sfz::Allocator* allocator) noexcept;
+
+// A loop through the atrium of Sponza, used when no path is specified.
+CameraPath createDefaultCameraPath(sfz::Allocator* allocator) noexcept;
+
+// Benchmark phases
+// ------------------------------------------------------------------------------------------------
+
+enum class BenchmarkPhase : uint32_t {
+	INPUT = 0, // Event handling and ImGui update
+	FIXED_UPDATE, // FixedTimeStepper::runTickUpdates()
+	STREAMING, // Uploads of the streamed level
+	LIGHT_LIST, // Point light list, culling and batching
+	RENDER_LIST, // Gathering render entities
+	PASS_GBUFFER, // Recording of the geometry passes, in the order of GEOMETRY_PASS_NAMES
+	PASS_SHADOW_CASCADE_1,
+	PASS_SHADOW_CASCADE_2,
+	PASS_SHADOW_CASCADE_3,
+	SHADING, // Recording of the shading and copy out passes
+	SUBMIT, // Renderer::executeCommandList() and Renderer::frameFinish()
+	FRAME, // The entire update function
+	COUNT
+};
+
+constexpr uint32_t NUM_BENCHMARK_PHASES = uint32_t(BenchmarkPhase::COUNT);
+
+const char* toString(BenchmarkPhase phase) noexcept;
+
+// BenchmarkRecorder
+// ------------------------------------------------------------------------------------------------
+
+struct BenchmarkFrame final {
+	float phaseMs[NUM_BENCHMARK_PHASES] = {};
+};
+
+// Records the CPU time spent in each phase of a fixed number of frames.
+class BenchmarkRecorder final {
+public:
+	// Constructors & destructors
+	// --------------------------------------------------------------------------------------------
+
+	BenchmarkRecorder() noexcept = default;
+	BenchmarkRecorder(const BenchmarkRecorder&) = delete;
+	BenchmarkRecorder& operator= (const BenchmarkRecorder&) = delete;
+	BenchmarkRecorder(BenchmarkRecorder&&) = delete;
+	BenchmarkRecorder& operator= (BenchmarkRecorder&&) = delete;
+	~BenchmarkRecorder() noexcept { this->destroy(); }
+
+	void init(uint32_t numFrames, float deltaSecs, sfz::Allocator* allocator) noexcept;
+	void destroy() noexcept;
+
+	// Methods
+	// --------------------------------------------------------------------------------------------
+
+	uint32_t numFrames() const { return mNumFrames; }
+	uint32_t numRecordedFrames() const { return mFrames.size(); }
+	bool isDone() const { return mFrames.size() >= mNumFrames; }
+
+	// Adds time to a phase of the current frame. Different phases may be added to from different
+	// threads at the same time, but each phase only from one thread at a time.
+	void addPhaseTime(BenchmarkPhase phase, float ms) { mCurrent.phaseMs[uint32_t(phase)] += ms; }
+
+	// Clears the timings of the current frame.
+	void beginFrame() noexcept;
+
+	// Stores the timings of the current frame, ignored if all frames are already recorded.
+	void endFrame() noexcept;
+
+	// Writes the recorded frames as JSON if the path ends with ".json", otherwise as CSV. All
+	// timings are in milliseconds.
+	bool writeResults(const char* path) const noexcept;
+
+	// Logs the mean, 95th percentile and max of each phase.
+	void logSummary() const noexcept;
+
+private:
+	uint32_t mNumFrames = 0;
+	float mDeltaSecs = 0.0f;
+	sfz::Allocator* mAllocator = nullptr;
+	sfz::Array<BenchmarkFrame> mFrames;
+	BenchmarkFrame mCurrent;
+};
+
+// BenchmarkScope
+// ------------------------------------------------------------------------------------------------
+
+// Adds the time from construction until stop() (or destruction) to a phase of the recorder's
+// current frame. Does nothing if the recorder is nullptr.
+class BenchmarkScope final {
+public:
+	BenchmarkScope(const BenchmarkScope&) = delete;
+	BenchmarkScope& operator= (const BenchmarkScope&) = delete;
+	BenchmarkScope(BenchmarkScope&&) = delete;
+	BenchmarkScope& operator= (BenchmarkScope&&) = delete;
+
+	BenchmarkScope(BenchmarkRecorder* recorder, BenchmarkPhase phase) noexcept
+		: mRecorder(recorder), mPhase(phase)
+	{
+		if (mRecorder != nullptr) mStart = std::chrono::high_resolution_clock::now();
+	}
+	~BenchmarkScope() noexcept { this->stop(); }
+
+	void stop() noexcept
+	{
+		if (mRecorder == nullptr) return;
+		const float ms = std::chrono::duration_cast<std::chrono::duration<float, std::milli>>(
+			std::chrono::high_resolution_clock::now() - mStart).count();
+		mRecorder->addPhaseTime(mPhase, ms);
+		mRecorder = nullptr;
+	}
+
+private:
+	BenchmarkRecorder* mRecorder = nullptr;
+	BenchmarkPhase mPhase = BenchmarkPhase::FRAME;
+	std::chrono::high_resolution_clock::time_point mStart;
+};
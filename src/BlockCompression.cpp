@@ -0,0 +1,344 @@
+#include "BlockCompression.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <utility>
+
+// Statics
+// ------------------------------------------------------------------------------------------------
+
+// Reads a 4x4 block of RGBA8 pixels, pixels outside the image repeat the closest edge pixel
+static void loadBlock(
+	const uint8_t* rgba, int32_t width, int32_t height, int32_t blockX, int32_t blockY,
+	uint8_t block[64]) noexcept
+{
+	for (int32_t y = 0; y < 4; y++) {
+		const int32_t srcY = sfz::min(blockY * 4 + y, height - 1);
+		for (int32_t x = 0; x < 4; x++) {
+			const int32_t srcX = sfz::min(blockX * 4 + x, width - 1);
+			const uint8_t* src = rgba + (size_t(srcY) * size_t(width) + size_t(srcX)) * 4;
+			uint8_t* dst = block + (y * 4 + x) * 4;
+			for (int32_t c = 0; c < 4; c++) dst[c] = src[c];
+		}
+	}
+}
+
+// Writes the part of a 4x4 block of RGBA8 pixels that is inside the image
+static void storeBlock(
+	const uint8_t block[64], int32_t width, int32_t height, int32_t blockX, int32_t blockY,
+	uint8_t* rgba) noexcept
+{
+	for (int32_t y = 0; y < 4 && (blockY * 4 + y) < height; y++) {
+		for (int32_t x = 0; x < 4 && (blockX * 4 + x) < width; x++) {
+			const size_t dstIdx = size_t(blockY * 4 + y) * size_t(width) + size_t(blockX * 4 + x);
+			const uint8_t* src = block + (y * 4 + x) * 4;
+			for (int32_t c = 0; c < 4; c++) rgba[dstIdx * 4 + c] = src[c];
+		}
+	}
+}
+
+static uint16_t packRGB565(const int32_t rgb[3]) noexcept
+{
+	const uint32_t r = uint32_t(rgb[0] * 31 + 127) / 255;
+	const uint32_t g = uint32_t(rgb[1] * 63 + 127) / 255;
+	const uint32_t b = uint32_t(rgb[2] * 31 + 127) / 255;
+	return uint16_t((r << 11) | (g << 5) | b);
+}
+
+static void unpackRGB565(uint16_t color, int32_t rgbOut[3]) noexcept
+{
+	const int32_t r = (color >> 11) & 31;
+	const int32_t g = (color >> 5) & 63;
+	const int32_t b = color & 31;
+	rgbOut[0] = (r << 3) | (r >> 2);
+	rgbOut[1] = (g << 2) | (g >> 4);
+	rgbOut[2] = (b << 3) | (b >> 2);
+}
+
+// BC1 color block (4 color mode only), the endpoints are the bounding box of the colors in the
+// block, inset slightly to compensate for the quantization (see J.M.P. van Waveren, "Real-Time
+// DXT Compression"). The diagonal is flipped for channels that are anti-correlated with the
+// channel with the largest range.
+static void encodeBC1Block(const uint8_t block[64], uint8_t dst[8]) noexcept
+{
+	int32_t minColor[3] = { 255, 255, 255 };
+	int32_t maxColor[3] = { 0, 0, 0 };
+	int32_t mean[3] = {};
+	for (int32_t i = 0; i < 16; i++) {
+		for (int32_t c = 0; c < 3; c++) {
+			minColor[c] = sfz::min(minColor[c], int32_t(block[i * 4 + c]));
+			maxColor[c] = sfz::max(maxColor[c], int32_t(block[i * 4 + c]));
+			mean[c] += block[i * 4 + c];
+		}
+	}
+	int32_t refChannel = 0;
+	for (int32_t c = 0; c < 3; c++) {
+		mean[c] = (mean[c] + 8) / 16;
+		const int32_t inset = (maxColor[c] - minColor[c]) >> 4;
+		minColor[c] += inset;
+		maxColor[c] -= inset;
+		if ((maxColor[c] - minColor[c]) > (maxColor[refChannel] - minColor[refChannel])) {
+			refChannel = c;
+		}
+	}
+	for (int32_t c = 0; c < 3; c++) {
+		if (c == refChannel) continue;
+		int32_t covariance = 0;
+		for (int32_t i = 0; i < 16; i++) {
+			covariance += (block[i * 4 + refChannel] - mean[refChannel]) *
+				(block[i * 4 + c] - mean[c]);
+		}
+		if (covariance < 0) std::swap(minColor[c], maxColor[c]);
+	}
+
+	uint16_t color0 = packRGB565(maxColor);
+	uint16_t color1 = packRGB565(minColor);
+	if (color0 < color1) std::swap(color0, color1);
+
+	uint32_t indices = 0;
+	if (color0 != color1) {
+		int32_t palette[4][3];
+		unpackRGB565(color0, palette[0]);
+		unpackRGB565(color1, palette[1]);
+		for (int32_t c = 0; c < 3; c++) {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+		for (int32_t i = 0; i < 16; i++) {
+			uint32_t bestIdx = 0;
+			int32_t bestDist = INT32_MAX;
+			for (uint32_t p = 0; p < 4; p++) {
+				int32_t dist = 0;
+				for (int32_t c = 0; c < 3; c++) {
+					const int32_t diff = int32_t(block[i * 4 + c]) - palette[p][c];
+					dist += diff * diff;
+				}
+				if (dist < bestDist) {
+					bestDist = dist;
+					bestIdx = p;
+				}
+			}
+			indices |= bestIdx << (2 * i);
+		}
+	}
+
+	dst[0] = uint8_t(color0 & 0xFF);
+	dst[1] = uint8_t(color0 >> 8);
+	dst[2] = uint8_t(color1 & 0xFF);
+	dst[3] = uint8_t(color1 >> 8);
+	for (int32_t i = 0; i < 4; i++) dst[4 + i] = uint8_t(indices >> (8 * i));
+}
+
+// Decodes the RGB of a BC1 color block. If BC1 is used on its own color0 <= color1 selects the 3
+// color mode with transparent black, inside BC3 blocks the 4 color mode is always used.
+static void decodeBC1Block(
+	const uint8_t src[8], bool allowThreeColorMode, uint8_t block[64]) noexcept
+{
+	const uint16_t color0 = uint16_t(src[0] | (src[1] << 8));
+	const uint16_t color1 = uint16_t(src[2] | (src[3] << 8));
+	uint32_t indices = 0;
+	for (int32_t i = 0; i < 4; i++) indices |= uint32_t(src[4 + i]) << (8 * i);
+
+	int32_t palette[4][4];
+	unpackRGB565(color0, palette[0]);
+	unpackRGB565(color1, palette[1]);
+	palette[0][3] = 255;
+	palette[1][3] = 255;
+	palette[2][3] = 255;
+	palette[3][3] = 255;
+	if (color0 > color1 || !allowThreeColorMode) {
+		for (int32_t c = 0; c < 3; c++) {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+	}
+	else {
+		for (int32_t c = 0; c < 3; c++) {
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = 0;
+		}
+		palette[3][3] = 0;
+	}
+
+	for (int32_t i = 0; i < 16; i++) {
+		const uint32_t idx = (indices >> (2 * i)) & 3;
+		for (int32_t c = 0; c < 4; c++) block[i * 4 + c] = uint8_t(palette[idx][c]);
+	}
+}
+
+// BC4 block (single channel) in 8 value mode, endpoints are the min and max values
+static void encodeBC4Block(const uint8_t block[64], int32_t channel, uint8_t dst[8]) noexcept
+{
+	int32_t minVal = 255;
+	int32_t maxVal = 0;
+	for (int32_t i = 0; i < 16; i++) {
+		minVal = sfz::min(minVal, int32_t(block[i * 4 + channel]));
+		maxVal = sfz::max(maxVal, int32_t(block[i * 4 + channel]));
+	}
+
+	uint64_t indices = 0;
+	const int32_t range = maxVal - minVal;
+	if (range > 0) {
+		for (int32_t i = 0; i < 16; i++) {
+			// Position along the ramp from max (0) to min (7), mapped to the BC4 index order
+			const int32_t dist = maxVal - int32_t(block[i * 4 + channel]);
+			const int32_t pos = (dist * 7 + range / 2) / range;
+			const uint64_t idx = pos == 0 ? 0 : (pos == 7 ? 1 : uint64_t(pos + 1));
+			indices |= idx << (3 * i);
+		}
+	}
+
+	dst[0] = uint8_t(maxVal);
+	dst[1] = uint8_t(minVal);
+	for (int32_t i = 0; i < 6; i++) dst[2 + i] = uint8_t(indices >> (8 * i));
+}
+
+static void decodeBC4Block(const uint8_t src[8], int32_t channel, uint8_t block[64]) noexcept
+{
+	const int32_t val0 = src[0];
+	const int32_t val1 = src[1];
+	uint64_t indices = 0;
+	for (int32_t i = 0; i < 6; i++) indices |= uint64_t(src[2 + i]) << (8 * i);
+
+	int32_t palette[8];
+	palette[0] = val0;
+	palette[1] = val1;
+	if (val0 > val1) {
+		for (int32_t k = 2; k < 8; k++) palette[k] = ((8 - k) * val0 + (k - 1) * val1) / 7;
+	}
+	else {
+		for (int32_t k = 2; k < 6; k++) palette[k] = ((6 - k) * val0 + (k - 1) * val1) / 5;
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+
+	for (int32_t i = 0; i < 16; i++) {
+		block[i * 4 + channel] = uint8_t(palette[(indices >> (3 * i)) & 7]);
+	}
+}
+
+// Reconstructs z of a normal stored in the red and green channels
+static void reconstructNormalZ(uint8_t block[64]) noexcept
+{
+	for (int32_t i = 0; i < 16; i++) {
+		const float x = float(block[i * 4 + 0]) * (2.0f / 255.0f) - 1.0f;
+		const float y = float(block[i * 4 + 1]) * (2.0f / 255.0f) - 1.0f;
+		const float z = std::sqrt(sfz::max(1.0f - x * x - y * y, 0.0f));
+		block[i * 4 + 2] = uint8_t(std::round((z * 0.5f + 0.5f) * 255.0f));
+		block[i * 4 + 3] = 255;
+	}
+}
+
+// Block compression formats
+// ------------------------------------------------------------------------------------------------
+
+const char* toString(BlockFormat format) noexcept
+{
+	switch (format) {
+	case BlockFormat::NONE: return "NONE";
+	case BlockFormat::BC1: return "BC1";
+	case BlockFormat::BC3: return "BC3";
+	case BlockFormat::BC5: return "BC5";
+	}
+	return "<INVALID>";
+}
+
+// Encoding & decoding
+// ------------------------------------------------------------------------------------------------
+
+bool rgbaIsOpaque(const uint8_t* rgba, int32_t width, int32_t height) noexcept
+{
+	const size_t numPixels = size_t(width) * size_t(height);
+	for (size_t i = 0; i < numPixels; i++) {
+		if (rgba[i * 4 + 3] != 255) return false;
+	}
+	return true;
+}
+
+BlockFormat chooseBlockFormat(
+	const uint8_t* rgba, int32_t width, int32_t height, TextureUsage usage) noexcept
+{
+	if (usage == TextureUsage::NORMAL_MAP) return BlockFormat::BC5;
+	return rgbaIsOpaque(rgba, width, height) ? BlockFormat::BC1 : BlockFormat::BC3;
+}
+
+uint32_t blockFormatBytesPerBlock(BlockFormat format) noexcept
+{
+	switch (format) {
+	case BlockFormat::NONE: return 0;
+	case BlockFormat::BC1: return 8;
+	case BlockFormat::BC3: return 16;
+	case BlockFormat::BC5: return 16;
+	}
+	return 0;
+}
+
+uint64_t blockCompressedSize(BlockFormat format, int32_t width, int32_t height) noexcept
+{
+	const uint64_t numBlocksX = uint64_t(width + 3) / 4;
+	const uint64_t numBlocksY = uint64_t(height + 3) / 4;
+	return numBlocksX * numBlocksY * blockFormatBytesPerBlock(format);
+}
+
+void blockCompress(
+	BlockFormat format, const uint8_t* rgba, int32_t width, int32_t height, uint8_t* dst) noexcept
+{
+	sfz_assert(format != BlockFormat::NONE);
+	const int32_t numBlocksX = (width + 3) / 4;
+	const int32_t numBlocksY = (height + 3) / 4;
+	const uint32_t bytesPerBlock = blockFormatBytesPerBlock(format);
+	uint8_t block[64];
+	for (int32_t blockY = 0; blockY < numBlocksY; blockY++) {
+		for (int32_t blockX = 0; blockX < numBlocksX; blockX++) {
+			loadBlock(rgba, width, height, blockX, blockY, block);
+			switch (format) {
+			case BlockFormat::BC1:
+				encodeBC1Block(block, dst);
+				break;
+			case BlockFormat::BC3:
+				encodeBC4Block(block, 3, dst);
+				encodeBC1Block(block, dst + 8);
+				break;
+			case BlockFormat::BC5:
+				encodeBC4Block(block, 0, dst);
+				encodeBC4Block(block, 1, dst + 8);
+				break;
+			case BlockFormat::NONE:
+				break;
+			}
+			dst += bytesPerBlock;
+		}
+	}
+}
+
+void blockDecompress(
+	BlockFormat format, const uint8_t* src, int32_t width, int32_t height, uint8_t* rgba) noexcept
+{
+	sfz_assert(format != BlockFormat::NONE);
+	const int32_t numBlocksX = (width + 3) / 4;
+	const int32_t numBlocksY = (height + 3) / 4;
+	const uint32_t bytesPerBlock = blockFormatBytesPerBlock(format);
+	uint8_t block[64];
+	for (int32_t blockY = 0; blockY < numBlocksY; blockY++) {
+		for (int32_t blockX = 0; blockX < numBlocksX; blockX++) {
+			switch (format) {
+			case BlockFormat::BC1:
+				decodeBC1Block(src, true, block);
+				break;
+			case BlockFormat::BC3:
+				decodeBC1Block(src + 8, false, block);
+				decodeBC4Block(src, 3, block);
+				break;
+			case BlockFormat::BC5:
+				decodeBC4Block(src, 0, block);
+				decodeBC4Block(src + 8, 1, block);
+				reconstructNormalZ(block);
+				break;
+			case BlockFormat::NONE:
+				break;
+			}
+			storeBlock(block, width, height, blockX, blockY, rgba);
+			src += bytesPerBlock;
+		}
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <skipifzero.hpp>
+
+// Block compression formats
+// ------------------------------------------------------------------------------------------------
+
+// The BCn formats used for textures. All of them store 4x4 pixel blocks, textures whose
+// dimensions are not multiples of 4 have their edge pixels repeated to fill the last blocks.
+enum class BlockFormat : uint32_t {
+	NONE = 0, // Not compressed
+	BC1 = 1, // RGB, 8 bytes per block
+	BC3 = 2, // RGBA (BC1 color + BC4 alpha), 16 bytes per block
+	BC5 = 3, // RG (two BC4 channels), 16 bytes per block. Used for normal maps.
+};
+
+const char* toString(BlockFormat format) noexcept;
+
+// What a texture is used for, decides which format it is compressed with.
+enum class TextureUsage : uint32_t {
+	COLOR = 0, // Albedo, metallic-roughness, emissive, etc.
+	NORMAL_MAP = 1, // Only xy is stored, z is reconstructed when decompressing
+};
+
+// Encoding & decoding
+// ------------------------------------------------------------------------------------------------
+
+// Whether every pixel of a RGBA8 image has alpha 255.
+bool rgbaIsOpaque(const uint8_t* rgba, int32_t width, int32_t height) noexcept;
+
+// Picks the format to compress a RGBA8 image with. BC3 is only used for color textures that have
+// non-opaque pixels.
+BlockFormat chooseBlockFormat(
+	const uint8_t* rgba, int32_t width, int32_t height, TextureUsage usage) noexcept;
+
+uint32_t blockFormatBytesPerBlock(BlockFormat format) noexcept;
+uint64_t blockCompressedSize(BlockFormat format, int32_t width, int32_t height) noexcept;
+
+// Compresses a RGBA8 image, dst must be blockCompressedSize() bytes.
+void blockCompress(
+	BlockFormat format, const uint8_t* rgba, int32_t width, int32_t height, uint8_t* dst) noexcept;
+
+// Decompresses into a RGBA8 image, dst must be width * height * 4 bytes.
+void blockDecompress(
+	BlockFormat format, const uint8_t* src, int32_t width, int32_t height, uint8_t* rgba) noexcept;
@@ -0,0 +1,266 @@
+#include "Bvh.hpp"
+
+#include <algorithm>
+
+using sfz::vec3;
+
+// Statics
+// ------------------------------------------------------------------------------------------------
+
+constexpr uint32_t BVH_NUM_BINS = 16;
+
+// Cost of traversing a node relative to testing a primitive, used by the SAH
+constexpr float BVH_TRAVERSAL_COST = 1.0f;
+
+// Nodes on the frustum query stack are marked with this bit if completely inside the frustum
+constexpr uint32_t INSIDE_BIT = 1u << 31;
+
+static float surfaceArea(const BoundingBox& box) noexcept
+{
+	if (box.isEmpty()) return 0.0f;
+	const vec3 size = box.max - box.min;
+	return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+// Bvh: Constructors & destructors
+// ------------------------------------------------------------------------------------------------
+
+void Bvh::build(const BoundingBox* bounds, uint32_t numBounds, sfz::Allocator* allocator) noexcept
+{
+	this->destroy();
+	mNodes.init(sfz::max(2 * numBounds, 1u), allocator, sfz_dbg("Bvh::mNodes"));
+	mPrimitives.init(numBounds, allocator, sfz_dbg("Bvh::mPrimitives"));
+	mPrimitiveBounds.init(numBounds, allocator, sfz_dbg("Bvh::mPrimitiveBounds"));
+	if (numBounds == 0) return;
+
+	mCentroids.init(numBounds, allocator, sfz_dbg(""));
+	for (uint32_t i = 0; i < numBounds; i++) {
+		mPrimitives.add(i);
+		mCentroids.add(bounds[i].isEmpty() ? vec3(0.0f) : bounds[i].center());
+	}
+	buildNode(bounds, 0, numBounds, 0);
+	for (uint32_t primitive : mPrimitives) mPrimitiveBounds.add(bounds[primitive]);
+	mCentroids.destroy();
+}
+
+void Bvh::destroy() noexcept
+{
+	mNodes.destroy();
+	mPrimitives.destroy();
+	mPrimitiveBounds.destroy();
+	mCentroids.destroy();
+}
+
+// Bvh: Methods
+// ------------------------------------------------------------------------------------------------
+
+void Bvh::queryFrustum(
+	const FrustumPlanes& frustum, sfz::Array<uint32_t>& primitivesOut) const noexcept
+{
+	if (mNodes.isEmpty()) return;
+	uint32_t stack[BVH_MAX_DEPTH + 2];
+	uint32_t stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0) {
+		const uint32_t entry = stack[--stackSize];
+		const uint32_t nodeIdx = entry & ~INSIDE_BIT;
+		const BvhNode& node = mNodes[nodeIdx];
+		bool inside = (entry & INSIDE_BIT) != 0;
+		if (!inside) {
+			const Containment containment = testContainment(frustum, node.bounds);
+			if (containment == Containment::OUTSIDE) continue;
+			inside = containment == Containment::INSIDE;
+		}
+
+		if (node.isLeaf()) {
+			for (uint32_t i = 0; i < node.numPrimitives; i++) {
+				const uint32_t idx = node.rightChildOrFirst + i;
+				if (inside || intersects(frustum, mPrimitiveBounds[idx])) {
+					primitivesOut.add(mPrimitives[idx]);
+				}
+			}
+			continue;
+		}
+		const uint32_t insideBit = inside ? INSIDE_BIT : 0u;
+		stack[stackSize++] = node.rightChildOrFirst | insideBit;
+		stack[stackSize++] = (nodeIdx + 1) | insideBit;
+	}
+}
+
+void Bvh::querySphere(
+	vec3 center, float radius, sfz::Array<uint32_t>& primitivesOut) const noexcept
+{
+	if (mNodes.isEmpty()) return;
+	uint32_t stack[BVH_MAX_DEPTH + 2];
+	uint32_t stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0) {
+		const uint32_t nodeIdx = stack[--stackSize];
+		const BvhNode& node = mNodes[nodeIdx];
+		if (!intersectsSphere(node.bounds, center, radius)) continue;
+
+		if (node.isLeaf()) {
+			for (uint32_t i = 0; i < node.numPrimitives; i++) {
+				const uint32_t idx = node.rightChildOrFirst + i;
+				if (intersectsSphere(mPrimitiveBounds[idx], center, radius)) {
+					primitivesOut.add(mPrimitives[idx]);
+				}
+			}
+			continue;
+		}
+		stack[stackSize++] = node.rightChildOrFirst;
+		stack[stackSize++] = nodeIdx + 1;
+	}
+}
+
+uint32_t Bvh::raycast(vec3 origin, vec3 dir, float maxDist, float* distOut) const noexcept
+{
+	if (mNodes.isEmpty()) return ~0u;
+	vec3 invDir;
+	for (uint32_t i = 0; i < 3; i++) invDir[i] = dir[i] != 0.0f ? 1.0f / dir[i] : FLT_MAX;
+
+	// Nodes are visited front to back, skipping those further away than the closest hit so far
+	struct StackEntry final {
+		uint32_t nodeIdx;
+		float dist;
+	};
+	StackEntry stack[BVH_MAX_DEPTH + 2];
+	uint32_t stackSize = 0;
+	float rootDist = 0.0f;
+	if (!intersectsRay(mNodes[0].bounds, origin, invDir, maxDist, rootDist)) return ~0u;
+	stack[stackSize++] = { 0, rootDist };
+
+	uint32_t closest = ~0u;
+	float closestDist = maxDist;
+	while (stackSize > 0) {
+		const StackEntry entry = stack[--stackSize];
+		if (entry.dist > closestDist) continue;
+		const BvhNode& node = mNodes[entry.nodeIdx];
+
+		if (node.isLeaf()) {
+			for (uint32_t i = 0; i < node.numPrimitives; i++) {
+				const uint32_t idx = node.rightChildOrFirst + i;
+				float dist = 0.0f;
+				if (intersectsRay(mPrimitiveBounds[idx], origin, invDir, closestDist, dist)) {
+					closest = mPrimitives[idx];
+					closestDist = dist;
+				}
+			}
+			continue;
+		}
+
+		// Push the further child first so the nearer one is visited first
+		StackEntry left = { entry.nodeIdx + 1, 0.0f };
+		StackEntry right = { node.rightChildOrFirst, 0.0f };
+		const bool hitLeft =
+			intersectsRay(mNodes[left.nodeIdx].bounds, origin, invDir, closestDist, left.dist);
+		const bool hitRight =
+			intersectsRay(mNodes[right.nodeIdx].bounds, origin, invDir, closestDist, right.dist);
+		if (hitLeft && hitRight) {
+			if (left.dist < right.dist) std::swap(left, right);
+			stack[stackSize++] = left;
+			stack[stackSize++] = right;
+		}
+		else if (hitLeft) {
+			stack[stackSize++] = left;
+		}
+		else if (hitRight) {
+			stack[stackSize++] = right;
+		}
+	}
+
+	if (distOut != nullptr && closest != ~0u) *distOut = closestDist;
+	return closest;
+}
+
+// Bvh: Private methods
+// ------------------------------------------------------------------------------------------------
+
+uint32_t Bvh::buildNode(
+	const BoundingBox* bounds, uint32_t first, uint32_t count, uint32_t depth) noexcept
+{
+	const uint32_t nodeIdx = mNodes.size();
+	mNodes.add(BvhNode());
+	BoundingBox nodeBounds;
+	BoundingBox centroidBounds;
+	for (uint32_t i = first; i < (first + count); i++) {
+		nodeBounds.add(bounds[mPrimitives[i]]);
+		centroidBounds.add(mCentroids[mPrimitives[i]]);
+	}
+	mNodes[nodeIdx].bounds = nodeBounds;
+
+	auto makeLeaf = [&]() {
+		mNodes[nodeIdx].rightChildOrFirst = first;
+		mNodes[nodeIdx].numPrimitives = count;
+		return nodeIdx;
+	};
+	if (count == 1 || depth >= BVH_MAX_DEPTH) return makeLeaf();
+
+	// Find the cheapest split between bins of centroids, along any axis
+	struct Bin final {
+		BoundingBox bounds;
+		uint32_t count = 0;
+	};
+	float bestCost = FLT_MAX;
+	uint32_t bestAxis = ~0u;
+	uint32_t bestSplit = 0; // Bins <= bestSplit go to the left child
+	auto binIdx = [&](uint32_t primitive, uint32_t axis) {
+		const float extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+		const float scale = float(BVH_NUM_BINS) / extent;
+		const float offset = mCentroids[primitive][axis] - centroidBounds.min[axis];
+		return sfz::min(uint32_t(offset * scale), BVH_NUM_BINS - 1);
+	};
+	for (uint32_t axis = 0; axis < 3; axis++) {
+		if (!(centroidBounds.max[axis] > centroidBounds.min[axis])) continue;
+		Bin bins[BVH_NUM_BINS];
+		for (uint32_t i = first; i < (first + count); i++) {
+			Bin& bin = bins[binIdx(mPrimitives[i], axis)];
+			bin.bounds.add(bounds[mPrimitives[i]]);
+			bin.count += 1;
+		}
+
+		// Sweep from the right to get the cost of each right side, then from the left
+		float rightCosts[BVH_NUM_BINS - 1];
+		BoundingBox rightBounds;
+		uint32_t rightCount = 0;
+		for (uint32_t i = BVH_NUM_BINS - 1; i > 0; i--) {
+			rightBounds.add(bins[i].bounds);
+			rightCount += bins[i].count;
+			rightCosts[i - 1] = rightCount == 0 ? -1.0f : surfaceArea(rightBounds) * rightCount;
+		}
+		BoundingBox leftBounds;
+		uint32_t leftCount = 0;
+		for (uint32_t i = 0; i < (BVH_NUM_BINS - 1); i++) {
+			leftBounds.add(bins[i].bounds);
+			leftCount += bins[i].count;
+			if (leftCount == 0 || rightCosts[i] < 0.0f) continue;
+			const float cost = surfaceArea(leftBounds) * leftCount + rightCosts[i];
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = i;
+			}
+		}
+	}
+
+	// All centroids in the same place, can't split
+	if (bestAxis == ~0u) return makeLeaf();
+
+	const float splitCost =
+		BVH_TRAVERSAL_COST + bestCost / sfz::max(surfaceArea(nodeBounds), FLT_MIN);
+	if (count <= BVH_MAX_LEAF_SIZE && float(count) <= splitCost) return makeLeaf();
+
+	uint32_t* begin = mPrimitives.data() + first;
+	uint32_t* mid = std::partition(begin, begin + count, [&](uint32_t primitive) {
+		return binIdx(primitive, bestAxis) <= bestSplit;
+	});
+	const uint32_t numLeft = uint32_t(mid - begin);
+	sfz_assert(numLeft > 0 && numLeft < count);
+
+	const uint32_t leftIdx = buildNode(bounds, first, numLeft, depth + 1);
+	sfz_assert(leftIdx == nodeIdx + 1);
+	(void)leftIdx;
+	const uint32_t rightIdx = buildNode(bounds, first + numLeft, count - numLeft, depth + 1);
+	mNodes[nodeIdx].rightChildOrFirst = rightIdx;
+	return nodeIdx;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <skipifzero.hpp>
+#include <skipifzero_arrays.hpp>
+#include <skipifzero_math.hpp>
+
+#include "Culling.hpp"
+
+// BVH constants
+// ------------------------------------------------------------------------------------------------
+
+// Nodes with at most this many primitives are turned into leaves if that is cheaper (according to
+// the SAH) than splitting them further
+constexpr uint32_t BVH_MAX_LEAF_SIZE = 4;
+
+// Nodes this deep are always leaves, bounds the traversal stacks
+constexpr uint32_t BVH_MAX_DEPTH = 48;
+
+// BvhNode
+// ------------------------------------------------------------------------------------------------
+
+// Nodes are stored depth first, so the left child of an internal node is always the next node
+// and only the index of the right child has to be stored. Two nodes fit in a cache line.
+struct BvhNode final {
+	BoundingBox bounds;
+	uint32_t rightChildOrFirst = 0; // Right child if internal, first primitive index if leaf
+	uint32_t numPrimitives = 0; // 0 for internal nodes
+
+	bool isLeaf() const { return numPrimitives != 0; }
+};
+static_assert(sizeof(BvhNode) == 32, "BvhNode is padded");
+
+// Bvh
+// ------------------------------------------------------------------------------------------------
+
+// Bounding volume hierarchy over a set of bounding boxes (primitives), identified by their index
+// in the array the BVH was built from. Built top-down using a binned surface area heuristic.
+// Static, has to be rebuilt if any of the boxes change.
+class Bvh final {
+public:
+	// Constructors & destructors
+	// --------------------------------------------------------------------------------------------
+
+	Bvh() noexcept = default;
+	Bvh(const Bvh&) = delete;
+	Bvh& operator= (const Bvh&) = delete;
+	Bvh(Bvh&&) = delete;
+	Bvh& operator= (Bvh&&) = delete;
+	~Bvh() noexcept { this->destroy(); }
+
+	// Builds the BVH, replacing the previous one (if any).
+	void build(const BoundingBox* bounds, uint32_t numBounds, sfz::Allocator* allocator) noexcept;
+	void destroy() noexcept;
+
+	// Methods
+	// --------------------------------------------------------------------------------------------
+
+	uint32_t numNodes() const { return mNodes.size(); }
+	uint32_t numPrimitives() const { return mPrimitives.size(); }
+
+	// Appends the primitives (potentially) inside the frustum. Conservative in the same way as
+	// intersects(), subtrees completely inside the frustum are added without further tests.
+	void queryFrustum(
+		const FrustumPlanes& frustum, sfz::Array<uint32_t>& primitivesOut) const noexcept;
+
+	// Appends the primitives whose bounds intersect the sphere.
+	void querySphere(
+		sfz::vec3 center, float radius, sfz::Array<uint32_t>& primitivesOut) const noexcept;
+
+	// Returns the primitive whose bounds are hit first by the ray (within maxDist), ~0u if none.
+	// The direction does not need to be normalized, distances are in multiples of it.
+	uint32_t raycast(
+		sfz::vec3 origin, sfz::vec3 dir, float maxDist, float* distOut = nullptr) const noexcept;
+
+private:
+	uint32_t buildNode(
+		const BoundingBox* bounds, uint32_t first, uint32_t count, uint32_t depth) noexcept;
+
+	sfz::Array<BvhNode> mNodes;
+
+	// Leaves reference ranges of these, the primitives' indices and bounds in leaf order
+	sfz::Array<uint32_t> mPrimitives;
+	sfz::Array<BoundingBox> mPrimitiveBounds;
+
+	sfz::Array<sfz::vec3> mCentroids; // Only used while building, indexed by primitive
+};
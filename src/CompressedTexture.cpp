@@ -0,0 +1,69 @@
+#include "CompressedTexture.hpp"
+
+#include <sfz/Logging.hpp>
+
+// CompressedTexture
+// ------------------------------------------------------------------------------------------------
+
+TextureUsage textureUsageInMesh(const sfz::Mesh& mesh, sfz::strID textureId) noexcept
+{
+	for (const sfz::Material& material : mesh.materials) {
+		if (material.normalTex == textureId) return TextureUsage::NORMAL_MAP;
+	}
+	return TextureUsage::COLOR;
+}
+
+bool loadCompressedTexture(
+	sfz::strID globalPathId,
+	TextureUsage usage,
+	bool useBlockCompression,
+	sfz::Allocator* allocator,
+	CompressedTexture& textureOut) noexcept
+{
+	const char* path = globalPathId.str();
+	sfz::Image image = sfz::loadImage("", path);
+	if (image.rawData.size() == 0) {
+		SFZ_ERROR("PhantasyTestbed", "Failed to decode image: %s", path);
+		return false;
+	}
+	textureOut.desc.type = image.type;
+	textureOut.desc.width = image.width;
+	textureOut.desc.height = image.height;
+	textureOut.desc.bytesPerPixel = image.bytesPerPixel;
+
+	// Only RGBA8 images are compressed
+	if (!useBlockCompression || image.type != sfz::ImageType::RGBA_U8) {
+		textureOut.desc.format = BlockFormat::NONE;
+		textureOut.data = std::move(image.rawData);
+		return true;
+	}
+
+	textureOut.desc.format =
+		chooseBlockFormat(image.rawData.data(), image.width, image.height, usage);
+	const uint32_t dataSize = uint32_t(textureOut.desc.dataSize());
+	textureOut.data.init(dataSize, allocator, sfz_dbg(""));
+	textureOut.data.add(uint8_t(0), dataSize);
+	blockCompress(textureOut.desc.format,
+		image.rawData.data(), image.width, image.height, textureOut.data.data());
+	return true;
+}
+
+sfz::Image decompressTexture(
+	const CompressedTextureDesc& desc, const uint8_t* data, sfz::Allocator* allocator) noexcept
+{
+	sfz::Image image;
+	image.type = desc.type;
+	image.width = desc.width;
+	image.height = desc.height;
+	image.bytesPerPixel = desc.bytesPerPixel;
+	const uint32_t numBytes = uint32_t(desc.width * desc.height * desc.bytesPerPixel);
+	image.rawData.init(numBytes, allocator, sfz_dbg(""));
+	if (desc.format == BlockFormat::NONE) {
+		image.rawData.add(data, numBytes);
+	}
+	else {
+		image.rawData.add(uint8_t(0), numBytes);
+		blockDecompress(desc.format, data, desc.width, desc.height, image.rawData.data());
+	}
+	return image;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <skipifzero.hpp>
+#include <skipifzero_arrays.hpp>
+#include <skipifzero_strings.hpp>
+
+#include <sfz/rendering/Image.hpp>
+#include <sfz/rendering/Mesh.hpp>
+
+#include "BlockCompression.hpp"
+
+// CompressedTexture
+// ------------------------------------------------------------------------------------------------
+
+// Describes a texture that is possibly block compressed, only used to store textures in scene
+// packages. The renderer (sfz::ImageType and the ZeroG texture formats) has no block compressed
+// formats, so compressed textures are decompressed to RGBA8 before they are uploaded. This only
+// makes packages smaller on disk, VRAM and upload sizes are unchanged.
+struct CompressedTextureDesc final {
+	BlockFormat format = BlockFormat::NONE;
+	sfz::ImageType type = sfz::ImageType::UNDEFINED; // Type of the decompressed image
+	int32_t width = 0;
+	int32_t height = 0;
+	int32_t bytesPerPixel = 0; // Of the decompressed image
+
+	uint64_t dataSize() const
+	{
+		if (format != BlockFormat::NONE) return blockCompressedSize(format, width, height);
+		return uint64_t(width) * uint64_t(height) * uint64_t(bytesPerPixel);
+	}
+};
+
+struct CompressedTexture final {
+	CompressedTextureDesc desc;
+	sfz::Array<uint8_t> data; // Blocks, or raw pixels if not compressed
+};
+
+// Returns NORMAL_MAP if any material in the mesh uses the texture as a normal map.
+TextureUsage textureUsageInMesh(const sfz::Mesh& mesh, sfz::strID textureId) noexcept;
+
+// Loads the image file at the given global path as a CompressedTexture. If useBlockCompression
+// is set RGBA8 images are block compressed, other image types are returned uncompressed.
+bool loadCompressedTexture(
+	sfz::strID globalPathId,
+	TextureUsage usage,
+	bool useBlockCompression,
+	sfz::Allocator* allocator,
+	CompressedTexture& textureOut) noexcept;
+
+// Decompresses (or copies, if not compressed) texture data into an image that can be uploaded.
+sfz::Image decompressTexture(
+	const CompressedTextureDesc& desc, const uint8_t* data, sfz::Allocator* allocator) noexcept;
@@ -0,0 +1,122 @@
+#include "Culling.hpp"
+
+#include <algorithm>
+
+using sfz::mat4;
+using sfz::mat34;
+using sfz::vec3;
+using sfz::vec4;
+
+// BoundingBox
+// ------------------------------------------------------------------------------------------------
+
+BoundingBox transformBoundingBox(const mat34& transform, const BoundingBox& box) noexcept
+{
+	if (box.isEmpty()) return box;
+
+	// Arvo's method, transform center and project extents onto the new axes
+	const vec3 center = box.center();
+	const vec3 halfExtents = box.halfExtents();
+	vec3 newCenter;
+	vec3 newHalfExtents;
+	for (uint32_t i = 0; i < 3; i++) {
+		const vec4 row = transform.row(i);
+		newCenter[i] = dot(row.xyz, center) + row.w;
+		newHalfExtents[i] =
+			std::abs(row.x) * halfExtents.x +
+			std::abs(row.y) * halfExtents.y +
+			std::abs(row.z) * halfExtents.z;
+	}
+
+	BoundingBox result;
+	result.min = newCenter - newHalfExtents;
+	result.max = newCenter + newHalfExtents;
+	return result;
+}
+
+// FrustumPlanes
+// ------------------------------------------------------------------------------------------------
+
+FrustumPlanes frustumFromMatrix(const mat4& projViewMatrix) noexcept
+{
+	// Gribb & Hartmann plane extraction
+	const vec4 r0 = projViewMatrix.row(0);
+	const vec4 r1 = projViewMatrix.row(1);
+	const vec4 r2 = projViewMatrix.row(2);
+	const vec4 r3 = projViewMatrix.row(3);
+
+	FrustumPlanes frustum;
+	frustum.planes[0] = r3 + r0; // Left
+	frustum.planes[1] = r3 - r0; // Right
+	frustum.planes[2] = r3 + r1; // Bottom
+	frustum.planes[3] = r3 - r1; // Top
+	frustum.planes[4] = r2; // z >= 0
+	frustum.planes[5] = r3 - r2; // z <= w
+	return frustum;
+}
+
+bool intersects(const FrustumPlanes& frustum, const BoundingBox& box) noexcept
+{
+	for (const vec4& plane : frustum.planes) {
+
+		// Test the corner furthest along the plane normal, if it is outside the box is outside
+		vec3 p;
+		p.x = plane.x >= 0.0f ? box.max.x : box.min.x;
+		p.y = plane.y >= 0.0f ? box.max.y : box.min.y;
+		p.z = plane.z >= 0.0f ? box.max.z : box.min.z;
+		if ((dot(plane.xyz, p) + plane.w) < 0.0f) return false;
+	}
+	return true;
+}
+
+Containment testContainment(const FrustumPlanes& frustum, const BoundingBox& box) noexcept
+{
+	Containment result = Containment::INSIDE;
+	for (const vec4& plane : frustum.planes) {
+
+		// The corner furthest along the plane normal decides if the box is outside, the nearest
+		// corner if it is inside
+		vec3 furthest, nearest;
+		furthest.x = plane.x >= 0.0f ? box.max.x : box.min.x;
+		furthest.y = plane.y >= 0.0f ? box.max.y : box.min.y;
+		furthest.z = plane.z >= 0.0f ? box.max.z : box.min.z;
+		nearest.x = plane.x >= 0.0f ? box.min.x : box.max.x;
+		nearest.y = plane.y >= 0.0f ? box.min.y : box.max.y;
+		nearest.z = plane.z >= 0.0f ? box.min.z : box.max.z;
+		if ((dot(plane.xyz, furthest) + plane.w) < 0.0f) return Containment::OUTSIDE;
+		if ((dot(plane.xyz, nearest) + plane.w) < 0.0f) result = Containment::PARTIAL;
+	}
+	return result;
+}
+
+// Sphere and ray tests
+// ------------------------------------------------------------------------------------------------
+
+bool intersectsSphere(const BoundingBox& box, vec3 center, float radius) noexcept
+{
+	const vec3 closest = sfz::max(box.min, sfz::min(center, box.max));
+	const vec3 diff = center - closest;
+	return dot(diff, diff) <= radius * radius;
+}
+
+bool intersectsRay(
+	const BoundingBox& box,
+	vec3 origin,
+	vec3 invDir,
+	float maxDist,
+	float& distOut) noexcept
+{
+	// Slab test
+	float tMin = 0.0f;
+	float tMax = maxDist;
+	for (uint32_t i = 0; i < 3; i++) {
+		float t0 = (box.min[i] - origin[i]) * invDir[i];
+		float t1 = (box.max[i] - origin[i]) * invDir[i];
+		if (t0 > t1) std::swap(t0, t1);
+		tMin = sfz::max(tMin, t0);
+		tMax = sfz::min(tMax, t1);
+		if (tMin > tMax) return false;
+	}
+	distOut = tMin;
+	return true;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cfloat>
+
+#include <skipifzero.hpp>
+#include <skipifzero_math.hpp>
+
+// BoundingBox
+// ------------------------------------------------------------------------------------------------
+
+// Axis-aligned bounding box, default constructed as an empty (inverted) box.
+struct BoundingBox final {
+	sfz::vec3 min = sfz::vec3(FLT_MAX);
+	sfz::vec3 max = sfz::vec3(-FLT_MAX);
+
+	bool isEmpty() const { return min.x > max.x || min.y > max.y || min.z > max.z; }
+	sfz::vec3 center() const { return (min + max) * 0.5f; }
+	sfz::vec3 halfExtents() const { return (max - min) * 0.5f; }
+
+	void add(sfz::vec3 point)
+	{
+		min = sfz::min(min, point);
+		max = sfz::max(max, point);
+	}
+
+	void add(const BoundingBox& other)
+	{
+		min = sfz::min(min, other.min);
+		max = sfz::max(max, other.max);
+	}
+};
+
+// Returns the bounding box (in the transform's destination space) of the transformed box.
+BoundingBox transformBoundingBox(const sfz::mat34& transform, const BoundingBox& box) noexcept;
+
+// FrustumPlanes
+// ------------------------------------------------------------------------------------------------
+
+// The 6 planes of a view frustum, stored as (normal, d). A point p is on the inside of a plane if
+// dot(normal, p) + d >= 0. The planes are not necessarily normalized.
+struct FrustumPlanes final {
+	sfz::vec4 planes[6];
+};
+
+// Extracts the frustum planes (in world space) from a projection * view matrix. Assumes the
+// ZeroG/D3D clip space convention (0 <= z <= w), which holds for both regular and reverse-z
+// projections. The far plane of an infinite projection degenerates into a plane that never
+// culls anything.
+FrustumPlanes frustumFromMatrix(const sfz::mat4& projViewMatrix) noexcept;
+
+// Returns whether the box is (potentially) inside the frustum. Conservative, might return true
+// for boxes close to the corners of the frustum.
+bool intersects(const FrustumPlanes& frustum, const BoundingBox& box) noexcept;
+
+// Result of testing a box against a frustum
+enum class Containment : uint32_t {
+	OUTSIDE = 0,
+	PARTIAL,
+	INSIDE
+};
+
+// Like intersects(), but also tells whether the box is completely inside the frustum.
+Containment testContainment(const FrustumPlanes& frustum, const BoundingBox& box) noexcept;
+
+// Sphere and ray tests
+// ------------------------------------------------------------------------------------------------
+
+// Returns whether the box intersects the sphere.
+bool intersectsSphere(const BoundingBox& box, sfz::vec3 center, float radius) noexcept;
+
+// Returns whether the ray (origin + t * dir, 0 <= t <= maxDist) hits the box. invDir is 1 / dir
+// (per component), distOut gets the distance to the entry point (0 if the origin is inside).
+bool intersectsRay(
+	const BoundingBox& box,
+	sfz::vec3 origin,
+	sfz::vec3 invDir,
+	float maxDist,
+	float& distOut) noexcept;
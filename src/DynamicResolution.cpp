@@ -0,0 +1,76 @@
+#include "DynamicResolution.hpp"
+
+#include <cmath>
+
+#include <skipifzero_math.hpp>
+
+// Statics
+// ------------------------------------------------------------------------------------------------
+
+// Weight of the latest frame in the average frame time
+constexpr float FRAME_TIME_SMOOTHING = 0.1f;
+
+// Frames slower than this multiple of the average are hitches (e.g. a shader compile or a file
+// load), which are ignored unless more than MAX_NUM_IGNORED_HITCHES of them come in a row
+constexpr float HITCH_FACTOR = 2.0f;
+constexpr uint32_t MAX_NUM_IGNORED_HITCHES = 3;
+
+// Scales are rounded to multiples of this, to avoid resizing over tiny differences
+constexpr float SCALE_STEP = 0.05f;
+
+// Max increase of the scale per resize, going up is done carefully to avoid oscillating
+constexpr float MAX_SCALE_INCREASE = 0.1f;
+
+// DynamicResolution: Methods
+// ------------------------------------------------------------------------------------------------
+
+void DynamicResolution::reset(float scale) noexcept
+{
+	mScale = scale;
+	mAverageFrameMs = 0.0f;
+	mFramesSinceResize = 0;
+	mNumHitches = 0;
+}
+
+bool DynamicResolution::update(float frameMs, const DynamicResolutionParams& params) noexcept
+{
+	const float minScale = sfz::min(params.minScale, params.maxScale);
+	const float maxScale = params.maxScale;
+	const float targetMs = params.targetFrameMs;
+
+	const bool hitch = mFramesSinceResize != 0 && frameMs > mAverageFrameMs * HITCH_FACTOR;
+	if (hitch && mNumHitches < MAX_NUM_IGNORED_HITCHES) {
+		mNumHitches += 1;
+		return false;
+	}
+	mNumHitches = 0;
+	mAverageFrameMs = mFramesSinceResize == 0 ?
+		frameMs : mAverageFrameMs + FRAME_TIME_SMOOTHING * (frameMs - mAverageFrameMs);
+	mFramesSinceResize += 1;
+
+	// Bounds might have changed since the last resize, which takes effect immediately
+	float newScale = sfz::clamp(mScale, minScale, maxScale);
+	if (newScale == mScale) {
+		if (mFramesSinceResize < params.minFramesBetweenResizes) return false;
+		if (mAverageFrameMs <= 0.0f) return false;
+
+		// Aim for the middle of the hysteresis band, assuming cost is proportional to pixel count
+		const float goalMs = targetMs * 0.5f * (params.lowerThreshold + params.upperThreshold);
+		const float idealScale = mScale * std::sqrt(goalMs / mAverageFrameMs);
+		if (mAverageFrameMs > targetMs * params.upperThreshold) {
+			newScale = std::floor(idealScale / SCALE_STEP) * SCALE_STEP;
+			if (newScale >= mScale) newScale = mScale - SCALE_STEP;
+		}
+		else if (mAverageFrameMs < targetMs * params.lowerThreshold) {
+			newScale = std::floor(idealScale / SCALE_STEP) * SCALE_STEP;
+			newScale = sfz::min(newScale, mScale + MAX_SCALE_INCREASE);
+			if (newScale <= mScale) return false;
+		}
+		newScale = sfz::clamp(newScale, minScale, maxScale);
+		if (std::abs(newScale - mScale) < 0.001f) return false;
+	}
+
+	this->reset(newScale);
+	mNumResizes += 1;
+	return true;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <skipifzero.hpp>
+
+// DynamicResolutionParams
+// ------------------------------------------------------------------------------------------------
+
+struct DynamicResolutionParams final {
+	float targetFrameMs = 16.667f;
+	float minScale = 0.5f;
+	float maxScale = 1.0f;
+
+	// Hysteresis, the scale is lowered when the average frame time is above the target times
+	// upperThreshold and raised when it is below the target times lowerThreshold
+	float upperThreshold = 1.05f;
+	float lowerThreshold = 0.85f;
+
+	// Each resize reallocates the screen relative render targets, so they are rate limited
+	uint32_t minFramesBetweenResizes = 30;
+};
+
+// DynamicResolution
+// ------------------------------------------------------------------------------------------------
+
+// Controller for the internal resolution scale, adjusts it to keep the frame time within the
+// target frame budget. The cost of a frame is assumed to be proportional to the number of pixels
+// rendered (i.e. the scale squared), which is only true for the resolution dependent parts of
+// it. Several resizes might therefore be needed before the target is reached, which is why the
+// average frame time is measured anew after each resize.
+class DynamicResolution final {
+public:
+	// Restarts the controller from the given scale
+	void reset(float scale) noexcept;
+
+	// Feeds the time of the last frame to the controller. Returns whether the scale changed.
+	bool update(float frameMs, const DynamicResolutionParams& params) noexcept;
+
+	float scale() const { return mScale; }
+	float averageFrameMs() const { return mAverageFrameMs; }
+	uint32_t framesSinceResize() const { return mFramesSinceResize; }
+	uint32_t numResizes() const { return mNumResizes; }
+
+private:
+	float mScale = 1.0f;
+	float mAverageFrameMs = 0.0f; // Exponential moving average since the last resize
+	uint32_t mFramesSinceResize = 0;
+	uint32_t mNumHitches = 0; // Consecutive frames ignored as hitches
+	uint32_t mNumResizes = 0;
+};
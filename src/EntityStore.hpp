@@ -0,0 +1,174 @@
+#pragma once
+
+#include <skipifzero.hpp>
+#include <skipifzero_arrays.hpp>
+
+// EntityHandle
+// ------------------------------------------------------------------------------------------------
+
+// Handle to an entity. The generation is bumped every time an entity index is reused, so stale
+// handles to deleted entities can be detected.
+struct EntityHandle final {
+	uint32_t idx = ~0u;
+	uint32_t generation = 0;
+
+	bool operator== (EntityHandle o) const { return idx == o.idx && generation == o.generation; }
+	bool operator!= (EntityHandle o) const { return !(*this == o); }
+};
+
+constexpr EntityHandle NULL_ENTITY = {};
+
+// EntityStore
+// ------------------------------------------------------------------------------------------------
+
+// Keeps track of which entities are alive. Grows as needed, there is no upper limit on the
+// number of entities. Component data is stored separately in ComponentArrays.
+class EntityStore final {
+public:
+	void init(uint32_t capacity, sfz::Allocator* allocator) noexcept
+	{
+		mGenerations.init(capacity, allocator, sfz_dbg("EntityStore::mGenerations"));
+		mFreeIndices.init(capacity, allocator, sfz_dbg("EntityStore::mFreeIndices"));
+		mNumAlive = 0;
+	}
+
+	uint32_t numAlive() const { return mNumAlive; }
+
+	// The number of entity indices in use (alive or on the free list). All entity indices are
+	// guaranteed to be smaller than this.
+	uint32_t numIndices() const { return mGenerations.size(); }
+
+	EntityHandle createEntity() noexcept
+	{
+		EntityHandle handle;
+		if (!mFreeIndices.isEmpty()) {
+			handle.idx = mFreeIndices.pop();
+		}
+		else {
+			handle.idx = mGenerations.size();
+			mGenerations.add(0);
+		}
+
+		// Odd generations are alive, even ones dead
+		mGenerations[handle.idx] += 1;
+		handle.generation = mGenerations[handle.idx];
+		mNumAlive += 1;
+		return handle;
+	}
+
+	// Note: Does not remove the entity's components, that is the caller's responsibility.
+	bool deleteEntity(EntityHandle handle) noexcept
+	{
+		if (!isAlive(handle)) return false;
+		mGenerations[handle.idx] += 1;
+		mFreeIndices.add(handle.idx);
+		mNumAlive -= 1;
+		return true;
+	}
+
+	bool isAlive(EntityHandle handle) const
+	{
+		if (handle.idx >= mGenerations.size()) return false;
+		return mGenerations[handle.idx] == handle.generation && (handle.generation & 1u) != 0;
+	}
+
+	// Returns the handle of an alive entity index, or NULL_ENTITY if no entity is alive there.
+	EntityHandle handleOf(uint32_t idx) const
+	{
+		if (idx >= mGenerations.size() || (mGenerations[idx] & 1u) == 0) return NULL_ENTITY;
+		EntityHandle handle;
+		handle.idx = idx;
+		handle.generation = mGenerations[idx];
+		return handle;
+	}
+
+private:
+	sfz::Array<uint32_t> mGenerations;
+	sfz::Array<uint32_t> mFreeIndices;
+	uint32_t mNumAlive = 0;
+};
+
+// ComponentArray
+// ------------------------------------------------------------------------------------------------
+
+// Dense storage of all components of a given type (a "sparse set"). Components are packed tightly
+// together with the index of the entity owning them, so systems can iterate over exactly the live
+// components of a type without scanning any masks. Removing a component moves the last component
+// into its place, so the order of components is not stable.
+template<typename T>
+class ComponentArray final {
+public:
+	void init(uint32_t capacity, sfz::Allocator* allocator) noexcept
+	{
+		mComponents.init(capacity, allocator, sfz_dbg("ComponentArray::mComponents"));
+		mEntities.init(capacity, allocator, sfz_dbg("ComponentArray::mEntities"));
+		mSparse.init(capacity, allocator, sfz_dbg("ComponentArray::mSparse"));
+	}
+
+	uint32_t size() const { return mComponents.size(); }
+	bool isEmpty() const { return mComponents.isEmpty(); }
+
+	// Dense arrays, entities()[i] is the index of the entity owning data()[i]
+	T* data() { return mComponents.data(); }
+	const T* data() const { return mComponents.data(); }
+	const uint32_t* entities() const { return mEntities.data(); }
+
+	T* begin() { return mComponents.begin(); }
+	T* end() { return mComponents.end(); }
+	const T* begin() const { return mComponents.begin(); }
+	const T* end() const { return mComponents.end(); }
+
+	bool has(uint32_t entityIdx) const
+	{
+		return entityIdx < mSparse.size() && mSparse[entityIdx] != ~0u;
+	}
+
+	T* get(uint32_t entityIdx)
+	{
+		if (!has(entityIdx)) return nullptr;
+		return &mComponents[mSparse[entityIdx]];
+	}
+
+	const T* get(uint32_t entityIdx) const
+	{
+		if (!has(entityIdx)) return nullptr;
+		return &mComponents[mSparse[entityIdx]];
+	}
+
+	// Adds (or overwrites) the component of the specified entity.
+	T& add(uint32_t entityIdx, const T& component) noexcept
+	{
+		if (entityIdx >= mSparse.size()) {
+			mSparse.add(~0u, entityIdx + 1 - mSparse.size());
+		}
+		if (mSparse[entityIdx] != ~0u) {
+			T& existing = mComponents[mSparse[entityIdx]];
+			existing = component;
+			return existing;
+		}
+		mSparse[entityIdx] = mComponents.size();
+		mEntities.add(entityIdx);
+		return mComponents.add(component);
+	}
+
+	bool remove(uint32_t entityIdx) noexcept
+	{
+		if (!has(entityIdx)) return false;
+		const uint32_t denseIdx = mSparse[entityIdx];
+		const uint32_t lastIdx = mComponents.size() - 1;
+		if (denseIdx != lastIdx) {
+			mComponents[denseIdx] = mComponents[lastIdx];
+			mEntities[denseIdx] = mEntities[lastIdx];
+			mSparse[mEntities[denseIdx]] = denseIdx;
+		}
+		mComponents.pop();
+		mEntities.pop();
+		mSparse[entityIdx] = ~0u;
+		return true;
+	}
+
+private:
+	sfz::Array<T> mComponents;
+	sfz::Array<uint32_t> mEntities;
+	sfz::Array<uint32_t> mSparse; // Entity index -> index into dense arrays, ~0u if none
+};
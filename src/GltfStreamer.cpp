@@ -0,0 +1,327 @@
+#include "GltfStreamer.hpp"
+
+#include <sfz/Context.hpp>
+#include <sfz/Logging.hpp>
+#include <sfz/renderer/Renderer.hpp>
+#include <sfz/rendering/Image.hpp>
+
+#include "MeshOptimization.hpp"
+
+// Placeholder textures
+// ------------------------------------------------------------------------------------------------
+
+static sfz::strID uploadPlaceholderTexture(
+	const char* name, sfz::vec4_u8 color, sfz::Allocator* allocator) noexcept
+{
+	sfz::Image image;
+	image.type = sfz::ImageType::RGBA_U8;
+	image.width = 1;
+	image.height = 1;
+	image.bytesPerPixel = 4;
+	image.rawData.init(4, allocator, sfz_dbg(""));
+	for (uint32_t i = 0; i < 4; i++) image.rawData.add(color[i]);
+
+	sfz::strID id = sfz::strID(name);
+	bool success = sfz::getRenderer().uploadTextureBlocking(id, image, false);
+	sfz_assert(success);
+	return id;
+}
+
+PlaceholderTextures uploadPlaceholderTextures(sfz::Allocator* allocator) noexcept
+{
+	PlaceholderTextures placeholders;
+	placeholders.albedo = uploadPlaceholderTexture(
+		"virtual/placeholder_albedo", sfz::vec4_u8(128, 128, 128, 255), allocator);
+
+	// Metallic in blue channel and roughness in green channel, as in gltf
+	placeholders.metallicRoughness = uploadPlaceholderTexture(
+		"virtual/placeholder_metallic_roughness", sfz::vec4_u8(0, 255, 0, 255), allocator);
+	placeholders.emissive = uploadPlaceholderTexture(
+		"virtual/placeholder_emissive", sfz::vec4_u8(0, 0, 0, 255), allocator);
+	return placeholders;
+}
+
+// Parallel gltf loading
+// ------------------------------------------------------------------------------------------------
+
+static float secondsSince(std::chrono::high_resolution_clock::time_point start) noexcept
+{
+	return std::chrono::duration_cast<std::chrono::duration<float>>(
+		std::chrono::high_resolution_clock::now() - start).count();
+}
+
+static sfz::Image decodeImage(sfz::strID globalPathId) noexcept
+{
+	sfz::Image image = sfz::loadImage("", globalPathId.str());
+	if (image.rawData.size() == 0) {
+		SFZ_ERROR("PhantasyTestbed", "Failed to decode image: %s", globalPathId.str());
+	}
+	return image;
+}
+
+bool parseGltfDeferTextures(
+	const char* gltfPath,
+	sfz::Mesh& meshOut,
+	sfz::Array<ComponentLods>& lodsOut,
+	sfz::Array<sfz::strID>& textureIdsOut,
+	const GltfLoadOptions& options,
+	sfz::Allocator* allocator) noexcept
+{
+	// Texture loading is deferred by claiming that every texture is already loaded, the ids of the
+	// skipped textures are recorded instead.
+	textureIdsOut.clear();
+	auto deferTexture = [](sfz::strID id, void* userPtr) -> bool {
+		sfz::Array<sfz::strID>& ids = *static_cast<sfz::Array<sfz::strID>*>(userPtr);
+		for (sfz::strID existing : ids) {
+			if (existing == id) return true;
+		}
+		ids.add(id);
+		return true;
+	};
+	sfz::Array<sfz::ImageAndPath> noTextures;
+	bool success = sfz::loadAssetsFromGltf(
+		gltfPath, meshOut, noTextures, allocator, deferTexture, &textureIdsOut);
+	if (!success) return false;
+
+	if (options.optimizeMesh) {
+		auto optimizeStart = std::chrono::high_resolution_clock::now();
+		MeshOptimizationStats stats = optimizeMesh(meshOut, allocator);
+		SFZ_INFO("PhantasyTestbed", "Optimized mesh \"%s\" (%u triangles) in %.1f ms: "
+			"ACMR %.3f -> %.3f, ATVR %.3f -> %.3f",
+			gltfPath, stats.after.numTriangles, secondsSince(optimizeStart) * 1000.0f,
+			stats.before.acmr(), stats.after.acmr(), stats.before.atvr(), stats.after.atvr());
+	}
+
+	// LODs are generated last, so they use the final vertex order
+	lodsOut.init(meshOut.components.size(), allocator, sfz_dbg(""));
+	if (options.generateLods) {
+		auto lodStart = std::chrono::high_resolution_clock::now();
+		const uint32_t numIndicesBefore = meshOut.indices.size();
+		generateMeshLods(meshOut, lodsOut, allocator);
+		SFZ_INFO("PhantasyTestbed", "Generated LODs for \"%s\" in %.1f ms, %u extra indices",
+			gltfPath, secondsSince(lodStart) * 1000.0f,
+			meshOut.indices.size() - numIndicesBefore);
+	}
+	else {
+		fullDetailLodsOnly(meshOut, lodsOut);
+	}
+	return true;
+}
+
+bool loadGltfParallel(
+	const char* gltfPath,
+	sfz::Mesh& meshOut,
+	sfz::Array<ComponentLods>& lodsOut,
+	sfz::Array<sfz::ImageAndPath>& texturesOut,
+	sfz::Allocator* allocator,
+	WorkerPool& decodePool,
+	const GltfLoadOptions& options,
+	GltfLoadTimings* timingsOut) noexcept
+{
+	GltfLoadTimings timings;
+
+	auto parseStart = std::chrono::high_resolution_clock::now();
+	sfz::Array<sfz::strID> textureIds;
+	textureIds.init(128, allocator, sfz_dbg(""));
+	bool success =
+		parseGltfDeferTextures(gltfPath, meshOut, lodsOut, textureIds, options, allocator);
+	timings.parseSecs = secondsSince(parseStart);
+	if (!success) return false;
+
+	// Each task writes to its own pre-allocated slot, so the order is deterministic
+	auto decodeStart = std::chrono::high_resolution_clock::now();
+	texturesOut.clear();
+	for (sfz::strID id : textureIds) {
+		sfz::ImageAndPath& item = texturesOut.add(sfz::ImageAndPath());
+		item.globalPathId = id;
+	}
+	auto decodeTask = [&](uint32_t idx) {
+		texturesOut[idx].image = decodeImage(texturesOut[idx].globalPathId);
+	};
+	decodePool.parallelFor(texturesOut.size(), decodeTask);
+	timings.decodeSecs = secondsSince(decodeStart);
+
+	if (timingsOut != nullptr) *timingsOut = timings;
+	return true;
+}
+
+// GltfStreamer: Constructors & destructors
+// ------------------------------------------------------------------------------------------------
+
+void GltfStreamer::start(
+	const char* gltfPath,
+	uint32_t numDecodeThreads,
+	const GltfLoadOptions& options,
+	sfz::Allocator* allocator) noexcept
+{
+	this->destroy();
+	mAllocator = allocator;
+	mGltfPath.printf("%s", gltfPath);
+	mMeshId = sfz::strID(gltfPath);
+	mNumDecodeThreads = numDecodeThreads;
+	mOptions = options;
+	mCancel = false;
+	mStartTime = std::chrono::high_resolution_clock::now();
+
+	mUploadSecs = 0.0f;
+	mParsed = false;
+	mTimings = {};
+	mParseFailed = false;
+	mNumTextures = 0;
+	mNumDecoded = 0;
+	mDecodedTextures.init(64, allocator, sfz_dbg("GltfStreamer::mDecodedTextures"));
+	mNextDecodedTexture = 0;
+	mOpaqueTextures.init(64, allocator, sfz_dbg("GltfStreamer::mOpaqueTextures"));
+
+	mProgress = {};
+	mProgress.started = true;
+	mLoaderThread = std::thread(loaderMain, this);
+}
+
+void GltfStreamer::destroy() noexcept
+{
+	mCancel = true;
+	if (mLoaderThread.joinable()) mLoaderThread.join();
+	mMesh = {};
+	mLods.destroy();
+	mDecodedTextures.destroy();
+	mNextDecodedTexture = 0;
+	mOpaqueTextures.destroy();
+	mProgress = {};
+}
+
+// GltfStreamer: Methods
+// ------------------------------------------------------------------------------------------------
+
+bool GltfStreamer::update(MeshRegistry& meshes, uint64_t uploadBudgetBytes) noexcept
+{
+	if (!mProgress.started || mProgress.done()) return false;
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (!mParsed) return false;
+		if (mParseFailed) {
+			SFZ_ERROR("PhantasyTestbed", "Failed to load assets from gltf: %s", mGltfPath.str);
+			mProgress.failed = true;
+			return false;
+		}
+		mProgress.texturesKnown = true;
+		mProgress.numTextures = mNumTextures;
+		mProgress.numTexturesDecoded = mNumDecoded;
+	}
+
+	// The loader thread never touches the mesh again after it has been parsed. The mesh upload
+	// uses up the budget for this frame. No textures are known to be opaque yet, so only the
+	// untextured components can be occluders until the occluders are updated below.
+	if (!mProgress.meshResident) {
+		auto uploadStart = std::chrono::high_resolution_clock::now();
+		bool success = meshes.uploadMeshBlocking(mMeshId, mMesh, mLods.data());
+		sfz_assert(success);
+		mLods.destroy();
+		mUploadSecs += secondsSince(uploadStart);
+		mProgress.meshResident = true;
+		return true;
+	}
+
+	// Upload decoded textures until budget is exhausted, always at least one so that textures
+	// larger than the budget still make progress.
+	sfz::Renderer& renderer = sfz::getRenderer();
+	auto uploadStart = std::chrono::high_resolution_clock::now();
+	uint64_t numBytesUploaded = 0;
+	while (true) {
+		sfz::ImageAndPath item;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			if (mNextDecodedTexture == mDecodedTextures.size()) break;
+			sfz::ImageAndPath& next = mDecodedTextures[mNextDecodedTexture];
+			const uint64_t numBytes = next.image.rawData.size();
+			if (numBytesUploaded != 0 && numBytesUploaded + numBytes > uploadBudgetBytes) break;
+			item = std::move(next);
+			mNextDecodedTexture += 1;
+
+			// Reuse the queue's memory once it has been drained
+			if (mNextDecodedTexture == mDecodedTextures.size()) {
+				mDecodedTextures.clear();
+				mNextDecodedTexture = 0;
+			}
+		}
+
+		// Images that failed to decode are skipped, but still count towards the progress
+		if (item.image.rawData.size() != 0 && !renderer.textureLoaded(item.globalPathId)) {
+			bool success = renderer.uploadTextureBlocking(item.globalPathId, item.image, true);
+			sfz_assert(success);
+		}
+		addIfOpaqueAlbedo(mMesh, item.globalPathId, item.image, mOpaqueTextures);
+		numBytesUploaded += item.image.rawData.size();
+		mProgress.numTexturesResident += 1;
+	}
+	mProgress.numBytesUploaded += numBytesUploaded;
+
+	mUploadSecs += secondsSince(uploadStart);
+
+	if (mProgress.done()) {
+		meshes.updateOccluders(
+			mMeshId, mMesh, mOpaqueTextures.data(), mOpaqueTextures.size());
+		mMesh = {};
+		mOpaqueTextures.destroy();
+
+		GltfLoadTimings timings;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			timings = mTimings;
+		}
+		SFZ_INFO("PhantasyTestbed",
+			"Streamed \"%s\" (%u textures, %.1f MiB) in %.2f s: "
+			"parse %.2f s, decode %.2f s (%u threads), upload %.2f s (main thread)",
+			mGltfPath.str, mProgress.numTextures,
+			float(mProgress.numBytesUploaded) / (1024.0f * 1024.0f), secondsSince(mStartTime),
+			timings.parseSecs, timings.decodeSecs, mNumDecodeThreads, mUploadSecs);
+	}
+	return false;
+}
+
+// GltfStreamer: Private methods
+// ------------------------------------------------------------------------------------------------
+
+void GltfStreamer::loaderMain(GltfStreamer* streamer) noexcept
+{
+	sfz::Allocator* allocator = streamer->mAllocator;
+
+	// Parse gltf file, the textures are decoded separately below
+	auto parseStart = std::chrono::high_resolution_clock::now();
+	sfz::Array<sfz::strID> textureIds;
+	textureIds.init(128, allocator, sfz_dbg(""));
+	sfz::Mesh mesh;
+	sfz::Array<ComponentLods> lods;
+	bool success = parseGltfDeferTextures(streamer->mGltfPath.str,
+		mesh, lods, textureIds, streamer->mOptions, allocator);
+	{
+		std::lock_guard<std::mutex> lock(streamer->mMutex);
+		streamer->mParsed = true;
+		streamer->mParseFailed = !success;
+		streamer->mMesh = std::move(mesh);
+		streamer->mLods = std::move(lods);
+		streamer->mNumTextures = success ? textureIds.size() : 0;
+		streamer->mTimings.parseSecs = secondsSince(parseStart);
+	}
+	if (!success) return;
+
+	// Decode images in parallel, each image is handed over to the main thread as soon as it is
+	// decoded.
+	auto decodeStart = std::chrono::high_resolution_clock::now();
+	WorkerPool decodePool;
+	decodePool.init(streamer->mNumDecodeThreads, allocator);
+	auto decodeTask = [&](uint32_t idx) {
+		if (streamer->mCancel) return;
+		sfz::ImageAndPath item;
+		item.globalPathId = textureIds[idx];
+		item.image = decodeImage(item.globalPathId);
+		std::lock_guard<std::mutex> lock(streamer->mMutex);
+		streamer->mNumDecoded += 1;
+		streamer->mDecodedTextures.add(std::move(item));
+	};
+	decodePool.parallelFor(textureIds.size(), decodeTask);
+
+	std::lock_guard<std::mutex> lock(streamer->mMutex);
+	streamer->mTimings.decodeSecs = secondsSince(decodeStart);
+}
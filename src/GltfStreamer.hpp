@@ -0,0 +1,187 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#include <skipifzero.hpp>
+#include <skipifzero_arrays.hpp>
+#include <skipifzero_math.hpp>
+#include <skipifzero_strings.hpp>
+
+#include <sfz/rendering/Mesh.hpp>
+#include <sfz/util/GltfLoader.hpp>
+
+#include "MeshLods.hpp"
+#include "MeshRegistry.hpp"
+#include "WorkerPool.hpp"
+
+// Placeholder textures
+// ------------------------------------------------------------------------------------------------
+
+// Textures bound instead of a material's textures while they are still being streamed in.
+struct PlaceholderTextures final {
+	sfz::strID albedo;
+	sfz::strID metallicRoughness;
+	sfz::strID emissive;
+};
+
+// Creates and uploads a 1x1 texture for each of the placeholder slots.
+PlaceholderTextures uploadPlaceholderTextures(sfz::Allocator* allocator) noexcept;
+
+// Parallel gltf loading
+// ------------------------------------------------------------------------------------------------
+
+// Options for how a gltf file is processed when it is loaded (or cooked).
+struct GltfLoadOptions final {
+	// Block compress RGBA8 textures when cooking scene packages (see CompressedTexture). Lossy
+	// and only makes the package smaller on disk, the textures are decompressed to RGBA8 when the
+	// package is loaded. Textures loaded straight from gltf are never compressed.
+	bool blockCompressTextures = false;
+
+	// Reorder the mesh's indices and vertices for the GPU (see optimizeMesh())
+	bool optimizeMesh = true;
+
+	// Generate simplified LODs of each mesh component (see generateMeshLods())
+	bool generateLods = true;
+
+	// Store the vertices in the packed layout (see PackedVertex) when cooking scene packages. Only
+	// makes the package smaller on disk, the vertices are unpacked when the package is loaded.
+	bool packVertices = false;
+};
+
+struct GltfLoadTimings final {
+	float parseSecs = 0.0f;
+	float decodeSecs = 0.0f;
+};
+
+// Parses a gltf file without decoding any of its images. Instead the ids (global paths) of the
+// referenced textures are returned, in the order they are first referenced by the file. The mesh
+// is optimized and its LODs generated according to the options, lodsOut always gets one entry
+// per component.
+bool parseGltfDeferTextures(
+	const char* gltfPath,
+	sfz::Mesh& meshOut,
+	sfz::Array<ComponentLods>& lodsOut,
+	sfz::Array<sfz::strID>& textureIdsOut,
+	const GltfLoadOptions& options,
+	sfz::Allocator* allocator) noexcept;
+
+// Same as sfz::loadAssetsFromGltf(), but the images are decoded in parallel on the given worker
+// pool. The textures are returned in the same order regardless of the number of threads.
+bool loadGltfParallel(
+	const char* gltfPath,
+	sfz::Mesh& meshOut,
+	sfz::Array<ComponentLods>& lodsOut,
+	sfz::Array<sfz::ImageAndPath>& texturesOut,
+	sfz::Allocator* allocator,
+	WorkerPool& decodePool,
+	const GltfLoadOptions& options,
+	GltfLoadTimings* timingsOut = nullptr) noexcept;
+
+// StreamingProgress
+// ------------------------------------------------------------------------------------------------
+
+struct StreamingProgress final {
+	bool started = false;
+	bool failed = false;
+	bool meshResident = false;
+	bool texturesKnown = false; // numTextures is not known until the gltf file is parsed
+	uint32_t numTextures = 0;
+	uint32_t numTexturesDecoded = 0;
+	uint32_t numTexturesResident = 0;
+	uint64_t numBytesUploaded = 0;
+
+	bool done() const
+	{
+		return failed || (meshResident && texturesKnown && numTexturesResident == numTextures);
+	}
+
+	// Rough fraction of the work done in [0, 1], the mesh counts as one texture.
+	float fraction() const
+	{
+		if (done()) return 1.0f;
+		if (!texturesKnown) return 0.0f;
+		const float numResident = float(numTexturesResident) + (meshResident ? 1.0f : 0.0f);
+		return numResident / float(numTextures + 1);
+	}
+};
+
+// GltfStreamer
+// ------------------------------------------------------------------------------------------------
+
+// Loads a gltf file (mesh + textures) without blocking the main thread.
+//
+// Parsing happens on a background thread and the images are decoded on a small worker pool owned
+// by the streamer (so decoding never competes with the per-frame jobs on the main worker pool).
+// The main thread calls update() once per frame, which uploads the mesh as soon as it is parsed
+// and then the decoded textures in the order they were decoded, as many as fit in the given byte
+// budget (but at least one). Until a texture is resident the placeholder textures should be bound
+// in its place. The mesh's occluders are gathered again once all textures are resident, until
+// then the components with albedo textures are not used as occluders.
+class GltfStreamer final {
+public:
+	// Constructors & destructors
+	// --------------------------------------------------------------------------------------------
+
+	GltfStreamer() noexcept = default;
+	GltfStreamer(const GltfStreamer&) = delete;
+	GltfStreamer& operator= (const GltfStreamer&) = delete;
+	GltfStreamer(GltfStreamer&&) = delete;
+	GltfStreamer& operator= (GltfStreamer&&) = delete;
+	~GltfStreamer() noexcept { this->destroy(); }
+
+	// Starts loading the gltf file in the background, the mesh will be uploaded with the strID of
+	// its path.
+	void start(
+		const char* gltfPath,
+		uint32_t numDecodeThreads,
+		const GltfLoadOptions& options,
+		sfz::Allocator* allocator) noexcept;
+
+	// Cancels any in-flight loading and waits for the background thread to finish.
+	void destroy() noexcept;
+
+	// Methods
+	// --------------------------------------------------------------------------------------------
+
+	// Uploads whatever has finished loading since last call, must be called from the main thread.
+	// Returns true the call in which the mesh became resident.
+	bool update(MeshRegistry& meshes, uint64_t uploadBudgetBytes) noexcept;
+
+	sfz::strID meshId() const { return mMeshId; }
+	const StreamingProgress& progress() const { return mProgress; }
+
+	// Whether textures might still be missing, i.e. whether placeholders might be needed
+	bool isStreaming() const { return mProgress.started && !mProgress.done(); }
+
+private:
+	static void loaderMain(GltfStreamer* streamer) noexcept;
+
+	sfz::Allocator* mAllocator = nullptr;
+	sfz::str320 mGltfPath;
+	sfz::strID mMeshId;
+	uint32_t mNumDecodeThreads = 0;
+	GltfLoadOptions mOptions;
+	std::thread mLoaderThread;
+	std::atomic_bool mCancel = false;
+	std::chrono::high_resolution_clock::time_point mStartTime;
+	float mUploadSecs = 0.0f;
+
+	// Shared with loader thread, protected by mMutex
+	std::mutex mMutex;
+	bool mParsed = false;
+	GltfLoadTimings mTimings;
+	bool mParseFailed = false;
+	sfz::Mesh mMesh;
+	sfz::Array<ComponentLods> mLods;
+	uint32_t mNumTextures = 0;
+	uint32_t mNumDecoded = 0;
+	sfz::Array<sfz::ImageAndPath> mDecodedTextures; // Decoded, in the order they finished
+	uint32_t mNextDecodedTexture = 0; // Textures before this one have been uploaded
+
+	// Main thread only
+	StreamingProgress mProgress;
+	sfz::Array<sfz::strID> mOpaqueTextures; // Opaque albedo textures, see addIfOpaqueAlbedo()
+};
@@ -0,0 +1,191 @@
+#include "LightList.hpp"
+
+#include <cstring>
+
+#include "Culling.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LIGHT_LIST_USE_SSE2 1
+#include <emmintrin.h>
+#else
+#define LIGHT_LIST_USE_SSE2 0
+#endif
+
+using sfz::mat4;
+using sfz::vec3;
+using sfz::vec4;
+
+// Statics
+// ------------------------------------------------------------------------------------------------
+
+static bool sameMatrix(const mat4& lhs, const mat4& rhs) noexcept
+{
+	return memcmp(lhs.data(), rhs.data(), sizeof(mat4)) == 0;
+}
+
+// LightList: Methods
+// ------------------------------------------------------------------------------------------------
+
+void LightList::init(uint32_t capacity, sfz::Allocator* allocator) noexcept
+{
+	for (sfz::Array<float>& array : mPos) array.init(capacity, allocator, sfz_dbg(""));
+	mRange.init(capacity, allocator, sfz_dbg("LightList::mRange"));
+	mStrength.init(capacity, allocator, sfz_dbg("LightList::mStrength"));
+	for (sfz::Array<float>& array : mPosVS) array.init(capacity, allocator, sfz_dbg(""));
+	mVisible.init(capacity, allocator, sfz_dbg("LightList::mVisible"));
+	mVisibleLights.init(capacity, allocator, sfz_dbg("LightList::mVisibleLights"));
+	mDirty.init(capacity, allocator, sfz_dbg("LightList::mDirty"));
+	mDirtyLights.init(capacity, allocator, sfz_dbg("LightList::mDirtyLights"));
+	mResized = false;
+	mUpdated = false;
+	mNumTransformed = 0;
+}
+
+void LightList::resize(uint32_t numLights) noexcept
+{
+	const uint32_t oldSize = this->size();
+	if (numLights == oldSize) return;
+	mResized = true;
+	while (this->size() > numLights) {
+		for (sfz::Array<float>& array : mPos) array.pop();
+		mRange.pop();
+		mStrength.pop();
+		for (sfz::Array<float>& array : mPosVS) array.pop();
+		mVisible.pop();
+		mDirty.pop();
+	}
+	for (uint32_t idx = oldSize; idx < numLights; idx++) {
+		for (sfz::Array<float>& array : mPos) array.add(0.0f);
+		mRange.add(0.0f);
+		mStrength.add(vec3(0.0f));
+		for (sfz::Array<float>& array : mPosVS) array.add(0.0f);
+		mVisible.add(0);
+		mDirty.add(1);
+		mDirtyLights.add(idx);
+	}
+}
+
+void LightList::set(uint32_t idx, vec3 pos, float range, vec3 strength) noexcept
+{
+	sfz_assert(idx < this->size());
+	const bool changed = mPos[0][idx] != pos.x || mPos[1][idx] != pos.y ||
+		mPos[2][idx] != pos.z || mRange[idx] != range || mStrength[idx] != strength;
+	if (!changed) return;
+	for (uint32_t i = 0; i < 3; i++) mPos[i][idx] = pos[i];
+	mRange[idx] = range;
+	mStrength[idx] = strength;
+	if (mDirty[idx] == 0) {
+		mDirty[idx] = 1;
+		mDirtyLights.add(idx);
+	}
+}
+
+bool LightList::update(const mat4& viewMatrix, const mat4& projMatrix) noexcept
+{
+	const bool cameraMoved = !mUpdated ||
+		!sameMatrix(viewMatrix, mViewMatrix) || !sameMatrix(projMatrix, mProjMatrix);
+	const bool changed = cameraMoved || mResized || !mDirtyLights.isEmpty();
+	mUpdated = true;
+	mViewMatrix = viewMatrix;
+	mProjMatrix = projMatrix;
+	mResized = false;
+	mNumTransformed = 0;
+	if (!changed) return false;
+
+	// View space frustum planes, normalized so that distances to them can be compared with ranges
+	vec4 planes[6];
+	const FrustumPlanes frustum = frustumFromMatrix(projMatrix);
+	for (uint32_t i = 0; i < 6; i++) {
+		const float length = sfz::length(frustum.planes[i].xyz);
+		planes[i] = length > 0.0f ? frustum.planes[i] / length : frustum.planes[i];
+	}
+
+	const uint32_t numLights = this->size();
+	if (cameraMoved) {
+		uint32_t i = 0;
+#if LIGHT_LIST_USE_SSE2
+		// 4 lights at a time, with one light per SIMD lane
+		__m128 view[3][4];
+		__m128 planesSimd[6][4];
+		for (uint32_t r = 0; r < 3; r++) {
+			for (uint32_t c = 0; c < 4; c++) view[r][c] = _mm_set1_ps(viewMatrix.row(r)[c]);
+		}
+		for (uint32_t p = 0; p < 6; p++) {
+			for (uint32_t c = 0; c < 4; c++) planesSimd[p][c] = _mm_set1_ps(planes[p][c]);
+		}
+		const __m128 zero = _mm_setzero_ps();
+		for (; (i + 4) <= numLights; i += 4) {
+			const __m128 x = _mm_loadu_ps(mPos[0].data() + i);
+			const __m128 y = _mm_loadu_ps(mPos[1].data() + i);
+			const __m128 z = _mm_loadu_ps(mPos[2].data() + i);
+			__m128 posVS[3];
+			for (uint32_t r = 0; r < 3; r++) {
+				__m128 sum = _mm_add_ps(_mm_mul_ps(view[r][0], x), _mm_mul_ps(view[r][1], y));
+				sum = _mm_add_ps(sum, _mm_mul_ps(view[r][2], z));
+				posVS[r] = _mm_add_ps(sum, view[r][3]);
+				_mm_storeu_ps(mPosVS[r].data() + i, posVS[r]);
+			}
+
+			// Inside unless the sphere is completely behind one of the planes
+			const __m128 negRange = _mm_sub_ps(zero, _mm_loadu_ps(mRange.data() + i));
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (uint32_t p = 0; p < 6; p++) {
+				__m128 dist = _mm_add_ps(
+					_mm_mul_ps(planesSimd[p][0], posVS[0]), _mm_mul_ps(planesSimd[p][1], posVS[1]));
+				dist = _mm_add_ps(dist, _mm_mul_ps(planesSimd[p][2], posVS[2]));
+				dist = _mm_add_ps(dist, planesSimd[p][3]);
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(dist, negRange));
+			}
+			const int insideMask = _mm_movemask_ps(inside);
+			for (uint32_t lane = 0; lane < 4; lane++) {
+				mVisible[i + lane] = uint8_t((insideMask >> lane) & 1);
+			}
+		}
+#endif
+		for (; i < numLights; i++) {
+			transformLight(i, planes);
+		}
+		mNumTransformed = numLights;
+	}
+	else {
+		for (uint32_t idx : mDirtyLights) {
+			if (idx >= numLights) continue; // Removed by resize()
+			transformLight(idx, planes);
+			mNumTransformed += 1;
+		}
+	}
+	for (uint32_t idx : mDirtyLights) {
+		if (idx < numLights) mDirty[idx] = 0;
+	}
+	mDirtyLights.clear();
+
+	mVisibleLights.clear();
+	for (uint32_t i = 0; i < numLights; i++) {
+		if (mVisible[i] != 0) mVisibleLights.add(i);
+	}
+	return true;
+}
+
+sfz::ShaderPointLight LightList::pointLight(uint32_t idx) const noexcept
+{
+	sfz::ShaderPointLight pointLight;
+	pointLight.posVS = vec3(mPosVS[0][idx], mPosVS[1][idx], mPosVS[2][idx]);
+	pointLight.range = mRange[idx];
+	pointLight.strength = mStrength[idx];
+	return pointLight;
+}
+
+// LightList: Private methods
+// ------------------------------------------------------------------------------------------------
+
+void LightList::transformLight(uint32_t idx, const vec4 planes[6]) noexcept
+{
+	const vec3 pos = vec3(mPos[0][idx], mPos[1][idx], mPos[2][idx]);
+	const vec3 posVS = sfz::transformPoint(mViewMatrix, pos);
+	for (uint32_t i = 0; i < 3; i++) mPosVS[i][idx] = posVS[i];
+	bool inside = true;
+	for (uint32_t i = 0; i < 6; i++) {
+		inside = inside && (dot(planes[i].xyz, posVS) + planes[i].w) >= -mRange[idx];
+	}
+	mVisible[idx] = inside ? 1 : 0;
+}
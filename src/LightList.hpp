@@ -0,0 +1,64 @@
+#pragma once
+
+#include <skipifzero.hpp>
+#include <skipifzero_arrays.hpp>
+#include <skipifzero_math.hpp>
+
+#include <sfz/renderer/BuiltinShaderTypes.hpp>
+
+// LightList
+// ------------------------------------------------------------------------------------------------
+
+// Persistent list of point lights, stored as a structure of arrays. Lights are kept in sync with
+// the scene through set(), which marks a light as dirty only if it actually changed.
+//
+// update() transforms the lights into view space and culls those whose sphere of influence is
+// outside the view frustum. If the camera did not move only the dirty lights are processed,
+// otherwise all of them are (4 at a time with SSE2 when available).
+class LightList final {
+public:
+	void init(uint32_t capacity, sfz::Allocator* allocator) noexcept;
+
+	uint32_t size() const { return mRange.size(); }
+
+	// Adds or removes lights at the end of the list, added lights are dirty until set.
+	void resize(uint32_t numLights) noexcept;
+
+	// Sets the world space position, range and strength (color) of a light.
+	void set(uint32_t idx, sfz::vec3 pos, float range, sfz::vec3 strength) noexcept;
+
+	// Updates the view space data and visibility of the lights. Returns whether anything changed
+	// since the last update, if not visibleLights() and all pointLight() are the same as before.
+	bool update(const sfz::mat4& viewMatrix, const sfz::mat4& projMatrix) noexcept;
+
+	// Indices of the lights (potentially) inside the view frustum, in increasing order
+	const sfz::Array<uint32_t>& visibleLights() const { return mVisibleLights; }
+
+	// The light in view space, as of the last update()
+	sfz::ShaderPointLight pointLight(uint32_t idx) const noexcept;
+
+	// Number of lights transformed into view space by the last update()
+	uint32_t numTransformed() const { return mNumTransformed; }
+
+private:
+	void transformLight(uint32_t idx, const sfz::vec4 planes[6]) noexcept;
+
+	// World space
+	sfz::Array<float> mPos[3];
+	sfz::Array<float> mRange;
+	sfz::Array<sfz::vec3> mStrength;
+
+	// View space, as of the last update()
+	sfz::Array<float> mPosVS[3];
+	sfz::Array<uint8_t> mVisible;
+	sfz::Array<uint32_t> mVisibleLights;
+
+	sfz::Array<uint8_t> mDirty;
+	sfz::Array<uint32_t> mDirtyLights;
+	bool mResized = false;
+
+	bool mUpdated = false; // If there has been an update() with the matrices below
+	sfz::mat4 mViewMatrix;
+	sfz::mat4 mProjMatrix;
+	uint32_t mNumTransformed = 0;
+};
@@ -0,0 +1,136 @@
+#include "MappedFile.hpp"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#if defined(__EMSCRIPTEN__)
+#include <sfz/util/IO.hpp>
+#elif defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// FileStamp
+// ------------------------------------------------------------------------------------------------
+
+bool fileStamp(const char* path, FileStamp& stampOut) noexcept
+{
+	struct stat fileStat = {};
+	if (stat(path, &fileStat) != 0) return false;
+	stampOut.size = uint64_t(fileStat.st_size);
+	stampOut.modifiedTime = int64_t(fileStat.st_mtime);
+	return true;
+}
+
+// MappedFile: Constructors & destructors
+// ------------------------------------------------------------------------------------------------
+
+#if defined(__EMSCRIPTEN__)
+
+bool MappedFile::init(const char* path, sfz::Allocator* allocator) noexcept
+{
+	this->destroy();
+	mFallbackData = sfz::readBinaryFile(path, allocator);
+	if (mFallbackData.size() == 0) return false;
+	mData = mFallbackData.data();
+	mSize = mFallbackData.size();
+	return true;
+}
+
+void MappedFile::destroy() noexcept
+{
+	mFallbackData.destroy();
+	mData = nullptr;
+	mSize = 0;
+}
+
+#elif defined(_WIN32)
+
+bool MappedFile::init(const char* path, sfz::Allocator* allocator) noexcept
+{
+	(void)allocator;
+	this->destroy();
+
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER fileSize = {};
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr) {
+		CloseHandle(file);
+		return false;
+	}
+
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (view == nullptr) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	mFileHandle = file;
+	mMappingHandle = mapping;
+	mData = static_cast<const uint8_t*>(view);
+	mSize = uint64_t(fileSize.QuadPart);
+	return true;
+}
+
+void MappedFile::destroy() noexcept
+{
+	if (mData != nullptr) UnmapViewOfFile(mData);
+	if (mMappingHandle != nullptr) CloseHandle(mMappingHandle);
+	if (mFileHandle != nullptr) CloseHandle(mFileHandle);
+	mData = nullptr;
+	mSize = 0;
+	mFileHandle = nullptr;
+	mMappingHandle = nullptr;
+}
+
+#else
+
+bool MappedFile::init(const char* path, sfz::Allocator* allocator) noexcept
+{
+	(void)allocator;
+	this->destroy();
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat fileStat = {};
+	if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+		close(fd);
+		return false;
+	}
+
+	// The mapping stays valid after the file descriptor is closed
+	void* view = mmap(nullptr, size_t(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (view == MAP_FAILED) return false;
+
+	// Everything is going to be read (and most of it uploaded to the GPU) right away
+	madvise(view, size_t(fileStat.st_size), MADV_WILLNEED);
+
+	mData = static_cast<const uint8_t*>(view);
+	mSize = uint64_t(fileStat.st_size);
+	return true;
+}
+
+void MappedFile::destroy() noexcept
+{
+	if (mData != nullptr) munmap(const_cast<uint8_t*>(mData), size_t(mSize));
+	mData = nullptr;
+	mSize = 0;
+}
+
+#endif
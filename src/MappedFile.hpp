@@ -0,0 +1,64 @@
+#pragma once
+
+#include <skipifzero.hpp>
+#include <skipifzero_arrays.hpp>
+
+// FileStamp
+// ------------------------------------------------------------------------------------------------
+
+// Size and last modification time of a file, used to cheaply detect if a file has changed
+// without reading it.
+struct FileStamp final {
+	uint64_t size = 0;
+	int64_t modifiedTime = 0; // Seconds since the Unix epoch
+
+	bool operator== (const FileStamp& o) const
+	{
+		return size == o.size && modifiedTime == o.modifiedTime;
+	}
+	bool operator!= (const FileStamp& o) const { return !(*this == o); }
+};
+
+// Returns false if the file does not exist (or can't be accessed).
+bool fileStamp(const char* path, FileStamp& stampOut) noexcept;
+
+// MappedFile
+// ------------------------------------------------------------------------------------------------
+
+// A read-only memory mapped file.
+//
+// Uses mmap() on POSIX platforms and file mappings on Windows. On platforms without memory mapping
+// (Emscripten) the whole file is read into memory instead, which is slower but behaves the same.
+class MappedFile final {
+public:
+	// Constructors & destructors
+	// --------------------------------------------------------------------------------------------
+
+	MappedFile() noexcept = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator= (const MappedFile&) = delete;
+	MappedFile(MappedFile&&) = delete;
+	MappedFile& operator= (MappedFile&&) = delete;
+	~MappedFile() noexcept { this->destroy(); }
+
+	// Maps the file at the given path, returns false on failure.
+	bool init(const char* path, sfz::Allocator* allocator) noexcept;
+	void destroy() noexcept;
+
+	// Methods
+	// --------------------------------------------------------------------------------------------
+
+	bool isValid() const { return mData != nullptr; }
+	const uint8_t* data() const { return mData; }
+	uint64_t size() const { return mSize; }
+
+private:
+	const uint8_t* mData = nullptr;
+	uint64_t mSize = 0;
+#if defined(__EMSCRIPTEN__)
+	sfz::Array<uint8_t> mFallbackData;
+#elif defined(_WIN32)
+	void* mFileHandle = nullptr;
+	void* mMappingHandle = nullptr;
+#endif
+};
@@ -0,0 +1,200 @@
+#include "MeshLods.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <skipifzero_math.hpp>
+
+#include "Culling.hpp"
+
+using sfz::vec3;
+
+// Statics
+// ------------------------------------------------------------------------------------------------
+
+// Components with fewer triangles are not worth simplifying
+constexpr uint32_t LOD_MIN_NUM_TRIANGLES = 64;
+
+// Grid resolution (along the largest axis of the component) of the first simplified LOD, halved
+// for each attempt after that
+constexpr uint32_t LOD_FIRST_GRID_RES = 256;
+
+// A LOD is only kept if it has at most this fraction of the triangles of the previous LOD
+constexpr float LOD_MAX_TRIANGLE_RATIO = 0.6f;
+
+static MeshLod fullDetailLod(const sfz::MeshComponent& comp) noexcept
+{
+	MeshLod lod;
+	lod.firstIndex = comp.firstIndex;
+	lod.numIndices = comp.numIndices;
+	lod.error = 0.0f;
+	return lod;
+}
+
+// Vertices on different sides of hard edges should not be merged, so the octant of the normal is
+// part of the cluster key.
+static uint32_t normalOctant(vec3 normal) noexcept
+{
+	return (normal.x < 0.0f ? 1u : 0u) | (normal.y < 0.0f ? 2u : 0u) | (normal.z < 0.0f ? 4u : 0u);
+}
+
+// Clusters the vertices of a component (given as local vertex indices) on a grid with the given
+// cell size. Returns the local index of the representative vertex of each local vertex.
+static void clusterVertices(
+	const vec3* positions,
+	const vec3* normals,
+	uint32_t numVertices,
+	vec3 boundsMin,
+	float cellSize,
+	sfz::Array<uint64_t>& keys,
+	sfz::Array<uint32_t>& sorted,
+	sfz::Array<uint32_t>& representativesOut) noexcept
+{
+	keys.clear();
+	sorted.clear();
+	for (uint32_t v = 0; v < numVertices; v++) {
+		const vec3 cell = (positions[v] - boundsMin) / cellSize;
+		const uint64_t x = uint64_t(sfz::clamp(cell.x, 0.0f, 65535.0f));
+		const uint64_t y = uint64_t(sfz::clamp(cell.y, 0.0f, 65535.0f));
+		const uint64_t z = uint64_t(sfz::clamp(cell.z, 0.0f, 65535.0f));
+		keys.add((x << 35) | (y << 19) | (z << 3) | uint64_t(normalOctant(normals[v])));
+		sorted.add(v);
+	}
+	std::sort(sorted.begin(), sorted.end(), [&](uint32_t lhs, uint32_t rhs) {
+		return keys[lhs] < keys[rhs];
+	});
+
+	// The representative of each cluster is the vertex closest to the cluster's mean position
+	representativesOut.clear();
+	representativesOut.add(0u, numVertices);
+	uint32_t clusterBegin = 0;
+	while (clusterBegin < numVertices) {
+		const uint64_t key = keys[sorted[clusterBegin]];
+		uint32_t clusterEnd = clusterBegin + 1;
+		vec3 mean = positions[sorted[clusterBegin]];
+		while (clusterEnd < numVertices && keys[sorted[clusterEnd]] == key) {
+			mean += positions[sorted[clusterEnd]];
+			clusterEnd += 1;
+		}
+		mean /= float(clusterEnd - clusterBegin);
+
+		uint32_t representative = sorted[clusterBegin];
+		float bestDistSquared = sfz::dot(positions[representative] - mean,
+			positions[representative] - mean);
+		for (uint32_t i = clusterBegin + 1; i < clusterEnd; i++) {
+			const vec3 diff = positions[sorted[i]] - mean;
+			const float distSquared = sfz::dot(diff, diff);
+			if (distSquared < bestDistSquared) {
+				bestDistSquared = distSquared;
+				representative = sorted[i];
+			}
+		}
+		for (uint32_t i = clusterBegin; i < clusterEnd; i++) {
+			representativesOut[sorted[i]] = representative;
+		}
+		clusterBegin = clusterEnd;
+	}
+}
+
+// ComponentLods
+// ------------------------------------------------------------------------------------------------
+
+void fullDetailLodsOnly(const sfz::Mesh& mesh, sfz::Array<ComponentLods>& lodsOut) noexcept
+{
+	lodsOut.clear();
+	for (const sfz::MeshComponent& comp : mesh.components) {
+		ComponentLods& lods = lodsOut.add(ComponentLods());
+		lods.lods[0] = fullDetailLod(comp);
+		lods.numLods = 1;
+	}
+}
+
+void generateMeshLods(
+	sfz::Mesh& mesh, sfz::Array<ComponentLods>& lodsOut, sfz::Allocator* allocator) noexcept
+{
+	fullDetailLodsOnly(mesh, lodsOut);
+
+	const uint32_t numVertices = mesh.vertices.size();
+	sfz::Array<uint32_t> globalToLocal;
+	globalToLocal.init(numVertices, allocator, sfz_dbg(""));
+	globalToLocal.add(~0u, numVertices);
+	sfz::Array<uint32_t> localToGlobal;
+	localToGlobal.init(numVertices, allocator, sfz_dbg(""));
+	sfz::Array<vec3> positions;
+	positions.init(numVertices, allocator, sfz_dbg(""));
+	sfz::Array<vec3> normals;
+	normals.init(numVertices, allocator, sfz_dbg(""));
+	sfz::Array<uint32_t> localIndices;
+	localIndices.init(0, allocator, sfz_dbg(""));
+	sfz::Array<uint64_t> keys;
+	keys.init(numVertices, allocator, sfz_dbg(""));
+	sfz::Array<uint32_t> sorted;
+	sorted.init(numVertices, allocator, sfz_dbg(""));
+	sfz::Array<uint32_t> representatives;
+	representatives.init(numVertices, allocator, sfz_dbg(""));
+	sfz::Array<uint32_t> lodIndices;
+	lodIndices.init(0, allocator, sfz_dbg(""));
+
+	for (uint32_t compIdx = 0; compIdx < mesh.components.size(); compIdx++) {
+		const sfz::MeshComponent comp = mesh.components[compIdx];
+		const uint32_t numTris = comp.numIndices / 3;
+		if (numTris < LOD_MIN_NUM_TRIANGLES) continue;
+
+		// Compact the component's vertices
+		localToGlobal.clear();
+		positions.clear();
+		normals.clear();
+		localIndices.clear();
+		BoundingBox bounds;
+		for (uint32_t i = 0; i < numTris * 3; i++) {
+			const uint32_t globalIdx = mesh.indices[comp.firstIndex + i];
+			if (globalToLocal[globalIdx] == ~0u) {
+				globalToLocal[globalIdx] = localToGlobal.size();
+				localToGlobal.add(globalIdx);
+				positions.add(mesh.vertices[globalIdx].pos);
+				normals.add(mesh.vertices[globalIdx].normal);
+				bounds.add(mesh.vertices[globalIdx].pos);
+			}
+			localIndices.add(globalToLocal[globalIdx]);
+		}
+		for (uint32_t globalIdx : localToGlobal) globalToLocal[globalIdx] = ~0u;
+		const vec3 extent = bounds.max - bounds.min;
+		const float maxExtent = sfz::max(extent.x, sfz::max(extent.y, extent.z));
+		if (!(maxExtent > 0.0f)) continue;
+
+		// Try increasingly coarse grids, keeping those that reduce the triangle count enough
+		ComponentLods& lods = lodsOut[compIdx];
+		uint32_t prevNumTris = numTris;
+		for (uint32_t gridRes = LOD_FIRST_GRID_RES; gridRes >= 2; gridRes /= 2) {
+			if (lods.numLods >= MAX_NUM_MESH_LODS) break;
+			const float cellSize = maxExtent / float(gridRes);
+			clusterVertices(positions.data(), normals.data(), localToGlobal.size(),
+				bounds.min, cellSize, keys, sorted, representatives);
+
+			// Remap triangles, dropping those that collapsed
+			lodIndices.clear();
+			for (uint32_t t = 0; t < numTris; t++) {
+				const uint32_t i0 = representatives[localIndices[t * 3 + 0]];
+				const uint32_t i1 = representatives[localIndices[t * 3 + 1]];
+				const uint32_t i2 = representatives[localIndices[t * 3 + 2]];
+				if (i0 == i1 || i1 == i2 || i2 == i0) continue;
+				lodIndices.add(localToGlobal[i0]);
+				lodIndices.add(localToGlobal[i1]);
+				lodIndices.add(localToGlobal[i2]);
+			}
+			const uint32_t lodNumTris = lodIndices.size() / 3;
+			if (lodNumTris == 0) break;
+			if (float(lodNumTris) > float(prevNumTris) * LOD_MAX_TRIANGLE_RATIO) continue;
+
+			// Vertices can move at most a cell diagonal
+			MeshLod& lod = lods.lods[lods.numLods];
+			lod.firstIndex = mesh.indices.size();
+			lod.numIndices = lodIndices.size();
+			lod.error = cellSize * std::sqrt(3.0f);
+			mesh.indices.add(lodIndices.data(), lodIndices.size());
+			lods.numLods += 1;
+			prevNumTris = lodNumTris;
+			if (lodNumTris < LOD_MIN_NUM_TRIANGLES) break;
+		}
+	}
+}
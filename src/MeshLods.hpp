@@ -0,0 +1,50 @@
+#pragma once
+
+#include <skipifzero.hpp>
+#include <skipifzero_arrays.hpp>
+
+#include <sfz/rendering/Mesh.hpp>
+
+// ComponentLods
+// ------------------------------------------------------------------------------------------------
+
+constexpr uint32_t MAX_NUM_MESH_LODS = 4;
+
+// A range in the mesh's index buffer, drawn instead of the component's own range.
+struct MeshLod final {
+	uint32_t firstIndex = 0;
+	uint32_t numIndices = 0;
+	float error = 0.0f; // Local space geometric error, 0 for the full detail LOD
+};
+
+// The LODs of a MeshComponent, from full detail to coarsest. LOD 0 is always the component's own
+// index range.
+struct ComponentLods final {
+	MeshLod lods[MAX_NUM_MESH_LODS];
+	uint32_t numLods = 0;
+};
+
+// Fills lodsOut with a single (full detail) LOD per component.
+void fullDetailLodsOnly(const sfz::Mesh& mesh, sfz::Array<ComponentLods>& lodsOut) noexcept;
+
+// Generates up to MAX_NUM_MESH_LODS - 1 simplified versions of each component using vertex
+// clustering (Rossignac & Borrel). Each LOD merges all vertices within a grid cell (and with
+// similar normals) into one of the existing vertices, so only indices are generated. They are
+// appended to mesh.indices. lodsOut gets one entry per component.
+void generateMeshLods(
+	sfz::Mesh& mesh, sfz::Array<ComponentLods>& lodsOut, sfz::Allocator* allocator) noexcept;
+
+// LOD selection
+// ------------------------------------------------------------------------------------------------
+
+// Returns the coarsest LOD whose error, multiplied by errorScale, is at most maxError.
+// errorScale converts a local space error to the unit of maxError, typically pixels.
+inline uint32_t selectLod(const ComponentLods& lods, float errorScale, float maxError)
+{
+	uint32_t lodIdx = 0;
+	for (uint32_t i = 1; i < lods.numLods; i++) {
+		if (lods.lods[i].error * errorScale > maxError) break;
+		lodIdx = i;
+	}
+	return lodIdx;
+}
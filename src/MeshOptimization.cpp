@@ -0,0 +1,383 @@
+#include "MeshOptimization.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <skipifzero_arrays.hpp>
+#include <skipifzero_math.hpp>
+
+using sfz::vec3;
+
+// Statics
+// ------------------------------------------------------------------------------------------------
+
+// Parameters from Forsyth's article, the cache is modelled as a LRU cache
+constexpr uint32_t FORSYTH_CACHE_SIZE = 32;
+constexpr float FORSYTH_CACHE_DECAY_POWER = 1.5f;
+constexpr float FORSYTH_LAST_TRI_SCORE = 0.75f;
+constexpr float FORSYTH_VALENCE_BOOST_SCALE = 2.0f;
+constexpr float FORSYTH_VALENCE_BOOST_POWER = 0.5f;
+constexpr uint32_t FORSYTH_MAX_VALENCE_TABLE = 64;
+
+struct ForsythScoreTables final {
+	float cache[FORSYTH_CACHE_SIZE];
+	float valence[FORSYTH_MAX_VALENCE_TABLE];
+
+	ForsythScoreTables() noexcept
+	{
+		for (uint32_t i = 0; i < FORSYTH_CACHE_SIZE; i++) {
+			if (i < 3) {
+				cache[i] = FORSYTH_LAST_TRI_SCORE;
+			}
+			else {
+				const float scaler = 1.0f / float(FORSYTH_CACHE_SIZE - 3);
+				cache[i] = std::pow(1.0f - float(i - 3) * scaler, FORSYTH_CACHE_DECAY_POWER);
+			}
+		}
+		valence[0] = 0.0f;
+		for (uint32_t i = 1; i < FORSYTH_MAX_VALENCE_TABLE; i++) {
+			valence[i] = valenceScore(i);
+		}
+	}
+
+	static float valenceScore(uint32_t numRemainingTris) noexcept
+	{
+		return FORSYTH_VALENCE_BOOST_SCALE *
+			std::pow(float(numRemainingTris), -FORSYTH_VALENCE_BOOST_POWER);
+	}
+
+	float vertexScore(int32_t cachePos, uint32_t numRemainingTris) const noexcept
+	{
+		// Vertices without any triangles left should never attract anything
+		if (numRemainingTris == 0) return -1.0f;
+		const float cacheScore = cachePos >= 0 ? cache[cachePos] : 0.0f;
+		const float valenceScore_ = numRemainingTris < FORSYTH_MAX_VALENCE_TABLE ?
+			valence[numRemainingTris] : valenceScore(numRemainingTris);
+		return cacheScore + valenceScore_;
+	}
+};
+
+// Reorders the triangles of an index buffer with local vertex indices in [0, numVertices)
+static void optimizeVertexCacheForsyth(
+	uint32_t* indices,
+	uint32_t numIndices,
+	uint32_t numVertices,
+	sfz::Allocator* allocator) noexcept
+{
+	const uint32_t numTris = numIndices / 3;
+	if (numTris <= 1) return;
+	const ForsythScoreTables tables;
+
+	// Triangles adjacent to each vertex. The first numRemaining[v] entries of a vertex's range are
+	// the triangles not yet emitted.
+	sfz::Array<uint32_t> numRemaining;
+	numRemaining.init(numVertices, allocator, sfz_dbg(""));
+	numRemaining.add(0u, numVertices);
+	for (uint32_t i = 0; i < numIndices; i++) numRemaining[indices[i]] += 1;
+	sfz::Array<uint32_t> adjOffsets;
+	adjOffsets.init(numVertices + 1, allocator, sfz_dbg(""));
+	adjOffsets.add(0u);
+	for (uint32_t v = 0; v < numVertices; v++) adjOffsets.add(adjOffsets[v] + numRemaining[v]);
+	sfz::Array<uint32_t> adjTris;
+	adjTris.init(numIndices, allocator, sfz_dbg(""));
+	adjTris.add(0u, numIndices);
+	{
+		sfz::Array<uint32_t> fillCount;
+		fillCount.init(numVertices, allocator, sfz_dbg(""));
+		fillCount.add(0u, numVertices);
+		for (uint32_t i = 0; i < numIndices; i++) {
+			const uint32_t v = indices[i];
+			adjTris[adjOffsets[v] + fillCount[v]] = i / 3;
+			fillCount[v] += 1;
+		}
+	}
+
+	sfz::Array<int32_t> cachePos;
+	cachePos.init(numVertices, allocator, sfz_dbg(""));
+	cachePos.add(-1, numVertices);
+	sfz::Array<float> vertexScores;
+	vertexScores.init(numVertices, allocator, sfz_dbg(""));
+	for (uint32_t v = 0; v < numVertices; v++) {
+		vertexScores.add(tables.vertexScore(-1, numRemaining[v]));
+	}
+	sfz::Array<float> triScores;
+	triScores.init(numTris, allocator, sfz_dbg(""));
+	int32_t bestTri = -1;
+	float bestScore = -1.0f;
+	for (uint32_t t = 0; t < numTris; t++) {
+		const float score = vertexScores[indices[t * 3 + 0]] +
+			vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+		triScores.add(score);
+		if (score > bestScore) {
+			bestScore = score;
+			bestTri = int32_t(t);
+		}
+	}
+	sfz::Array<uint8_t> emitted;
+	emitted.init(numTris, allocator, sfz_dbg(""));
+	emitted.add(uint8_t(0), numTris);
+
+	sfz::Array<uint32_t> newIndices;
+	newIndices.init(numIndices, allocator, sfz_dbg(""));
+	uint32_t cache[FORSYTH_CACHE_SIZE + 3];
+	uint32_t cacheSize = 0;
+	uint32_t scanCursor = 0;
+
+	for (uint32_t numEmitted = 0; numEmitted < numTris; numEmitted++) {
+
+		// If no triangle in the cache is adjacent to anything, pick the next one in input order
+		if (bestTri < 0) {
+			while (emitted[scanCursor] != 0) scanCursor += 1;
+			bestTri = int32_t(scanCursor);
+		}
+		const uint32_t tri = uint32_t(bestTri);
+		const uint32_t* triVerts = indices + tri * 3;
+		emitted[tri] = 1;
+		newIndices.add(triVerts, 3);
+
+		// Remove triangle from the remaining lists of its vertices
+		for (uint32_t i = 0; i < 3; i++) {
+			const uint32_t v = triVerts[i];
+			uint32_t* adj = adjTris.data() + adjOffsets[v];
+			for (uint32_t j = 0; j < numRemaining[v]; j++) {
+				if (adj[j] == tri) {
+					std::swap(adj[j], adj[numRemaining[v] - 1]);
+					break;
+				}
+			}
+			numRemaining[v] -= 1;
+		}
+
+		// Move the triangle's vertices to the front of the LRU cache, the (up to 3) vertices
+		// pushed out of the cache are kept at the end of the list so their scores are updated
+		uint32_t newCache[FORSYTH_CACHE_SIZE + 3];
+		uint32_t newCacheSize = 0;
+		for (uint32_t i = 0; i < 3; i++) newCache[newCacheSize++] = triVerts[i];
+		for (uint32_t i = 0; i < cacheSize; i++) {
+			const uint32_t v = cache[i];
+			if (v != triVerts[0] && v != triVerts[1] && v != triVerts[2]) {
+				newCache[newCacheSize++] = v;
+			}
+		}
+		for (uint32_t i = 0; i < newCacheSize; i++) {
+			const uint32_t v = newCache[i];
+			cachePos[v] = i < FORSYTH_CACHE_SIZE ? int32_t(i) : -1;
+			vertexScores[v] = tables.vertexScore(cachePos[v], numRemaining[v]);
+		}
+
+		// Rescore the remaining triangles of all affected vertices and find the best one
+		bestTri = -1;
+		bestScore = -1.0f;
+		for (uint32_t i = 0; i < newCacheSize; i++) {
+			const uint32_t v = newCache[i];
+			const uint32_t* adj = adjTris.data() + adjOffsets[v];
+			for (uint32_t j = 0; j < numRemaining[v]; j++) {
+				const uint32_t t = adj[j];
+				const float score = vertexScores[indices[t * 3 + 0]] +
+					vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+				triScores[t] = score;
+				if (score > bestScore) {
+					bestScore = score;
+					bestTri = int32_t(t);
+				}
+			}
+		}
+
+		cacheSize = sfz::min(newCacheSize, FORSYTH_CACHE_SIZE);
+		for (uint32_t i = 0; i < cacheSize; i++) cache[i] = newCache[i];
+	}
+
+	for (uint32_t i = 0; i < numIndices; i++) indices[i] = newIndices[i];
+}
+
+// Splits an (already vertex cache optimized) index buffer into clusters starting at triangles
+// that miss the cache completely, and sorts the clusters so that clusters facing away from the
+// center of the mesh are drawn first. Those are likely to occlude the rest.
+static void optimizeOverdraw(
+	uint32_t* indices,
+	uint32_t numIndices,
+	uint32_t numVertices,
+	const vec3* positions,
+	sfz::Allocator* allocator) noexcept
+{
+	const uint32_t numTris = numIndices / 3;
+	if (numTris <= 1) return;
+
+	// Find cluster boundaries by simulating a FIFO cache
+	sfz::Array<uint32_t> clusterStarts;
+	clusterStarts.init(64, allocator, sfz_dbg(""));
+	{
+		sfz::Array<uint32_t> insertedAt;
+		insertedAt.init(numVertices, allocator, sfz_dbg(""));
+		insertedAt.add(0u, numVertices);
+		uint32_t time = VERTEX_CACHE_ANALYSIS_SIZE;
+		for (uint32_t t = 0; t < numTris; t++) {
+			uint32_t numMisses = 0;
+			for (uint32_t i = 0; i < 3; i++) {
+				const uint32_t v = indices[t * 3 + i];
+				if ((time - insertedAt[v]) >= VERTEX_CACHE_ANALYSIS_SIZE) {
+					numMisses += 1;
+					time += 1;
+					insertedAt[v] = time;
+				}
+			}
+			if (t == 0 || numMisses == 3) clusterStarts.add(t);
+		}
+	}
+	const uint32_t numClusters = clusterStarts.size();
+	if (numClusters <= 1) return;
+
+	// Mesh center
+	vec3 meshCenter = vec3(0.0f);
+	for (uint32_t i = 0; i < numIndices; i++) meshCenter += positions[indices[i]];
+	meshCenter /= float(numIndices);
+
+	// Sort key per cluster, how much the (area weighted) cluster normal points away from the center
+	struct ClusterKey final {
+		uint32_t clusterIdx = 0;
+		float key = 0.0f;
+	};
+	sfz::Array<ClusterKey> keys;
+	keys.init(numClusters, allocator, sfz_dbg(""));
+	for (uint32_t c = 0; c < numClusters; c++) {
+		const uint32_t firstTri = clusterStarts[c];
+		const uint32_t endTri = (c + 1) < numClusters ? clusterStarts[c + 1] : numTris;
+		vec3 center = vec3(0.0f);
+		vec3 normal = vec3(0.0f);
+		for (uint32_t t = firstTri; t < endTri; t++) {
+			const vec3 p0 = positions[indices[t * 3 + 0]];
+			const vec3 p1 = positions[indices[t * 3 + 1]];
+			const vec3 p2 = positions[indices[t * 3 + 2]];
+			center += (p0 + p1 + p2) * (1.0f / 3.0f);
+			normal += sfz::cross(p1 - p0, p2 - p0);
+		}
+		center /= float(endTri - firstTri);
+		const float normalLength = sfz::length(normal);
+
+		ClusterKey& key = keys.add(ClusterKey());
+		key.clusterIdx = c;
+		key.key = normalLength > 0.0f ? sfz::dot(center - meshCenter, normal / normalLength) : 0.0f;
+	}
+	std::stable_sort(keys.begin(), keys.end(), [](const ClusterKey& lhs, const ClusterKey& rhs) {
+		return lhs.key > rhs.key;
+	});
+
+	sfz::Array<uint32_t> newIndices;
+	newIndices.init(numIndices, allocator, sfz_dbg(""));
+	for (const ClusterKey& key : keys) {
+		const uint32_t c = key.clusterIdx;
+		const uint32_t firstTri = clusterStarts[c];
+		const uint32_t endTri = (c + 1) < numClusters ? clusterStarts[c + 1] : numTris;
+		newIndices.add(indices + firstTri * 3, (endTri - firstTri) * 3);
+	}
+	for (uint32_t i = 0; i < numIndices; i++) indices[i] = newIndices[i];
+}
+
+// Reorders the vertices in the order they are first referenced, unreferenced vertices are removed
+static void optimizeVertexFetch(sfz::Mesh& mesh, sfz::Allocator* allocator) noexcept
+{
+	const uint32_t numVertices = mesh.vertices.size();
+	sfz::Array<uint32_t> remap;
+	remap.init(numVertices, allocator, sfz_dbg(""));
+	remap.add(~0u, numVertices);
+	sfz::Array<sfz::Vertex> newVertices;
+	newVertices.init(numVertices, allocator, sfz_dbg(""));
+	for (uint32_t& index : mesh.indices) {
+		if (remap[index] == ~0u) {
+			remap[index] = newVertices.size();
+			newVertices.add(mesh.vertices[index]);
+		}
+		index = remap[index];
+	}
+	mesh.vertices = std::move(newVertices);
+}
+
+// Vertex cache statistics
+// ------------------------------------------------------------------------------------------------
+
+VertexCacheStats analyzeVertexCache(const sfz::Mesh& mesh, sfz::Allocator* allocator) noexcept
+{
+	const uint32_t numVertices = mesh.vertices.size();
+	sfz::Array<uint32_t> insertedAt;
+	insertedAt.init(numVertices, allocator, sfz_dbg(""));
+	insertedAt.add(0u, numVertices);
+	sfz::Array<uint32_t> seenInComponent;
+	seenInComponent.init(numVertices, allocator, sfz_dbg(""));
+	seenInComponent.add(0u, numVertices);
+
+	// Each component is a separate draw, so the cache is flushed between components
+	VertexCacheStats stats;
+	uint32_t time = VERTEX_CACHE_ANALYSIS_SIZE;
+	for (uint32_t compIdx = 0; compIdx < mesh.components.size(); compIdx++) {
+		const sfz::MeshComponent& comp = mesh.components[compIdx];
+		time += VERTEX_CACHE_ANALYSIS_SIZE;
+		stats.numTriangles += comp.numIndices / 3;
+		for (uint32_t i = 0; i < comp.numIndices; i++) {
+			const uint32_t v = mesh.indices[comp.firstIndex + i];
+			if (seenInComponent[v] != compIdx + 1) {
+				seenInComponent[v] = compIdx + 1;
+				stats.numUniqueVertices += 1;
+			}
+			if ((time - insertedAt[v]) >= VERTEX_CACHE_ANALYSIS_SIZE) {
+				stats.numTransformedVertices += 1;
+				time += 1;
+				insertedAt[v] = time;
+			}
+		}
+	}
+	return stats;
+}
+
+// Mesh optimization
+// ------------------------------------------------------------------------------------------------
+
+MeshOptimizationStats optimizeMesh(sfz::Mesh& mesh, sfz::Allocator* allocator) noexcept
+{
+	MeshOptimizationStats stats;
+	stats.before = analyzeVertexCache(mesh, allocator);
+
+	// The per-component passes work on compact local vertex indices
+	const uint32_t numVertices = mesh.vertices.size();
+	sfz::Array<uint32_t> globalToLocal;
+	globalToLocal.init(numVertices, allocator, sfz_dbg(""));
+	globalToLocal.add(~0u, numVertices);
+	sfz::Array<uint32_t> localToGlobal;
+	localToGlobal.init(numVertices, allocator, sfz_dbg(""));
+	sfz::Array<vec3> localPositions;
+	localPositions.init(numVertices, allocator, sfz_dbg(""));
+	sfz::Array<uint32_t> localIndices;
+	localIndices.init(0, allocator, sfz_dbg(""));
+
+	for (const sfz::MeshComponent& comp : mesh.components) {
+		if (comp.numIndices < 6 || (comp.numIndices % 3) != 0) continue;
+		uint32_t* compIndices = mesh.indices.data() + comp.firstIndex;
+
+		localToGlobal.clear();
+		localPositions.clear();
+		localIndices.clear();
+		for (uint32_t i = 0; i < comp.numIndices; i++) {
+			const uint32_t globalIdx = compIndices[i];
+			if (globalToLocal[globalIdx] == ~0u) {
+				globalToLocal[globalIdx] = localToGlobal.size();
+				localToGlobal.add(globalIdx);
+				localPositions.add(mesh.vertices[globalIdx].pos);
+			}
+			localIndices.add(globalToLocal[globalIdx]);
+		}
+
+		const uint32_t numLocalVertices = localToGlobal.size();
+		optimizeVertexCacheForsyth(
+			localIndices.data(), comp.numIndices, numLocalVertices, allocator);
+		optimizeOverdraw(localIndices.data(), comp.numIndices, numLocalVertices,
+			localPositions.data(), allocator);
+
+		for (uint32_t i = 0; i < comp.numIndices; i++) {
+			compIndices[i] = localToGlobal[localIndices[i]];
+		}
+		for (uint32_t globalIdx : localToGlobal) globalToLocal[globalIdx] = ~0u;
+	}
+
+	optimizeVertexFetch(mesh, allocator);
+	stats.after = analyzeVertexCache(mesh, allocator);
+	return stats;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <skipifzero.hpp>
+
+#include <sfz/rendering/Mesh.hpp>
+
+// Vertex cache statistics
+// ------------------------------------------------------------------------------------------------
+
+// Size of the FIFO cache simulated when measuring, roughly matches the post-transform caches of
+// current GPUs.
+constexpr uint32_t VERTEX_CACHE_ANALYSIS_SIZE = 16;
+
+struct VertexCacheStats final {
+	uint32_t numTriangles = 0;
+	uint32_t numTransformedVertices = 0; // Cache misses
+	uint32_t numUniqueVertices = 0;
+
+	// Average cache miss ratio, transformed vertices per triangle. 0.5 is ideal for large grid
+	// meshes, 3.0 is the worst case.
+	float acmr() const
+	{
+		return numTriangles == 0 ? 0.0f : float(numTransformedVertices) / float(numTriangles);
+	}
+
+	// Average transform to vertex ratio, 1.0 is ideal.
+	float atvr() const
+	{
+		if (numUniqueVertices == 0) return 0.0f;
+		return float(numTransformedVertices) / float(numUniqueVertices);
+	}
+};
+
+// Simulates a FIFO post-transform cache over the index buffer of every component in the mesh.
+VertexCacheStats analyzeVertexCache(const sfz::Mesh& mesh, sfz::Allocator* allocator) noexcept;
+
+// Mesh optimization
+// ------------------------------------------------------------------------------------------------
+
+struct MeshOptimizationStats final {
+	VertexCacheStats before;
+	VertexCacheStats after;
+};
+
+// Optimizes a mesh for rendering, without changing what is rendered:
+//
+// 1. Triangles in each component are reordered for post-transform vertex cache locality (Tom
+//    Forsyth, "Linear-Speed Vertex Cache Optimisation").
+// 2. The result is split into clusters at cache-cold triangles, and the clusters are sorted
+//    roughly outside-in to reduce overdraw (a simplified version of Sander et al., "Fast
+//    Triangle Reordering for Vertex Locality and Reduced Overdraw").
+// 3. Vertices are reordered in the order they are first referenced for vertex fetch locality.
+MeshOptimizationStats optimizeMesh(sfz::Mesh& mesh, sfz::Allocator* allocator) noexcept;
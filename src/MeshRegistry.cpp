@@ -0,0 +1,176 @@
+#include "MeshRegistry.hpp"
+
+#include <sfz/renderer/Renderer.hpp>
+
+#include "BlockCompression.hpp"
+
+using sfz::strID;
+
+// MeshInfo
+// ------------------------------------------------------------------------------------------------
+
+// Components are used as occluders if their bounds are at least this large (in local space) in
+// two dimensions, so that they can hide something
+constexpr float OCCLUDER_MIN_SIZE = 2.0f;
+
+// Components with more triangles than this are not used as occluders. Only the full detail
+// geometry is used, the simplified LODs can bulge outside of the real surface and would then
+// hide things that are actually visible.
+constexpr uint32_t OCCLUDER_MAX_NUM_TRIANGLES = 2048;
+
+static bool isOccluderSized(const BoundingBox& bounds) noexcept
+{
+	if (bounds.isEmpty()) return false;
+	const sfz::vec3 size = bounds.max - bounds.min;
+	uint32_t numLargeDims = 0;
+	for (uint32_t i = 0; i < 3; i++) {
+		if (size[i] >= OCCLUDER_MIN_SIZE) numLargeDims += 1;
+	}
+	return numLargeDims >= 2;
+}
+
+static bool imageIsOpaque(const sfz::ImageViewConst& image) noexcept
+{
+	if (image.rawData == nullptr) return false;
+	switch (image.type) {
+	case sfz::ImageType::RGBA_U8:
+		return rgbaIsOpaque(image.rawData, image.width, image.height);
+	case sfz::ImageType::RGBA_F32: {
+		const float* rgba = reinterpret_cast<const float*>(image.rawData);
+		const size_t numPixels = size_t(image.width) * size_t(image.height);
+		for (size_t i = 0; i < numPixels; i++) {
+			if (rgba[i * 4 + 3] < 1.0f) return false;
+		}
+		return true;
+	}
+	case sfz::ImageType::UNDEFINED: return false;
+	default: return true; // No alpha channel
+	}
+}
+
+static bool materialIsOpaque(
+	const sfz::Material& material,
+	const sfz::strID* opaqueTextures,
+	uint32_t numOpaqueTextures) noexcept
+{
+	if (material.albedo.w != 255) return false;
+	if (!material.albedoTex.isValid()) return true;
+	for (uint32_t i = 0; i < numOpaqueTextures; i++) {
+		if (opaqueTextures[i] == material.albedoTex) return true;
+	}
+	return false;
+}
+
+static void gatherOccluders(
+	const sfz::Mesh& mesh,
+	const sfz::strID* opaqueTextures,
+	uint32_t numOpaqueTextures,
+	MeshInfo& info) noexcept
+{
+	info.occluderTriangles.clear();
+	for (uint32_t compIdx = 0; compIdx < mesh.components.size(); compIdx++) {
+		if (!isOccluderSized(info.componentBounds[compIdx])) continue;
+		const sfz::MeshComponent& comp = mesh.components[compIdx];
+		if ((comp.numIndices / 3) > OCCLUDER_MAX_NUM_TRIANGLES) continue;
+		if (comp.materialIdx >= mesh.materials.size()) continue;
+		const sfz::Material& material = mesh.materials[comp.materialIdx];
+		if (!materialIsOpaque(material, opaqueTextures, numOpaqueTextures)) continue;
+		for (uint32_t i = 0; i < comp.numIndices; i++) {
+			info.occluderTriangles.add(mesh.vertices[mesh.indices[comp.firstIndex + i]].pos);
+		}
+	}
+}
+
+void addIfOpaqueAlbedo(
+	const sfz::Mesh& mesh,
+	strID textureId,
+	const sfz::ImageViewConst& image,
+	sfz::Array<strID>& opaqueTexturesOut) noexcept
+{
+	bool isAlbedo = false;
+	for (const sfz::Material& material : mesh.materials) {
+		if (material.albedoTex == textureId) {
+			isAlbedo = true;
+			break;
+		}
+	}
+	if (!isAlbedo) return;
+	for (strID existing : opaqueTexturesOut) {
+		if (existing == textureId) return;
+	}
+	if (imageIsOpaque(image)) opaqueTexturesOut.add(textureId);
+}
+
+MeshInfo calculateMeshInfo(
+	const sfz::Mesh& mesh,
+	const ComponentLods* lods,
+	const strID* opaqueTextures,
+	uint32_t numOpaqueTextures,
+	sfz::Allocator* allocator) noexcept
+{
+	MeshInfo info;
+	info.componentBounds.init(mesh.components.size(), allocator, sfz_dbg(""));
+	info.componentLods.init(mesh.components.size(), allocator, sfz_dbg(""));
+	if (lods != nullptr) info.componentLods.add(lods, mesh.components.size());
+	else fullDetailLodsOnly(mesh, info.componentLods);
+	for (const sfz::MeshComponent& comp : mesh.components) {
+		BoundingBox compBounds;
+		for (uint32_t i = 0; i < comp.numIndices; i++) {
+			const uint32_t index = mesh.indices[comp.firstIndex + i];
+			compBounds.add(mesh.vertices[index].pos);
+		}
+		info.componentBounds.add(compBounds);
+		info.bounds.add(compBounds);
+	}
+
+	info.occluderTriangles.init(0, allocator, sfz_dbg(""));
+	gatherOccluders(mesh, opaqueTextures, numOpaqueTextures, info);
+	return info;
+}
+
+// MeshRegistry
+// ------------------------------------------------------------------------------------------------
+
+void MeshRegistry::init(uint32_t capacity, sfz::Allocator* allocatorIn) noexcept
+{
+	this->allocator = allocatorIn;
+	meshes.init(capacity, allocatorIn, sfz_dbg(""));
+}
+
+bool MeshRegistry::uploadMeshBlocking(
+	strID id,
+	const sfz::Mesh& mesh,
+	const ComponentLods* lods,
+	const strID* opaqueTextures,
+	uint32_t numOpaqueTextures) noexcept
+{
+	bool success = sfz::getRenderer().uploadMeshBlocking(id, mesh);
+	if (!success) return false;
+	meshes.put(id, calculateMeshInfo(mesh, lods, opaqueTextures, numOpaqueTextures, allocator));
+
+	// Both the mesh's PoolHandle and the location of MeshInfos in the hash map might have changed
+	generation += 1;
+	if (generation == 0) generation = 1;
+	return true;
+}
+
+void MeshRegistry::updateOccluders(
+	strID id,
+	const sfz::Mesh& mesh,
+	const strID* opaqueTextures,
+	uint32_t numOpaqueTextures) noexcept
+{
+	MeshInfo* info = meshes.get(id);
+	if (info == nullptr) return;
+	sfz_assert(info->componentBounds.size() == mesh.components.size());
+	gatherOccluders(mesh, opaqueTextures, numOpaqueTextures, *info);
+}
+
+ResolvedMesh MeshRegistry::resolve(strID id) const noexcept
+{
+	ResolvedMesh resolved;
+	resolved.handle = sfz::getResourceManager().getMeshHandle(id);
+	resolved.info = meshes.get(id);
+	resolved.generation = generation;
+	return resolved;
+}
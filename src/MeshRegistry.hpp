@@ -0,0 +1,111 @@
+#pragma once
+
+#include <skipifzero.hpp>
+#include <skipifzero_arrays.hpp>
+#include <skipifzero_hash_maps.hpp>
+#include <skipifzero_strings.hpp>
+
+#include <sfz/rendering/Image.hpp>
+#include <sfz/rendering/Mesh.hpp>
+#include <sfz/resources/ResourceManager.hpp>
+
+#include "Culling.hpp"
+#include "MeshLods.hpp"
+
+// MeshInfo
+// ------------------------------------------------------------------------------------------------
+
+// CPU side information about a mesh uploaded to the renderer, needed for culling and LOD
+// selection.
+struct MeshInfo final {
+	BoundingBox bounds; // Local space bounds of the entire mesh
+	sfz::Array<BoundingBox> componentBounds; // Local space bounds of each MeshComponent
+	sfz::Array<ComponentLods> componentLods; // LODs of each MeshComponent
+
+	// Local space triangle list (3 vertices per triangle, full detail) of the opaque components
+	// large enough to be used as occluders, see OcclusionBuffer
+	sfz::Array<sfz::vec3> occluderTriangles;
+};
+
+// Adds the texture to opaqueTexturesOut if it is the albedo texture of one of the mesh's materials
+// and all of its texels are opaque. Components whose albedo texture has any non-opaque texel
+// might be alpha tested (leaves, fences, etc.) and are never used as occluders.
+void addIfOpaqueAlbedo(
+	const sfz::Mesh& mesh,
+	sfz::strID textureId,
+	const sfz::ImageViewConst& image,
+	sfz::Array<sfz::strID>& opaqueTexturesOut) noexcept;
+
+// Calculates the local space bounds of a mesh and each of its components, and gathers its
+// occluders. If lods is nullptr each component only gets its full detail LOD, otherwise it must
+// point to one entry per component.
+//
+// Only components whose material is opaque are used as occluders, i.e. the albedo alpha is 255 and
+// the albedo texture (if any) is one of the given opaque textures (see addIfOpaqueAlbedo()).
+// Textures that are not in the list, e.g. because they have not been decoded yet, are treated as
+// non-opaque.
+MeshInfo calculateMeshInfo(
+	const sfz::Mesh& mesh,
+	const ComponentLods* lods,
+	const sfz::strID* opaqueTextures,
+	uint32_t numOpaqueTextures,
+	sfz::Allocator* allocator) noexcept;
+
+// ResolvedMesh
+// ------------------------------------------------------------------------------------------------
+
+// The result of looking up a mesh by its strID, cached so the lookups don't need to be performed
+// every frame. Only valid as long as its generation matches the registry's generation, which is
+// bumped every time a mesh is uploaded (or reloaded) through the registry.
+struct ResolvedMesh final {
+	sfz::PoolHandle handle = sfz::NULL_HANDLE;
+	const MeshInfo* info = nullptr;
+	uint32_t generation = 0; // 0 is never a valid generation
+};
+
+// MeshRegistry
+// ------------------------------------------------------------------------------------------------
+
+// Keeps track of the MeshInfo of every mesh uploaded through it. All meshes that are rendered by
+// the testbed should be uploaded through the registry so that they can be culled.
+struct MeshRegistry final {
+	sfz::Allocator* allocator = nullptr;
+	sfz::HashMap<sfz::strID, MeshInfo> meshes;
+	uint32_t generation = 1;
+
+	void init(uint32_t capacity, sfz::Allocator* allocator) noexcept;
+
+	// Uploads the mesh to the renderer and calculates its MeshInfo. The (optional) LODs must have
+	// one entry per component and the opaque textures decide which components can be occluders,
+	// see calculateMeshInfo().
+	bool uploadMeshBlocking(
+		sfz::strID id,
+		const sfz::Mesh& mesh,
+		const ComponentLods* lods = nullptr,
+		const sfz::strID* opaqueTextures = nullptr,
+		uint32_t numOpaqueTextures = 0) noexcept;
+
+	// Gathers the occluders of an already uploaded mesh again, e.g. once its textures have been
+	// decoded and it is known which of them are opaque. The mesh must be the one uploaded.
+	void updateOccluders(
+		sfz::strID id,
+		const sfz::Mesh& mesh,
+		const sfz::strID* opaqueTextures,
+		uint32_t numOpaqueTextures) noexcept;
+
+	const MeshInfo* get(sfz::strID id) const noexcept { return meshes.get(id); }
+
+	// Looks up the mesh's PoolHandle in the ResourceManager and its MeshInfo in the registry.
+	ResolvedMesh resolve(sfz::strID id) const noexcept;
+
+	// Cheap check whether a ResolvedMesh is still valid, no lookups are performed.
+	bool isValid(const ResolvedMesh& resolved) const { return resolved.generation == generation; }
+
+	// Re-resolves the mesh if it is no longer valid. Returns whether it had to be re-resolved.
+	bool refresh(sfz::strID id, ResolvedMesh& resolved) const noexcept
+	{
+		if (isValid(resolved)) return false;
+		resolved = resolve(id);
+		return true;
+	}
+};
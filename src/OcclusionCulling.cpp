@@ -0,0 +1,250 @@
+#include "OcclusionCulling.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_USE_SSE2 1
+#include <emmintrin.h>
+#else
+#define OCCLUSION_USE_SSE2 0
+#endif
+
+using sfz::mat4;
+using sfz::vec3;
+using sfz::vec4;
+
+// Statics
+// ------------------------------------------------------------------------------------------------
+
+// Vertices closer than this (in clip space w) are considered to cross the near plane
+constexpr float OCCLUSION_MIN_W = 1e-3f;
+
+// Occluders must be nearer than a box by this factor (in 1 / w) to hide it, so that surfaces do
+// not occlude their own bounding boxes due to rounding
+constexpr float OCCLUSION_DEPTH_BIAS = 1.0001f;
+
+constexpr float BUFFER_WIDTH = float(OCCLUSION_BUFFER_WIDTH);
+constexpr float BUFFER_HEIGHT = float(OCCLUSION_BUFFER_HEIGHT);
+
+// A vertex in the occlusion buffer's pixel coordinates, z is 1 / w
+struct ScreenVertex final {
+	float x, y, z;
+};
+
+// Projects a point using the x, y and w rows of a projection matrix. Returns false if the point
+// is on or behind the near plane.
+static bool projectToScreen(
+	const vec4& rowX, const vec4& rowY, const vec4& rowW, vec3 point, ScreenVertex& out) noexcept
+{
+	const float w = dot(rowW.xyz, point) + rowW.w;
+	if (w < OCCLUSION_MIN_W) return false;
+	const float invW = 1.0f / w;
+	const float ndcX = (dot(rowX.xyz, point) + rowX.w) * invW;
+	const float ndcY = (dot(rowY.xyz, point) + rowY.w) * invW;
+	out.x = (ndcX * 0.5f + 0.5f) * BUFFER_WIDTH;
+	out.y = (0.5f - ndcY * 0.5f) * BUFFER_HEIGHT;
+	out.z = invW;
+	return true;
+}
+
+// A function a * x + b * y + c over the pixel coordinates of the buffer
+struct PixelPlane final {
+	float a, b, c;
+	float at(float x, float y) const { return a * x + b * y + c; }
+};
+
+// OcclusionBuffer: Constructors & destructors
+// ------------------------------------------------------------------------------------------------
+
+void OcclusionBuffer::init(sfz::Allocator* allocator) noexcept
+{
+	this->destroy();
+	mAllocator = allocator;
+	const uint64_t numBytes = OCCLUSION_BUFFER_WIDTH * OCCLUSION_BUFFER_HEIGHT * sizeof(float);
+	mDepth = static_cast<float*>(
+		allocator->allocate(sfz_dbg("OcclusionBuffer::mDepth"), numBytes, 64));
+	this->clear(mat4::identity());
+}
+
+void OcclusionBuffer::destroy() noexcept
+{
+	if (mDepth != nullptr) mAllocator->deallocate(mDepth);
+	mAllocator = nullptr;
+	mDepth = nullptr;
+}
+
+// OcclusionBuffer: Methods
+// ------------------------------------------------------------------------------------------------
+
+void OcclusionBuffer::clear(const mat4& projViewMatrix) noexcept
+{
+	for (uint32_t i = 0; i < OCCLUSION_BUFFER_WIDTH * OCCLUSION_BUFFER_HEIGHT; i++) {
+		mDepth[i] = 0.0f;
+	}
+	mProjViewMatrix = projViewMatrix;
+}
+
+uint32_t OcclusionBuffer::rasterizeTriangles(
+	const mat4& modelViewProjMatrix,
+	const vec3* vertices,
+	uint32_t numVertices) noexcept
+{
+	const vec4 rowX = modelViewProjMatrix.row(0);
+	const vec4 rowY = modelViewProjMatrix.row(1);
+	const vec4 rowW = modelViewProjMatrix.row(3);
+
+	uint32_t numRasterized = 0;
+	for (uint32_t triIdx = 0; (triIdx + 2) < numVertices; triIdx += 3) {
+		ScreenVertex v[3];
+		if (!projectToScreen(rowX, rowY, rowW, vertices[triIdx], v[0])) continue;
+		if (!projectToScreen(rowX, rowY, rowW, vertices[triIdx + 1], v[1])) continue;
+		if (!projectToScreen(rowX, rowY, rowW, vertices[triIdx + 2], v[2])) continue;
+
+		// Occluders are double sided, make the winding counter-clockwise
+		float doubleArea = (v[1].x - v[0].x) * (v[2].y - v[0].y) -
+			(v[1].y - v[0].y) * (v[2].x - v[0].x);
+		if (doubleArea < 0.0f) {
+			std::swap(v[1], v[2]);
+			doubleArea = -doubleArea;
+		}
+		if (!(doubleArea > 0.0f)) continue;
+
+		// Pixels entirely inside the bounds of the triangle, only they can be covered
+		const float minX = sfz::min(v[0].x, sfz::min(v[1].x, v[2].x));
+		const float maxX = sfz::max(v[0].x, sfz::max(v[1].x, v[2].x));
+		const float minY = sfz::min(v[0].y, sfz::min(v[1].y, v[2].y));
+		const float maxY = sfz::max(v[0].y, sfz::max(v[1].y, v[2].y));
+		const int32_t x0 = int32_t(std::ceil(sfz::clamp(minX, 0.0f, BUFFER_WIDTH)));
+		const int32_t x1 = int32_t(std::floor(sfz::clamp(maxX, 0.0f, BUFFER_WIDTH)));
+		const int32_t y0 = int32_t(std::ceil(sfz::clamp(minY, 0.0f, BUFFER_HEIGHT)));
+		const int32_t y1 = int32_t(std::floor(sfz::clamp(maxY, 0.0f, BUFFER_HEIGHT)));
+		if (x0 >= x1 || y0 >= y1) continue;
+
+		// Edge functions, positive inside. They are shifted to their minimum within the pixel
+		// (at one of its corners) so that evaluating them at the center tells if the whole pixel
+		// is inside.
+		PixelPlane edges[3];
+		for (uint32_t i = 0; i < 3; i++) {
+			const ScreenVertex& a = v[(i + 1) % 3];
+			const ScreenVertex& b = v[(i + 2) % 3];
+			PixelPlane& edge = edges[i];
+			edge.a = a.y - b.y;
+			edge.b = b.x - a.x;
+			edge.c = a.x * b.y - a.y * b.x - 0.5f * (std::abs(edge.a) + std::abs(edge.b));
+		}
+
+		// 1 / w interpolated using the edge functions as barycentrics, shifted to the farthest
+		// depth within the pixel
+		PixelPlane depth = {};
+		const float invDoubleArea = 1.0f / doubleArea;
+		for (uint32_t i = 0; i < 3; i++) {
+			const ScreenVertex& a = v[(i + 1) % 3];
+			const ScreenVertex& b = v[(i + 2) % 3];
+			const float weight = v[i].z * invDoubleArea;
+			depth.a += (a.y - b.y) * weight;
+			depth.b += (b.x - a.x) * weight;
+			depth.c += (a.x * b.y - a.y * b.x) * weight;
+		}
+		depth.c -= 0.5f * (std::abs(depth.a) + std::abs(depth.b));
+
+		// Rows are processed 4 pixels at a time starting from an aligned pixel, the pixels left
+		// of x0 are outside the triangle anyway
+		const int32_t alignedX0 = x0 & ~3;
+		numRasterized += 1;
+		for (int32_t y = y0; y < y1; y++) {
+			const float pixelY = float(y) + 0.5f;
+			float* row = mDepth + uint32_t(y) * OCCLUSION_BUFFER_WIDTH;
+#if OCCLUSION_USE_SSE2
+			const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+			const __m128 zero = _mm_setzero_ps();
+			__m128 edgeStep[3], edgeValues[3];
+			for (uint32_t i = 0; i < 3; i++) {
+				const float rowStart = edges[i].at(float(alignedX0), pixelY);
+				edgeStep[i] = _mm_set1_ps(edges[i].a * 4.0f);
+				edgeValues[i] = _mm_add_ps(_mm_set1_ps(rowStart),
+					_mm_mul_ps(_mm_set1_ps(edges[i].a), laneOffsets));
+			}
+			const __m128 depthStep = _mm_set1_ps(depth.a * 4.0f);
+			__m128 depthValues = _mm_add_ps(_mm_set1_ps(depth.at(float(alignedX0), pixelY)),
+				_mm_mul_ps(_mm_set1_ps(depth.a), laneOffsets));
+			for (int32_t x = alignedX0; x < x1; x += 4) {
+				__m128 inside = _mm_cmpge_ps(edgeValues[0], zero);
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(edgeValues[1], zero));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(edgeValues[2], zero));
+				const __m128 z = _mm_and_ps(inside, _mm_max_ps(depthValues, zero));
+				_mm_store_ps(row + x, _mm_max_ps(_mm_load_ps(row + x), z));
+				for (uint32_t i = 0; i < 3; i++) {
+					edgeValues[i] = _mm_add_ps(edgeValues[i], edgeStep[i]);
+				}
+				depthValues = _mm_add_ps(depthValues, depthStep);
+			}
+#else
+			for (int32_t x = x0; x < x1; x++) {
+				const float pixelX = float(x) + 0.5f;
+				if (edges[0].at(pixelX, pixelY) < 0.0f) continue;
+				if (edges[1].at(pixelX, pixelY) < 0.0f) continue;
+				if (edges[2].at(pixelX, pixelY) < 0.0f) continue;
+				row[x] = sfz::max(row[x], depth.at(pixelX, pixelY));
+			}
+#endif
+		}
+	}
+	return numRasterized;
+}
+
+bool OcclusionBuffer::isOccluded(const BoundingBox& box) const noexcept
+{
+	if (box.isEmpty()) return false;
+	const vec4 rowX = mProjViewMatrix.row(0);
+	const vec4 rowY = mProjViewMatrix.row(1);
+	const vec4 rowW = mProjViewMatrix.row(3);
+
+	// Screen space bounds and nearest depth of the box, boxes crossing the near plane are visible
+	float minX = FLT_MAX, maxX = -FLT_MAX, minY = FLT_MAX, maxY = -FLT_MAX;
+	float nearestZ = 0.0f;
+	for (uint32_t i = 0; i < 8; i++) {
+		const vec3 corner = vec3(
+			(i & 1) ? box.max.x : box.min.x,
+			(i & 2) ? box.max.y : box.min.y,
+			(i & 4) ? box.max.z : box.min.z);
+		ScreenVertex v;
+		if (!projectToScreen(rowX, rowY, rowW, corner, v)) return false;
+		minX = sfz::min(minX, v.x);
+		maxX = sfz::max(maxX, v.x);
+		minY = sfz::min(minY, v.y);
+		maxY = sfz::max(maxY, v.y);
+		nearestZ = sfz::max(nearestZ, v.z);
+	}
+	nearestZ *= OCCLUSION_DEPTH_BIAS;
+
+	// All pixels touched by the box. Boxes outside the buffer are left to frustum culling.
+	const int32_t x0 = int32_t(std::floor(sfz::clamp(minX, 0.0f, BUFFER_WIDTH)));
+	const int32_t x1 = int32_t(std::ceil(sfz::clamp(maxX, 0.0f, BUFFER_WIDTH)));
+	const int32_t y0 = int32_t(std::floor(sfz::clamp(minY, 0.0f, BUFFER_HEIGHT)));
+	const int32_t y1 = int32_t(std::ceil(sfz::clamp(maxY, 0.0f, BUFFER_HEIGHT)));
+	if (x0 >= x1 || y0 >= y1) return false;
+
+	// Occluded only if every pixel has an occluder in front of the box
+	for (int32_t y = y0; y < y1; y++) {
+		const float* row = mDepth + uint32_t(y) * OCCLUSION_BUFFER_WIDTH;
+#if OCCLUSION_USE_SSE2
+		const __m128 nearest = _mm_set1_ps(nearestZ);
+		const __m128 rangeMin = _mm_set1_ps(float(x0));
+		const __m128 rangeMax = _mm_set1_ps(float(x1));
+		for (int32_t x = x0 & ~3; x < x1; x += 4) {
+			const __m128 lanes =
+				_mm_add_ps(_mm_set1_ps(float(x)), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+			const __m128 inRange =
+				_mm_and_ps(_mm_cmpge_ps(lanes, rangeMin), _mm_cmplt_ps(lanes, rangeMax));
+			const __m128 visible = _mm_and_ps(inRange, _mm_cmple_ps(_mm_load_ps(row + x), nearest));
+			if (_mm_movemask_ps(visible) != 0) return false;
+		}
+#else
+		for (int32_t x = x0; x < x1; x++) {
+			if (row[x] <= nearestZ) return false;
+		}
+#endif
+	}
+	return true;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <skipifzero.hpp>
+#include <skipifzero_math.hpp>
+
+#include "Culling.hpp"
+
+// OcclusionBuffer constants
+// ------------------------------------------------------------------------------------------------
+
+// Resolution of the occlusion buffer, independent of the screen resolution. The width must be a
+// multiple of 4 (the SIMD width).
+constexpr uint32_t OCCLUSION_BUFFER_WIDTH = 256;
+constexpr uint32_t OCCLUSION_BUFFER_HEIGHT = 128;
+static_assert((OCCLUSION_BUFFER_WIDTH % 4) == 0, "Width must be a multiple of 4");
+
+// OcclusionBuffer
+// ------------------------------------------------------------------------------------------------
+
+// Low resolution software depth buffer for occlusion culling. A few large occluders are
+// rasterized into it on the CPU each frame, after which the screen space bounds of everything
+// else can be tested against it.
+//
+// Occluders must be opaque. The triangles are rasterized as solid surfaces, so an alpha tested
+// occluder (leaves, fences, etc.) would hide things that are visible through its holes. See
+// calculateMeshInfo() for how the occluders are chosen.
+//
+// Occluders are rasterized conservatively: a pixel is only written if a single triangle covers
+// all of it, and then gets the farthest depth of the triangle within the pixel. A box is only
+// reported as occluded if it is behind an occluder in every pixel it touches, so gaps between
+// occluders can't hide anything no matter how narrow they are. The price is that pixels along the
+// edges between the triangles of a mesh are usually not covered by either triangle, so occluders
+// need to be large compared to the pixels of the buffer. Requires a perspective projection, the
+// buffer stores 1 / w (which is interpolated linearly in screen space) with 0 meaning nothing has
+// been rasterized.
+//
+// Uses SSE2 (4 pixels at a time) when available and a scalar fallback otherwise.
+class OcclusionBuffer final {
+public:
+	// Constructors & destructors
+	// --------------------------------------------------------------------------------------------
+
+	OcclusionBuffer() noexcept = default;
+	OcclusionBuffer(const OcclusionBuffer&) = delete;
+	OcclusionBuffer& operator= (const OcclusionBuffer&) = delete;
+	OcclusionBuffer(OcclusionBuffer&&) = delete;
+	OcclusionBuffer& operator= (OcclusionBuffer&&) = delete;
+	~OcclusionBuffer() noexcept { this->destroy(); }
+
+	void init(sfz::Allocator* allocator) noexcept;
+	void destroy() noexcept;
+
+	// Methods
+	// --------------------------------------------------------------------------------------------
+
+	bool isInitialized() const { return mDepth != nullptr; }
+
+	// Clears the buffer and sets the (perspective) projection * view matrix used by testBox().
+	void clear(const sfz::mat4& projViewMatrix) noexcept;
+
+	// Rasterizes a triangle list (3 vertices per triangle) transformed by the given model view
+	// projection matrix. Triangles crossing the near plane are skipped, which is conservative.
+	// Returns the number of triangles rasterized.
+	uint32_t rasterizeTriangles(
+		const sfz::mat4& modelViewProjMatrix,
+		const sfz::vec3* vertices,
+		uint32_t numVertices) noexcept;
+
+	// Returns whether the (world space) box is completely hidden by the rasterized occluders.
+	bool isOccluded(const BoundingBox& box) const noexcept;
+
+private:
+	sfz::Allocator* mAllocator = nullptr;
+	float* mDepth = nullptr; // 1 / w, OCCLUSION_BUFFER_WIDTH * OCCLUSION_BUFFER_HEIGHT
+	sfz::mat4 mProjViewMatrix;
+};
@@ -1,3 +1,10 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
 #include <imgui.h>
 
 #include <skipifzero.hpp>
@@ -20,16 +27,28 @@
 #include <sfz/resources/MeshResource.hpp>
 #include <sfz/resources/ResourceManager.hpp>
 #include <sfz/resources/TextureResource.hpp>
-#include <sfz/state/GameState.hpp>
-#include <sfz/state/GameStateContainer.hpp>
-#include <sfz/state/GameStateEditor.hpp>
 #include <sfz/util/FixedTimeUpdateHelpers.hpp>
 #include <sfz/util/GltfLoader.hpp>
 #include <sfz/util/GltfWriter.hpp>
 
 #include <ZeroG.h>
 
+#include "Allocators.hpp"
+#include "Benchmark.hpp"
+#include "Bvh.hpp"
 #include "Cube.hpp"
+#include "Culling.hpp"
+#include "DynamicResolution.hpp"
+#include "EntityStore.hpp"
+#include "GltfStreamer.hpp"
+#include "LightList.hpp"
+#include "MeshRegistry.hpp"
+#include "OcclusionCulling.hpp"
+#include "Profiler.hpp"
+#include "ScenePackage.hpp"
+#include "TransformHierarchy.hpp"
+#include "TransformKernels.hpp"
+#include "WorkerPool.hpp"
 
 #if defined(_WIN32) && defined(NDEBUG)
 #pragma comment(linker, "/SUBSYSTEM:windows /ENTRY:mainCRTStartup")
@@ -62,62 +81,432 @@ struct CameraData {
 	float vertFovDeg = 0.0f;
 };
 
+// Placed in the world by the entity's Transform, or StaticScene::modelMatrices if static
 struct RenderEntity final {
-	sfz::quat rotation = sfz::quat::identity();
-	sfz::vec3 scale = sfz::vec3(1.0f);
-	sfz::vec3 translation = sfz::vec3(0.0f);
 	strID meshId;
+	ResolvedMesh mesh; // Cached lookup of meshId, re-resolved if meshes are (re)loaded
+};
 
-	sfz::mat34 transform() const
-	{
-		// Apply rotation first
-		sfz::mat34 tmp = rotation.toMat34();
+struct StaticScene final {
+	sfz::Array<RenderEntity> renderEntities;
+	sfz::Array<sfz::mat34> modelMatrices; // Of each render entity, calculated once when added
+	sfz::Array<phSphereLight> sphereLights;
+};
 
-		// Matrix multiply in scale (order does not matter)
-		sfz::vec4 scaleVec = sfz::vec4(scale, 1.0f);
-		tmp.row(0) *= scaleVec;
-		tmp.row(1) *= scaleVec;
-		tmp.row(2) *= scaleVec;
+// A RenderEntity (static or dynamic) prepared for rendering, gathered once per frame and shared
+// between all geometry passes.
+struct FrameRenderItem final {
+	uint32_t modelMatrixIdx = 0; // Index into FrameRenderList::modelMatrices
+	float maxScale = 1.0f; // Largest scale of the model matrix, for LOD selection
+	sfz::PoolHandle meshHandle;
+	const MeshInfo* meshInfo = nullptr;
+	BoundingBox worldBounds;
+	uint32_t firstComponentBounds = 0; // Index into FrameRenderList::componentBounds
+	uint32_t numComponents = 0;
+};
+
+// A contiguous range of FrameRenderItems that all use the same mesh
+struct MeshGroup final {
+	sfz::PoolHandle meshHandle;
+	const MeshInfo* meshInfo = nullptr;
+	uint32_t firstItem = 0;
+	uint32_t numItems = 0;
+};
 
-		// Add translation (last)
-		tmp.setColumn(3, translation);
+struct FrameRenderList final {
+	// The static scene's items come first in StaticScene order (so the index of a static item is
+	// the index of its render entity), followed by the dynamic items sorted by mesh
+	sfz::Array<FrameRenderItem> items;
+	sfz::Array<BoundingBox> componentBounds; // World space bounds of each MeshComponent
+	sfz::Array<MeshGroup> groups; // Of the dynamic items
+
+	// Model matrices of all render entities (static first), in gather order
+	sfz::Array<sfz::mat34> modelMatrices;
+
+	// The static scene's items and components come first in items and componentBounds
+	uint32_t numStaticItems = 0;
+	uint32_t numStaticComponents = 0;
+};
+
+// The item and MeshComponent a static componentBounds entry belongs to
+struct StaticComponentRef final {
+	uint32_t itemIdx = 0;
+	uint32_t compIdx = 0;
+};
+
+// Geometry passes
+// ------------------------------------------------------------------------------------------------
+
+constexpr uint32_t GBUFFER_PASS_IDX = 0;
+constexpr uint32_t NUM_GEOMETRY_PASSES = 4;
+constexpr const char* GEOMETRY_PASS_NAMES[NUM_GEOMETRY_PASSES] = {
+	"GBuffer",
+	"Shadow Cascade 1",
+	"Shadow Cascade 2",
+	"Shadow Cascade 3"
+};
+
+constexpr const char* SHADOW_MAP_CASCADE_FRAMEBUFFERS[NUM_GEOMETRY_PASSES - 1] = {
+	"ShadowMapCascaded1_fb",
+	"ShadowMapCascaded2_fb",
+	"ShadowMapCascaded3_fb"
+};
+
+constexpr uint32_t SHADOW_MAP_CASCADE_RES[NUM_GEOMETRY_PASSES - 1] = {
+	2048,
+	2048,
+	1024
+};
+
+struct PassStats final {
+	uint32_t numDrawnComponents = 0;
+	uint32_t numCulledComponents = 0;
+	uint32_t numOccludedComponents = 0;
+	uint32_t numSkippedStateChanges = 0;
+	uint32_t numBatches = 0;
+	uint32_t numTriangles = 0;
+	bool cached = false; // Shadow cascade was up to date, nothing was rendered
+};
 
-		return tmp;
+struct OcclusionStats final {
+	uint32_t numOccluderTriangles = 0; // Rasterized, excluding those outside the buffer
+	float rasterizeMs = 0.0f;
+};
+
+// The contents of a shadow cascade are kept between frames, and only re-rendered if the light
+// matrices or anything drawn into it changed.
+struct ShadowCascadeCache final {
+	bool valid = false;
+	sfz::mat4 viewMatrix;
+	sfz::mat4 projMatrix;
+	uint64_t contentsHash = 0;
+};
+
+// 64-bit FNV-1a, continuing from the given hash
+inline uint64_t hashBytes(uint64_t hash, const void* data, size_t numBytes)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	for (size_t i = 0; i < numBytes; i++) {
+		hash ^= bytes[i];
+		hash *= 0x100000001B3ull;
 	}
+	return hash;
+}
+
+inline bool sameMatrix(const sfz::mat4& lhs, const sfz::mat4& rhs)
+{
+	return memcmp(lhs.data(), rhs.data(), sizeof(sfz::mat4)) == 0;
+}
+
+// An instance of a MeshComponent together with the LOD selected for it
+struct InstanceLod final {
+	uint32_t matricesIdx = 0; // Index into the pass' DrawMatrices
+	uint32_t lodIdx = 0;
 };
 
-struct StaticScene final {
-	sfz::Array<RenderEntity> renderEntities;
-	sfz::Array<phSphereLight> sphereLights;
+// How LODs are selected in a geometry pass. The projected size of a LOD's error is
+// error * scale * pixelsPerUnit / distance (perspective) or error * scale * pixelsPerUnit
+// (orthographic) pixels, or texels for shadow maps. The coarsest LOD with a projected error of
+// at most maxError is selected.
+struct LodSelection final {
+	float pixelsPerUnit = 0.0f; // At distance 1 for perspective projections
+	bool perspective = true;
+	float maxError = 0.0f;
+};
+
+inline LodSelection createLodSelection(
+	const sfz::mat4& projMatrix, float targetHeight, float maxError)
+{
+	LodSelection selection;
+	selection.pixelsPerUnit = projMatrix.at(1, 1) * 0.5f * targetHeight;
+	selection.perspective = projMatrix.at(3, 3) == 0.0f;
+	selection.maxError = maxError;
+	return selection;
+}
+
+// Scale converting the local space errors of a component's LODs to pixels (or texels)
+inline float lodErrorScale(
+	const LodSelection& selection,
+	const sfz::mat4& viewMatrix,
+	const BoundingBox& worldBounds,
+	float maxScale)
+{
+	float scale = selection.pixelsPerUnit * maxScale;
+	if (selection.perspective) {
+		const sfz::vec3 centerVS = sfz::transformPoint(viewMatrix, worldBounds.center());
+		const float distance = sfz::length(centerVS) - sfz::length(worldBounds.halfExtents());
+		scale /= sfz::max(distance, 0.01f);
+	}
+	return scale;
+}
+
+// A MeshComponent to be drawn for one or more instances (entities sharing the same mesh) in a
+// geometry pass. Draws are sorted by their key before being recorded so that consecutive draws
+// share as much state as possible.
+struct DrawItem final {
+	uint64_t key = 0;
+	sfz::MeshResource* mesh = nullptr;
+	uint32_t compIdx = 0;
+	MeshLod lod; // Index range to draw, the component's own or one of its LODs
+	uint32_t firstInstance = 0; // Index into the pass' instance list
+	uint32_t numInstances = 0;
 };
 
-// ECS component types
+// Draw key layout, most significant bits first:
+// [pass: 4 bits][mesh: 20 bits][texture set: 24 bits][material index: 16 bits]
+// There is one shader per pass, so the pass bits also sort by shader.
+inline uint64_t createDrawKey(
+	uint32_t passIdx, sfz::PoolHandle mesh, uint32_t textureSetHash, uint32_t materialIdx)
+{
+	uint64_t key = 0;
+	key |= uint64_t(passIdx & 0xFu) << 60;
+	key |= uint64_t(mesh.idx() & 0xFFFFFu) << 40;
+	key |= uint64_t(textureSetHash & 0xFFFFFFu) << 16;
+	key |= uint64_t(materialIdx & 0xFFFFu);
+	return key;
+}
+
+// Hash of the set of textures a material binds. Only used for sorting, collisions just mean
+// that some redundant binding changes might not be skipped.
+inline uint32_t textureSetHash(const sfz::Material& material)
+{
+	uint64_t hash = material.albedoTex.id;
+	hash = hash * 31 + material.metallicRoughnessTex.id;
+	hash = hash * 31 + material.emissiveTex.id;
+	return uint32_t(hash ^ (hash >> 32));
+}
+
+inline bool sameTextures(const sfz::Material& lhs, const sfz::Material& rhs)
+{
+	return lhs.albedoTex == rhs.albedoTex &&
+		lhs.metallicRoughnessTex == rhs.metallicRoughnessTex &&
+		lhs.emissiveTex == rhs.emissiveTex;
+}
+
+// Point lights
+// ------------------------------------------------------------------------------------------------
+
+// The shading shader handles a fixed number of lights per dispatch, more lights are rendered by
+// splitting them into several batches, each with its own streaming buffer.
+constexpr uint32_t MAX_NUM_POINT_LIGHTS_PER_BATCH =
+	sizeof(sfz::ForwardShaderPointLightsBuffer::pointLights) / sizeof(sfz::ShaderPointLight);
+
+struct PointLightsBufferName final {
+	char str[64];
+};
+
+inline PointLightsBufferName pointLightsBufferName(uint32_t batchIdx)
+{
+	PointLightsBufferName name;
+	if (batchIdx == 0) snprintf(name.str, sizeof(name.str), "Point Lights Buffer");
+	else snprintf(name.str, sizeof(name.str), "Point Lights Buffer %u", batchIdx);
+	return name;
+}
+
+// Number of copies of each point lights streaming buffer, an unchanged batch needs to be uploaded
+// this many frames in a row before all copies contain it
+constexpr uint32_t POINT_LIGHTS_BUFFER_NUM_COPIES = 3;
+
+struct LightStats final {
+	uint32_t numLights = 0;
+	uint32_t numVisibleLights = 0;
+	uint32_t numBatches = 0;
+	uint32_t numTransformed = 0; // Lights transformed into view space this frame
+	uint32_t numUploadedBatches = 0; // Batches uploaded this frame
+};
+
+// Level
+// ------------------------------------------------------------------------------------------------
+
+// Cooked version of "res/sponza.gltf", created by running with "--cook"
+constexpr const char* SPONZA_PACKAGE_PATH = "res/sponza.phscene";
+
+// Memory
+// ------------------------------------------------------------------------------------------------
+
+// Budget of the frame arena, per frame in flight
+constexpr uint64_t FRAME_ARENA_BYTES_PER_FRAME = 4 * 1024 * 1024;
+
+// Subsystems whose allocations are tracked separately, see the "Memory" console window
+enum class MemorySubsystem : uint32_t {
+	ECS = 0,
+	RESOURCES,
+	CONSOLE,
+	GLTF_LOAD,
+	RENDERING,
+	COUNT
+};
+constexpr uint32_t NUM_MEMORY_SUBSYSTEMS = uint32_t(MemorySubsystem::COUNT);
+
+constexpr const char* MEMORY_SUBSYSTEM_NAMES[NUM_MEMORY_SUBSYSTEMS] = {
+	"ECS",
+	"Resources",
+	"Console",
+	"glTF load",
+	"Rendering"
+};
+
+// Config keys (in the "Memory" section) of the budget of each subsystem in MiB, 0 means none
+constexpr const char* MEMORY_BUDGET_SETTINGS[NUM_MEMORY_SUBSYSTEMS] = {
+	"budgetMiBEcs",
+	"budgetMiBResources",
+	"budgetMiBConsole",
+	"budgetMiBGltfLoad",
+	"budgetMiBRendering"
+};
+
+// Profiler
+// ------------------------------------------------------------------------------------------------
+
+// Where the "Profiler" console window dumps Chrome traces
+constexpr const char* PROFILER_TRACE_PATH = "profiler_trace.json";
+
+// Benchmark
 // ------------------------------------------------------------------------------------------------
 
-constexpr uint32_t RENDER_ENTITY_TYPE = 1u << 0u;
-constexpr uint32_t SPHERE_LIGHT_TYPE = 1u << 1u;
+constexpr uint32_t BENCHMARK_DEFAULT_NUM_FRAMES = 1000;
+constexpr const char* BENCHMARK_DEFAULT_OUTPUT_PATH = "benchmark.csv";
+constexpr float BENCHMARK_DELTA_SECS = 1.0f / 60.0f;
+
+// Frames rendered before recording starts, so that caches and allocations have settled
+constexpr uint32_t BENCHMARK_NUM_WARMUP_FRAMES = 30;
+
+constexpr uint32_t TRANSFORM_BENCHMARK_DEFAULT_SIZE = 10000;
 
 // PhantasyTestbedState
 // ------------------------------------------------------------------------------------------------
 
 struct PhantasyTestbedState final {
+	// Set if started with "--cook", then the scene package is cooked and nothing else is done
+	const char* mCookGltfPath = nullptr;
+	const char* mCookPackagePath = nullptr;
+	char mCookPackagePathBuffer[320] = {}; // Package path derived from the gltf path
+
+	// Set if started with "--bench-transforms", then the transform kernels are benchmarked with
+	// this many transforms and nothing else is done
+	uint32_t mTransformBenchmarkSize = 0;
+
+	// Set if started with "--benchmark", then the camera follows a path with a fixed time step
+	// without any input or UI, and the CPU timings of each frame are written to a file
+	bool mBenchmark = false;
+	uint32_t mBenchmarkNumFrames = BENCHMARK_DEFAULT_NUM_FRAMES;
+	const char* mBenchmarkOutputPath = BENCHMARK_DEFAULT_OUTPUT_PATH;
+	const char* mBenchmarkCameraPathFile = nullptr; // Default path if nullptr
+	uint32_t mBenchmarkFrameIdx = 0; // Including warmup frames
+	CameraPath mBenchmarkCameraPath; // Empty if it failed to load
+	BenchmarkRecorder mBenchmarkRecorder;
+	bool mBenchmarkPrevVsync = true;
+	bool mBenchmarkPrevConsoleActive = false;
+
+	// Persistent allocations go through mAllocator, which counts how many calls each frame makes
+	// to the default allocator (should be 0 once loaded). Each subsystem allocates through its own
+	// TrackingAllocator (wrapping mAllocator) so that its usage can be reported and checked
+	// against its budget. Data only needed for the current frame (light lists, render list, draw
+	// lists) is allocated from mFrameArena instead.
+	CountingAllocator mAllocator;
+	TrackingAllocator mMemory[NUM_MEMORY_SUBSYSTEMS];
+	Setting* mMemoryBudgetsMiB[NUM_MEMORY_SUBSYSTEMS] = {};
+	bool mMemoryOverBudget[NUM_MEMORY_SUBSYSTEMS] = {};
+	sfz::Array<AllocationTagStats> mMemoryTags; // Temp storage
+	FrameArena mFrameArena;
+
 	// Gameloop stuff
 	sfz::Console console;
 	sfz::FixedTimeStepper fixedTimeStepper;
 
 	CameraData mCam;
 	StaticScene mStaticScene;
+	MeshRegistry mMeshes;
+	strID mFullscreenTriangleId;
+	ResolvedMesh mFullscreenTriangle;
+
+	// Streaming of the level, placeholders are bound in place of textures not yet resident
+	GltfStreamer mLevelStreamer;
+	PlaceholderTextures mPlaceholderTextures;
+	Setting* mStreamingUploadBudgetMiB = nullptr;
+
+	// Render list and per-pass draw lists, allocated from mFrameArena each frame
+	FrameRenderList mFrameRenderList;
+	PassStats mPassStats[NUM_GEOMETRY_PASSES];
+	sfz::Array<DrawItem> mPassDrawItems[NUM_GEOMETRY_PASSES];
+	sfz::Array<DrawMatrices> mPassDrawMatrices[NUM_GEOMETRY_PASSES];
+	sfz::Array<uint32_t> mPassInstances[NUM_GEOMETRY_PASSES]; // Indices into DrawMatrices
+	sfz::Array<uint32_t> mPassVisibleItems[NUM_GEOMETRY_PASSES]; // Temp storage
+	sfz::Array<uint32_t> mPassVisibleModels[NUM_GEOMETRY_PASSES]; // Temp storage
+	sfz::Array<InstanceLod> mPassInstanceLods[NUM_GEOMETRY_PASSES]; // Temp storage
+	sfz::Array<uint32_t> mPassStaticQueries[NUM_GEOMETRY_PASSES]; // Temp storage
+	sfz::Array<uint32_t> mPassStaticItemMatrices[NUM_GEOMETRY_PASSES]; // Temp storage
+	ShadowCascadeCache mShadowCascadeCaches[NUM_GEOMETRY_PASSES - 1];
+	Setting* mCacheShadowCascades = nullptr;
+
+	// Large occluders are rasterized into mOcclusionBuffer each frame, components hidden behind
+	// them are skipped in the GBuffer pass
+	OcclusionBuffer mOcclusionBuffer;
+	Setting* mOcclusionCulling = nullptr;
+	OcclusionStats mOcclusionStats;
+
+	// Adjusts "Renderer.internalResolutionScale" to hold the target frame time, if enabled
+	DynamicResolution mDynamicResolution;
+	Setting* mDynamicResolutionEnabled = nullptr;
+	Setting* mDynamicResolutionTargetMs = nullptr;
+	Setting* mDynamicResolutionMinScale = nullptr;
+	Setting* mDynamicResolutionMaxScale = nullptr;
+	Setting* mDynamicResolutionMinResizeFrames = nullptr;
+	bool mDynamicResolutionActive = false; // If the controller owned the scale last frame
+	float mDynamicResolutionUserScale = 1.0f; // Restored when the controller lets go of the scale
+
+	// BVH over the world space bounds of the static scene's components, indexed the same as the
+	// first FrameRenderList::numStaticComponents componentBounds. Rebuilt when meshes change.
+	Bvh mStaticBvh;
+	sfz::Array<StaticComponentRef> mStaticComponentRefs; // Of each component in mStaticBvh
+	uint32_t mStaticBvhGeneration = ~0u; // MeshRegistry generation it was built for
+	float mStaticBvhBuildMs = 0.0f;
+
+	// Point lights, kept in sync with the scene by mLightList. The visible lights are only split
+	// into batches again when the camera or a light changed, and each batch is only uploaded when
+	// its contents changed (once per streaming buffer copy).
+	LightList mLightList;
+	uint32_t mNumStaticLightsSynced = ~0u; // Static scene lights (first in mLightList) set
+	sfz::Array<sfz::ForwardShaderPointLightsBuffer> mPointLightBatches;
+	sfz::Array<uint32_t> mPointLightBatchUploads; // Uploads left until all buffer copies match
+	uint32_t mNumPointLightsBuffers = 0;
+	LightStats mLightStats;
+
+	WorkerPool mWorkerPool;
+	Setting* mParallelRecording = nullptr;
+
+	// Max projected error (in pixels / shadow map texels) of the LODs selected, 0 disables LODs
+	Setting* mLodBiasCamera = nullptr;
+	Setting* mLodBiasShadows = nullptr;
 
 	sfz::RawInputState prevInput = {};
 
 	Setting* mShowImguiDemo = nullptr;
-	sfz::GameStateContainer mGameStateContainer;
-	sfz::GameStateEditor mGameStateEditor;
+
+	// Profiler console window
+	Setting* mProfilerEnabled = nullptr;
+	int32_t mProfilerDumpNumFrames = 60;
+	sfz::Array<ProfilerEvent> mProfilerEvents; // Temp storage
+
+	// Entities and their components, stored densely per component type
+	EntityStore mEntities;
+	TransformHierarchy mTransforms;
+	uint32_t mNumTransformsUpdated = 0; // World matrices recomputed this frame
+	ComponentArray<RenderEntity> mRenderEntities;
+	ComponentArray<phSphereLight> mSphereLights;
+	int32_t mEditorSelectedEntity = 0;
+	int32_t mEditorPickedStaticComponent = -1; // Static component under the mouse when clicked
+	BoundingBox mEditorPickedStaticBounds;
 };
 
 // Helper functions
 // ------------------------------------------------------------------------------------------------
 
+static sfz::Allocator* memory(PhantasyTestbedState& state, MemorySubsystem subsystem) noexcept
+{
+	return &state.mMemory[uint32_t(subsystem)];
+}
+
 static void setDir(CameraData& cam, vec3 direction, vec3 up) noexcept
 {
 	cam.dir = normalize(direction);
@@ -125,141 +514,598 @@ static void setDir(CameraData& cam, vec3 direction, vec3 up) noexcept
 	//sfz_assert_debug(approxEqual(dot(mCam.dir, mCam.up), 0.0f));
 }
 
-// Game loop functions
-// ------------------------------------------------------------------------------------------------
+static GltfLoadOptions gltfLoadOptionsFromConfig() noexcept
+{
+	GlobalConfig& cfg = sfz::getGlobalConfig();
+	GltfLoadOptions options;
+	options.blockCompressTextures =
+		cfg.sanitizeBool("PhantasyTestbed", "blockCompressTextures", true, false)->boolValue();
+	options.optimizeMesh =
+		cfg.sanitizeBool("PhantasyTestbed", "optimizeMeshes", true, true)->boolValue();
+	options.generateLods =
+		cfg.sanitizeBool("PhantasyTestbed", "generateMeshLods", true, true)->boolValue();
+	options.packVertices =
+		cfg.sanitizeBool("PhantasyTestbed", "packVertices", true, false)->boolValue();
+	return options;
+}
 
-static void onInit(void* userPtr)
+static void addStaticRenderEntity(PhantasyTestbedState& state, strID meshId) noexcept
 {
-	PhantasyTestbedState& state = *static_cast<PhantasyTestbedState*>(userPtr);
-	sfz::Renderer& renderer = sfz::getRenderer();
+	RenderEntity entity;
+	entity.meshId = meshId;
+	entity.mesh = state.mMeshes.resolve(meshId);
+	state.mStaticScene.renderEntities.add(entity);
+	state.mStaticScene.modelMatrices.add(Transform().matrix());
+}
 
-	// Initialize console
-	constexpr const char* windows[1] = {
-		"Game State Editor"
-	};
-	state.console.init(getDefaultAllocator(), 1, windows);
+static void deleteEntity(PhantasyTestbedState& state, EntityHandle entity) noexcept
+{
+	if (!state.mEntities.isAlive(entity)) return;
+	state.mTransforms.remove(entity.idx);
+	state.mRenderEntities.remove(entity.idx);
+	state.mSphereLights.remove(entity.idx);
+	state.mEntities.deleteEntity(entity);
+}
 
-	// Load renderer config
-	bool rendererLoadConfigSuccess =
-		renderer.loadConfiguration("res_ph/shaders/default_renderer_config.json");
-	sfz_assert(rendererLoadConfigSuccess);
+// Stores the benchmark timings of the current frame (unless it is a warmup frame). Returns false
+// once all frames are recorded, after writing the results.
+static bool finishBenchmarkFrame(PhantasyTestbedState& state) noexcept
+{
+	BenchmarkRecorder& recorder = state.mBenchmarkRecorder;
+	if (state.mBenchmarkFrameIdx >= BENCHMARK_NUM_WARMUP_FRAMES) recorder.endFrame();
+	state.mBenchmarkFrameIdx += 1;
+	if (!recorder.isDone()) return true;
+
+	recorder.logSummary();
+	if (recorder.writeResults(state.mBenchmarkOutputPath)) {
+		SFZ_INFO("PhantasyTestbed", "Wrote benchmark results to \"%s\"",
+			state.mBenchmarkOutputPath);
+	}
+	return false;
+}
 
-	// Create fullscreen triangle
-	sfz::Mesh fullscreenTriangle = sfz::createFullscreenTriangle(getDefaultAllocator());
-	renderer.uploadMeshBlocking(strID("FullscreenTriangle"), fullscreenTriangle);
+// Entity editor
+// ------------------------------------------------------------------------------------------------
 
-	// Create game state
-	const uint32_t NUM_SINGLETONS = 1;
-	const uint32_t SINGLETON_SIZES[NUM_SINGLETONS] = {
-		sizeof(RenderEntity)
-	};
-	const uint32_t MAX_NUM_ENTITIES = 100;
-	const uint32_t NUM_COMPONENT_TYPES = 2;
-	const uint32_t COMPONENT_SIZES[NUM_COMPONENT_TYPES] = {
-		sizeof(RenderEntity),
-		sizeof(phSphereLight)
-	};
-	state.mGameStateContainer = sfz::GameStateContainer::create(
-		NUM_SINGLETONS, SINGLETON_SIZES, MAX_NUM_ENTITIES, NUM_COMPONENT_TYPES, COMPONENT_SIZES, sfz::getDefaultAllocator());
+// Returns whether the transform was modified
+static bool transformEditor(Transform& transform) noexcept
+{
+	bool modified = false;
+	modified |= ImGui::InputFloat3("Scale", transform.scale.data());
+	modified |= ImGui::InputFloat3("Translation", transform.translation.data());
+	if (ImGui::InputFloat4("Rotation quaternion", transform.rotation.vector.data())) {
+		transform.rotation = normalize(transform.rotation);
+		modified = true;
+	}
+	vec3 eulerRot = transform.rotation.toEuler();
+	if (ImGui::InputFloat3("Rotation euler", eulerRot.data())) {
+		transform.rotation = quat::fromEuler(eulerRot);
+		transform.rotation = normalize(transform.rotation);
+		modified = true;
+	}
+	return modified;
+}
 
-	// Init ECS viewer
-	SingletonInfo singletonInfos[NUM_SINGLETONS];
+static void sphereLightEditor(phSphereLight& sphereLight) noexcept
+{
+	ImGui::InputFloat3("Position", sphereLight.pos.data());
+	ImGui::InputFloat("Radius", &sphereLight.radius);
+	ImGui::InputFloat("Range", &sphereLight.range);
+	ImGui::InputFloat("Strength", &sphereLight.strength);
+	vec3 color = vec3(sphereLight.color) * (1.0f / 255.0f);
+	if (ImGui::ColorEdit3("Color", color.data())) {
+		color *= 255.0f;
+		color += vec3(0.5f); // To round properly
+		sphereLight.color = vec3_u8(uint8_t(color.x), uint8_t(color.y), uint8_t(color.z));
+	}
+}
 
-	singletonInfos[0].singletonIndex = 0;
-	singletonInfos[0].singletonName.appendf("phRenderEntity");
-	singletonInfos[0].singletonEditor =
-		[](uint8_t* userPtr, uint8_t* singletonData, GameStateHeader* state) {
+// Selects the dynamic entity whose bounds are hit first by a ray through the mouse position. If
+// there is none the static component hit first is shown instead, found through the static BVH.
+static void pickEntity(PhantasyTestbedState& state, vec2 mousePos, vec2 windowRes) noexcept
+{
+	const CameraData& cam = state.mCam;
+	const vec3 right = normalize(cross(cam.dir, cam.up));
+	const vec3 up = cross(right, cam.dir);
+	const float tanHalfFov = std::tan(cam.vertFovDeg * (PI / 180.0f) * 0.5f);
+	const float aspect = windowRes.x / windowRes.y;
+	const float ndcX = 2.0f * mousePos.x / windowRes.x - 1.0f;
+	const float ndcY = 1.0f - 2.0f * mousePos.y / windowRes.y;
+	const vec3 dir = normalize(
+		cam.dir + right * (ndcX * tanHalfFov * aspect) + up * (ndcY * tanHalfFov));
+	vec3 invDir;
+	for (uint32_t i = 0; i < 3; i++) invDir[i] = dir[i] != 0.0f ? 1.0f / dir[i] : FLT_MAX;
+
+	// Dynamic entities
+	uint32_t closestEntity = ~0u;
+	float closestDist = cam.far;
+	const uint32_t* entityIndices = state.mRenderEntities.entities();
+	for (uint32_t i = 0; i < state.mRenderEntities.size(); i++) {
+		const RenderEntity& entity = state.mRenderEntities.data()[i];
+		if (entity.mesh.info == nullptr) continue;
+		const BoundingBox bounds = transformBoundingBox(
+			state.mTransforms.world(entityIndices[i]), entity.mesh.info->bounds);
+		float dist = 0.0f;
+		if (intersectsRay(bounds, cam.pos, invDir, closestDist, dist)) {
+			closestEntity = entityIndices[i];
+			closestDist = dist;
+		}
+	}
+	if (closestEntity != ~0u) {
+		state.mEditorSelectedEntity = int32_t(closestEntity);
+		state.mEditorPickedStaticComponent = -1;
+		return;
+	}
+
+	// Static scene
+	const uint32_t staticComponent = state.mStaticBvh.raycast(cam.pos, dir, cam.far);
+	if (staticComponent == ~0u) {
+		state.mEditorPickedStaticComponent = -1;
+		return;
+	}
+	state.mEditorPickedStaticComponent = int32_t(staticComponent);
+	state.mEditorPickedStaticBounds = state.mFrameRenderList.componentBounds[staticComponent];
+}
 
-		(void)userPtr;
-		(void)state;
-		RenderEntity& renderEntity = *reinterpret_cast<RenderEntity*>(singletonData);
+static void renderEntityEditorWindow(PhantasyTestbedState& state) noexcept
+{
+	ImGui::Begin("Entity Editor", nullptr, ImGuiWindowFlags_NoFocusOnAppearing);
+
+	ImGui::Text("Alive entities: %u", state.mEntities.numAlive());
+	ImGui::Text("Transform components: %u", state.mTransforms.size());
+	ImGui::Text("phRenderEntity components: %u", state.mRenderEntities.size());
+	ImGui::Text("phSphereLight components: %u", state.mSphereLights.size());
+	if (state.mEditorPickedStaticComponent >= 0) {
+		const BoundingBox& bounds = state.mEditorPickedStaticBounds;
+		ImGui::Text("Picked static component: %i", state.mEditorPickedStaticComponent);
+		ImGui::Text("  Min: %.2f, %.2f, %.2f", bounds.min.x, bounds.min.y, bounds.min.z);
+		ImGui::Text("  Max: %.2f, %.2f, %.2f", bounds.max.x, bounds.max.y, bounds.max.z);
+	}
+	ImGui::Separator();
+
+	ImGui::InputInt("Entity", &state.mEditorSelectedEntity);
+	state.mEditorSelectedEntity = sfz::clamp(
+		state.mEditorSelectedEntity, 0, sfz::max(int32_t(state.mEntities.numIndices()) - 1, 0));
+	const EntityHandle entity = state.mEntities.handleOf(uint32_t(state.mEditorSelectedEntity));
+	if (entity == NULL_ENTITY) {
+		ImGui::Text("Not alive");
+		ImGui::End();
+		return;
+	}
 
-		ImGui::InputFloat3("Scale", renderEntity.scale.data());
-		ImGui::InputFloat3("Translation", renderEntity.translation.data());
-		if (ImGui::InputFloat4("Rotation quaternion", renderEntity.rotation.vector.data())) {
-			renderEntity.rotation = normalize(renderEntity.rotation);
+	if (const Transform* transform = state.mTransforms.get(entity.idx)) {
+		if (ImGui::CollapsingHeader("Transform")) {
+			Transform edited = *transform;
+			if (transformEditor(edited)) *state.mTransforms.edit(entity.idx) = edited;
+			int32_t parent = int32_t(state.mTransforms.parent(entity.idx));
+			if (ImGui::InputInt("Parent (-1 for none)", &parent)) {
+				state.mTransforms.setParent(entity.idx, parent < 0 ? ~0u : uint32_t(parent));
+			}
 		}
-		vec3 eulerRot = renderEntity.rotation.toEuler();
-		if (ImGui::InputFloat3("Rotation euler", eulerRot.data())) {
-			renderEntity.rotation = quat::fromEuler(eulerRot);
-			renderEntity.rotation = normalize(renderEntity.rotation);
+	}
+	if (RenderEntity* renderEntity = state.mRenderEntities.get(entity.idx)) {
+		if (ImGui::CollapsingHeader("phRenderEntity")) {
+			ImGui::Text("Mesh: %s", renderEntity->meshId.str());
 		}
-	};
+	}
+	if (phSphereLight* sphereLight = state.mSphereLights.get(entity.idx)) {
+		if (ImGui::CollapsingHeader("phSphereLight")) sphereLightEditor(*sphereLight);
+	}
+	if (ImGui::Button("Delete entity")) {
+		deleteEntity(state, entity);
+	}
+
+	ImGui::End();
+}
 
-	ComponentInfo componentInfos[NUM_COMPONENT_TYPES];
+// Memory window
+// ------------------------------------------------------------------------------------------------
 
-	componentInfos[0].componentType = RENDER_ENTITY_TYPE;
-	componentInfos[0].componentName.appendf("phRenderEntity");
-	componentInfos[0].componentEditor =
-		[](uint8_t* editorState, uint8_t* componentData, GameStateHeader* state, uint32_t entity) {
+static float toMiB(uint64_t bytes) noexcept
+{
+	return float(double(bytes) / (1024.0 * 1024.0));
+}
 
-		(void)editorState;
-		(void)state;
-		(void)entity;
-		RenderEntity& renderEntity = *reinterpret_cast<RenderEntity*>(componentData);
+// The sfz_dbg() message of an allocation site, or its file and line if there is none.
+static const char* allocationSiteName(
+	const AllocationTagStats& site, char* buffer, uint32_t bufferSize) noexcept
+{
+	if (site.tag != nullptr && site.tag[0] != '\0') return site.tag;
+	const char* file = site.file != nullptr ? site.file : "<unknown>";
+	const char* fileName = file;
+	for (const char* c = file; *c != '\0'; c++) {
+		if (*c == '/' || *c == '\\') fileName = c + 1;
+	}
+	snprintf(buffer, bufferSize, "%s:%u", fileName, site.line);
+	return buffer;
+}
 
-		ImGui::InputFloat3("Scale", renderEntity.scale.data());
-		ImGui::InputFloat3("Translation", renderEntity.translation.data());
-		if (ImGui::InputFloat4("Rotation quaternion", renderEntity.rotation.vector.data())) {
-			renderEntity.rotation = normalize(renderEntity.rotation);
+// Warns once each time a subsystem goes over its budget.
+static void checkMemoryBudgets(PhantasyTestbedState& state) noexcept
+{
+	for (uint32_t i = 0; i < NUM_MEMORY_SUBSYSTEMS; i++) {
+		const uint64_t budgetBytes = uint64_t(state.mMemoryBudgetsMiB[i]->intValue()) << 20;
+		const AllocationTagStats total = state.mMemory[i].snapshot(nullptr);
+		const bool overBudget = budgetBytes != 0 && total.liveBytes > budgetBytes;
+		if (overBudget && !state.mMemoryOverBudget[i]) {
+			SFZ_WARNING("PhantasyTestbed", "%s is over its memory budget: %.2f / %.2f MiB",
+				MEMORY_SUBSYSTEM_NAMES[i], toMiB(total.liveBytes), toMiB(budgetBytes));
 		}
-		vec3 eulerRot = renderEntity.rotation.toEuler();
-		if (ImGui::InputFloat3("Rotation euler", eulerRot.data())) {
-			renderEntity.rotation = quat::fromEuler(eulerRot);
-			renderEntity.rotation = normalize(renderEntity.rotation);
+		state.mMemoryOverBudget[i] = overBudget;
+	}
+}
+
+static void logMemoryReport(PhantasyTestbedState& state) noexcept
+{
+	char nameBuffer[128];
+	SFZ_INFO("PhantasyTestbed", "%s", "Memory report (live MiB / peak MiB / live allocs / total "
+		"allocs):");
+	for (uint32_t i = 0; i < NUM_MEMORY_SUBSYSTEMS; i++) {
+		state.mMemoryTags.clear();
+		const AllocationTagStats total = state.mMemory[i].snapshot(&state.mMemoryTags);
+		const int32_t budgetMiB = state.mMemoryBudgetsMiB[i]->intValue();
+		SFZ_INFO("PhantasyTestbed", "%s: %.2f / %.2f / %u / %llu (budget: %d MiB)",
+			MEMORY_SUBSYSTEM_NAMES[i], toMiB(total.liveBytes), toMiB(total.peakBytes),
+			total.numLiveAllocations, (unsigned long long)total.numAllocations, budgetMiB);
+		for (const AllocationTagStats& site : state.mMemoryTags) {
+			SFZ_INFO("PhantasyTestbed", "  %-48s %.3f / %.3f / %u / %llu",
+				allocationSiteName(site, nameBuffer, sizeof(nameBuffer)), toMiB(site.liveBytes),
+				toMiB(site.peakBytes), site.numLiveAllocations,
+				(unsigned long long)site.numAllocations);
+		}
+	}
+}
+
+static void renderMemoryWindow(PhantasyTestbedState& state) noexcept
+{
+	ImGui::Begin("Memory", nullptr, ImGuiWindowFlags_NoFocusOnAppearing);
+
+	if (ImGui::Button("Dump memory report")) logMemoryReport(state);
+	ImGui::SameLine();
+	ImGui::Text("(to the log)");
+	ImGui::Separator();
+
+	// One row per subsystem, expandable into one row per allocation site
+	const ImVec4 overBudgetColor = ImVec4(1.0f, 0.3f, 0.3f, 1.0f);
+	char nameBuffer[128];
+	ImGui::Columns(6, "MemoryTable");
+	ImGui::Text("Subsystem"); ImGui::NextColumn();
+	ImGui::Text("Live MiB"); ImGui::NextColumn();
+	ImGui::Text("Peak MiB"); ImGui::NextColumn();
+	ImGui::Text("Budget MiB"); ImGui::NextColumn();
+	ImGui::Text("Live allocs"); ImGui::NextColumn();
+	ImGui::Text("Total allocs"); ImGui::NextColumn();
+	ImGui::Separator();
+	for (uint32_t i = 0; i < NUM_MEMORY_SUBSYSTEMS; i++) {
+		state.mMemoryTags.clear();
+		const AllocationTagStats total = state.mMemory[i].snapshot(&state.mMemoryTags);
+		const int32_t budgetMiB = state.mMemoryBudgetsMiB[i]->intValue();
+
+		const bool open = ImGui::TreeNode(MEMORY_SUBSYSTEM_NAMES[i]); ImGui::NextColumn();
+		if (state.mMemoryOverBudget[i]) {
+			ImGui::TextColored(overBudgetColor, "%.2f", toMiB(total.liveBytes));
+		}
+		else {
+			ImGui::Text("%.2f", toMiB(total.liveBytes));
+		}
+		ImGui::NextColumn();
+		ImGui::Text("%.2f", toMiB(total.peakBytes)); ImGui::NextColumn();
+		if (budgetMiB != 0) ImGui::Text("%d", budgetMiB);
+		else ImGui::Text("-");
+		ImGui::NextColumn();
+		ImGui::Text("%u", total.numLiveAllocations); ImGui::NextColumn();
+		ImGui::Text("%llu", (unsigned long long)total.numAllocations); ImGui::NextColumn();
+		if (!open) continue;
+
+		for (const AllocationTagStats& site : state.mMemoryTags) {
+			ImGui::Text("%s", allocationSiteName(site, nameBuffer, sizeof(nameBuffer)));
+			ImGui::NextColumn();
+			ImGui::Text("%.3f", toMiB(site.liveBytes)); ImGui::NextColumn();
+			ImGui::Text("%.3f", toMiB(site.peakBytes)); ImGui::NextColumn();
+			ImGui::NextColumn();
+			ImGui::Text("%u", site.numLiveAllocations); ImGui::NextColumn();
+			ImGui::Text("%llu", (unsigned long long)site.numAllocations); ImGui::NextColumn();
 		}
+		ImGui::TreePop();
+	}
+	ImGui::Columns(1);
+
+	ImGui::End();
+}
+
+// Profiler window
+// ------------------------------------------------------------------------------------------------
+
+static ImU32 profilerEventColor(const char* name) noexcept
+{
+	constexpr uint32_t NUM_COLORS = 6;
+	constexpr ImU32 COLORS[NUM_COLORS] = {
+		IM_COL32(86, 156, 214, 255),
+		IM_COL32(78, 201, 176, 255),
+		IM_COL32(220, 170, 90, 255),
+		IM_COL32(197, 134, 192, 255),
+		IM_COL32(181, 206, 168, 255),
+		IM_COL32(214, 120, 110, 255)
 	};
+	return COLORS[(uintptr_t(name) >> 3) % NUM_COLORS];
+}
 
-	componentInfos[1].componentType = SPHERE_LIGHT_TYPE;
-	componentInfos[1].componentName.appendf("phSphereLight");
-	componentInfos[1].componentEditor =
-		[](uint8_t* editorState, uint8_t* componentData, GameStateHeader* state, uint32_t entity) {
-
-		(void)editorState;
-		(void)state;
-		(void)entity;
-		phSphereLight& sphereLight = *reinterpret_cast<phSphereLight*>(componentData);
-
-		ImGui::InputFloat3("Position", sphereLight.pos.data());
-		ImGui::InputFloat("Radius", &sphereLight.radius);
-		ImGui::InputFloat("Range", &sphereLight.range);
-		ImGui::InputFloat("Strength", &sphereLight.strength);
-		vec3 color = vec3(sphereLight.color) * (1.0f / 255.0f);
-		if (ImGui::ColorEdit3("Color", color.data())) {
-			color *= 255.0f;
-			color += vec3(0.5f); // To round properly
-			sphereLight.color = vec3_u8(uint8_t(color.x), uint8_t(color.y), uint8_t(color.z));
+static void renderProfilerWindow(PhantasyTestbedState& state) noexcept
+{
+	Profiler& profiler = getProfiler();
+	ImGui::Begin("Profiler", nullptr, ImGuiWindowFlags_NoFocusOnAppearing);
+
+	bool enabled = state.mProfilerEnabled->boolValue();
+	if (ImGui::Checkbox("Enabled", &enabled)) state.mProfilerEnabled->setBool(enabled);
+
+	// Dump the last frames as a Chrome trace
+	ImGui::InputInt("Frames to dump", &state.mProfilerDumpNumFrames);
+	state.mProfilerDumpNumFrames =
+		sfz::clamp(state.mProfilerDumpNumFrames, 1, int32_t(PROFILER_MAX_NUM_FRAMES - 1));
+	if (ImGui::Button("Dump Chrome trace")) {
+		const uint32_t numFrames = uint32_t(state.mProfilerDumpNumFrames);
+		if (profiler.writeChromeTrace(PROFILER_TRACE_PATH, numFrames)) {
+			SFZ_INFO("PhantasyTestbed", "Wrote profiler trace to \"%s\"", PROFILER_TRACE_PATH);
+		}
+	}
+	ImGui::SameLine();
+	ImGui::Text("(%s)", PROFILER_TRACE_PATH);
+	ImGui::Separator();
+
+	// Flame view of the last complete frame, one block of rows (one row per depth) per thread
+	if (profiler.numFrames() < 2) {
+		ImGui::Text("No complete frames");
+		ImGui::End();
+		return;
+	}
+	const uint64_t frameIdx = profiler.numFrames() - 2;
+	const uint64_t frameBeginNs = profiler.frameBeginNs(frameIdx);
+	const uint64_t frameEndNs = profiler.frameEndNs(frameIdx);
+	const double frameNs = double(frameEndNs - frameBeginNs);
+	ImGui::Text("Frame %llu: %.2f ms", (unsigned long long)frameIdx, frameNs * 1e-6);
+
+	constexpr float ROW_HEIGHT = 18.0f;
+	const float width = sfz::max(ImGui::GetContentRegionAvail().x, 100.0f);
+	ImDrawList* drawList = ImGui::GetWindowDrawList();
+	const ImVec2 mousePos = ImGui::GetIO().MousePos;
+	sfz::Array<ProfilerEvent>& events = state.mProfilerEvents;
+	for (uint32_t threadIdx = 0; threadIdx < profiler.numThreads(); threadIdx++) {
+		events.clear();
+		profiler.copyEvents(threadIdx, frameBeginNs, frameEndNs, events);
+		if (events.isEmpty()) continue;
+		uint32_t maxDepth = 0;
+		for (const ProfilerEvent& event : events) maxDepth = sfz::max(maxDepth, event.depth);
+
+		ImGui::Text("%s", profiler.threadName(threadIdx));
+		const ImVec2 origin = ImGui::GetCursorScreenPos();
+		const float height = float(maxDepth + 1) * ROW_HEIGHT;
+		auto toX = [&](uint64_t ns) {
+			const double t = (double(ns) - double(frameBeginNs)) / frameNs;
+			return origin.x + width * sfz::clamp(float(t), 0.0f, 1.0f);
+		};
+		for (const ProfilerEvent& event : events) {
+			const float minY = origin.y + float(event.depth) * ROW_HEIGHT;
+			const float maxX = toX(event.beginNs + event.durationNs);
+			const ImVec2 min = ImVec2(toX(event.beginNs), minY);
+			const ImVec2 max = ImVec2(sfz::max(maxX, min.x + 1.0f), minY + ROW_HEIGHT - 1.0f);
+			drawList->AddRectFilled(min, max, profilerEventColor(event.name));
+			if ((max.x - min.x) > 30.0f) {
+				drawList->PushClipRect(min, max, true);
+				drawList->AddText(ImVec2(min.x + 2.0f, min.y + 2.0f),
+					IM_COL32(0, 0, 0, 255), event.name);
+				drawList->PopClipRect();
+			}
+			if (mousePos.x >= min.x && mousePos.x < max.x &&
+				mousePos.y >= min.y && mousePos.y < max.y) {
+				ImGui::SetTooltip("%s: %.3f ms", event.name, double(event.durationNs) * 1e-6);
+			}
 		}
+		ImGui::Dummy(ImVec2(width, height));
+	}
+
+	ImGui::End();
+}
+
+// Game loop functions
+// ------------------------------------------------------------------------------------------------
+
+static void onInit(void* userPtr)
+{
+	PhantasyTestbedState& state = *static_cast<PhantasyTestbedState*>(userPtr);
+	sfz::Renderer& renderer = sfz::getRenderer();
+
+	// Cook scene package instead of running the testbed if requested
+	if (state.mCookGltfPath != nullptr) {
+		WorkerPool decodePool;
+		decodePool.init(std::thread::hardware_concurrency(), getDefaultAllocator());
+		cookScenePackage(state.mCookGltfPath, state.mCookPackagePath, decodePool,
+			gltfLoadOptionsFromConfig(), getDefaultAllocator());
+		return;
+	}
+
+	// Same for the transform kernel microbenchmark
+	if (state.mTransformBenchmarkSize != 0) {
+		benchmarkTransformKernels(state.mTransformBenchmarkSize, getDefaultAllocator());
+		return;
+	}
+
+	// Initialize profiler, recording is toggled from the "Profiler" console window
+	getProfiler().init(getDefaultAllocator());
+
+	// Initialize allocators
+	GlobalConfig& cfg = sfz::getGlobalConfig();
+	state.mAllocator.init(getDefaultAllocator());
+	for (uint32_t i = 0; i < NUM_MEMORY_SUBSYSTEMS; i++) {
+		state.mMemory[i].init(MEMORY_SUBSYSTEM_NAMES[i], &state.mAllocator);
+		state.mMemoryBudgetsMiB[i] =
+			cfg.sanitizeInt("Memory", MEMORY_BUDGET_SETTINGS[i], true, 0, 0, 65536);
+	}
+	state.mMemoryTags.init(64, &state.mAllocator, sfz_dbg(""));
+	state.mFrameArena.init(
+		FRAME_ARENA_BYTES_PER_FRAME, memory(state, MemorySubsystem::RENDERING));
+
+	// Initialize console
+	constexpr uint32_t NUM_WINDOWS = 4;
+	constexpr const char* windows[NUM_WINDOWS] = {
+		"Entity Editor",
+		"Render Stats",
+		"Memory",
+		"Profiler"
 	};
+	state.console.init(memory(state, MemorySubsystem::CONSOLE), NUM_WINDOWS, windows);
 
-	state.mGameStateEditor.init(
-		"Game State Editor", singletonInfos, NUM_SINGLETONS, componentInfos, NUM_COMPONENT_TYPES, sfz::getDefaultAllocator());
+	// Load renderer config
+	bool rendererLoadConfigSuccess =
+		renderer.loadConfiguration("res_ph/shaders/default_renderer_config.json");
+	sfz_assert(rendererLoadConfigSuccess);
+
+	// Initialize mesh registry, the per-frame render and draw lists are created each frame
+	sfz::Allocator* resourceAllocator = memory(state, MemorySubsystem::RESOURCES);
+	state.mMeshes.init(64, resourceAllocator);
+	state.mProfilerEvents.init(
+		PROFILER_RING_SIZE, memory(state, MemorySubsystem::CONSOLE), sfz_dbg(""));
+
+	// Create fullscreen triangle
+	sfz::Mesh fullscreenTriangle = sfz::createFullscreenTriangle(resourceAllocator);
+	state.mFullscreenTriangleId = strID("FullscreenTriangle");
+	state.mMeshes.uploadMeshBlocking(state.mFullscreenTriangleId, fullscreenTriangle);
+	state.mFullscreenTriangle = state.mMeshes.resolve(state.mFullscreenTriangleId);
+
+	// Create entity storage, grows as needed
+	sfz::Allocator* ecsAllocator = memory(state, MemorySubsystem::ECS);
+	state.mEntities.init(128, ecsAllocator);
+	state.mTransforms.init(128, ecsAllocator);
+	state.mRenderEntities.init(128, ecsAllocator);
+	state.mSphereLights.init(128, ecsAllocator);
 
 	// Load cube mesh
 	strID cubeMeshId = strID("virtual/cube");
-	sfz::Mesh cubeMesh = createCubeMesh(getDefaultAllocator());
-	renderer.uploadMeshBlocking(cubeMeshId, cubeMesh);
+	sfz::Mesh cubeMesh = createCubeMesh(resourceAllocator);
+	state.mMeshes.uploadMeshBlocking(cubeMeshId, cubeMesh);
+
+	// Load sponza level, either from its cooked scene package (if available), streamed in over the
+	// first frames or blocking before the first frame. Benchmarks never stream, the frames must not
+	// depend on how fast the level happens to load.
+	Setting* useScenePackageSetting =
+		cfg.sanitizeBool("PhantasyTestbed", "useScenePackage", true, true);
+	const GltfLoadOptions loadOptions = gltfLoadOptionsFromConfig();
+	Setting* streamingLoadSetting =
+		cfg.sanitizeBool("PhantasyTestbed", "streamingLoad", true, true);
+	state.mStreamingUploadBudgetMiB =
+		cfg.sanitizeInt("PhantasyTestbed", "streamingUploadBudgetMiB", true, 32, 1, 1024);
+	StaticScene& staticScene = state.mStaticScene;
+	staticScene.renderEntities.init(0, ecsAllocator, sfz_dbg(""));
+	staticScene.modelMatrices.init(0, ecsAllocator, sfz_dbg(""));
+	staticScene.sphereLights.init(0, ecsAllocator, sfz_dbg(""));
+	state.mPlaceholderTextures = uploadPlaceholderTextures(resourceAllocator);
+
+	// Number of threads decoding images while loading, only read on startup
+	const int32_t defaultNumDecodeThreads =
+		sfz::max(int32_t(std::thread::hardware_concurrency()) - 1, 0);
+	Setting* numDecodeThreadsSetting = cfg.sanitizeInt("PhantasyTestbed", "numDecodeThreads", true,
+		defaultNumDecodeThreads, 0, int32_t(WORKER_POOL_MAX_NUM_THREADS));
+	const uint32_t numDecodeThreads = uint32_t(numDecodeThreadsSetting->intValue());
+
+	// Everything allocated while loading (and streaming) the level is counted as glTF load
+	sfz::Allocator* loadAllocator = memory(state, MemorySubsystem::GLTF_LOAD);
+	// A package that is older than the gltf file (or its textures) is ignored, as is one cooked
+	// with other load options. The package is loaded blocking, it bypasses the streamer.
+	ScenePackage sponzaPackage;
+	bool loadFromPackage = useScenePackageSetting->boolValue() &&
+		sponzaPackage.init(SPONZA_PACKAGE_PATH, loadAllocator);
+	if (loadFromPackage && !sponzaPackage.isUpToDate("res/sponza.gltf", loadOptions)) {
+		SFZ_WARNING("PhantasyTestbed",
+			"\"%s\" is out of date (source files or load options changed), loading gltf instead. "
+			"Run with \"--cook\" to update it.", SPONZA_PACKAGE_PATH);
+		sponzaPackage.destroy();
+		loadFromPackage = false;
+	}
+	if (loadFromPackage) {
+		auto loadStart = std::chrono::high_resolution_clock::now();
+		strID sponzaId = strID("res/sponza.gltf");
 
-	{
+		// Block compressed textures are decompressed in parallel, uncompressed textures are
+		// uploaded straight from the mapped file
+		const uint32_t numTextures = sponzaPackage.numTextures();
+		sfz::Array<Image> decompressed;
+		decompressed.init(numTextures, loadAllocator, sfz_dbg(""));
+		for (uint32_t i = 0; i < numTextures; i++) decompressed.add(Image());
+		{
+			WorkerPool decodePool;
+			decodePool.init(numDecodeThreads, loadAllocator);
+			auto decompressTask = [&](uint32_t idx) {
+				if (!sponzaPackage.textureIsCompressed(idx)) return;
+				decompressed[idx] = sponzaPackage.decompressTexture(idx, loadAllocator);
+			};
+			decodePool.parallelFor(numTextures, decompressTask);
+		}
+		for (uint32_t i = 0; i < numTextures; i++) {
+			strID textureId = strID(sponzaPackage.texture(i).globalPath);
+			if (!renderer.textureLoaded(textureId)) {
+				bool success = sponzaPackage.textureIsCompressed(i) ?
+					renderer.uploadTextureBlocking(textureId, decompressed[i], true) :
+					renderer.uploadTextureBlocking(textureId, sponzaPackage.textureView(i), true);
+				sfz_assert(success);
+			}
+		}
+
+		// Only components with opaque albedo textures can be occluders, see calculateMeshInfo()
+		Mesh mesh = sponzaPackage.createMesh(loadAllocator);
+		sfz::Array<strID> opaqueTextures;
+		opaqueTextures.init(numTextures, loadAllocator, sfz_dbg(""));
+		for (uint32_t i = 0; i < numTextures; i++) {
+			strID textureId = strID(sponzaPackage.texture(i).globalPath);
+			if (sponzaPackage.textureIsCompressed(i)) {
+				addIfOpaqueAlbedo(mesh, textureId, decompressed[i], opaqueTextures);
+			}
+			else {
+				addIfOpaqueAlbedo(mesh, textureId, sponzaPackage.textureView(i), opaqueTextures);
+			}
+		}
+		bool sponzaUploadSuccess = state.mMeshes.uploadMeshBlocking(sponzaId, mesh,
+			sponzaPackage.lods(), opaqueTextures.data(), opaqueTextures.size());
+		sfz_assert(sponzaUploadSuccess);
+		sponzaPackage.destroy();
+
+		const float loadSecs = std::chrono::duration_cast<std::chrono::duration<float>>(
+			std::chrono::high_resolution_clock::now() - loadStart).count();
+		SFZ_INFO("PhantasyTestbed", "Loaded \"%s\" in %.1f ms",
+			SPONZA_PACKAGE_PATH, loadSecs * 1000.0f);
+
+		addStaticRenderEntity(state, sponzaId);
+	}
+	else if (streamingLoadSetting->boolValue() && !state.mBenchmark) {
+		state.mLevelStreamer.start("res/sponza.gltf",
+			numDecodeThreads, loadOptions, loadAllocator);
+	}
+	else {
 		strID sponzaId = strID("res/sponza.gltf");
 
 		// Load sponza level
 		Mesh mesh;
+		sfz::Array<ComponentLods> lods;
 		sfz::Array<ImageAndPath> textures;
+		textures.init(128, loadAllocator, sfz_dbg(""));
+		GltfLoadTimings timings;
 		{
-			bool success = loadAssetsFromGltf(
+			WorkerPool decodePool;
+			decodePool.init(numDecodeThreads, loadAllocator);
+			bool success = loadGltfParallel(
 				"res/sponza.gltf",
 				mesh,
+				lods,
 				textures,
-				sfz::getDefaultAllocator(),
-				nullptr,
-				nullptr);
+				loadAllocator,
+				decodePool,
+				loadOptions,
+				&timings);
 			if (!success) {
 				SFZ_ERROR("PhantasyTesbed", "%s", "Failed to load assets from gltf!");
 			}
 		}
 
 		// Upload sponza textures to Renderer
+		auto uploadStart = std::chrono::high_resolution_clock::now();
 		for (const ImageAndPath& item : textures) {
 			if (!renderer.textureLoaded(item.globalPathId)) {
 				bool success =
@@ -268,22 +1114,28 @@ static void onInit(void* userPtr)
 			}
 		}
 
-		// Upload sponza mesh to Renderer
-		bool sponzaUploadSuccess =
-			renderer.uploadMeshBlocking(sponzaId, mesh);
-		sfz_assert(sponzaUploadSuccess);
-
-		// Create RenderEntity
-		StaticScene& staticScene = state.mStaticScene;
-		staticScene.renderEntities.init(0, sfz::getDefaultAllocator(), sfz_dbg(""));
-		staticScene.sphereLights.init(0, sfz::getDefaultAllocator(), sfz_dbg(""));
-		{
-			RenderEntity entity;
-			entity.meshId = sponzaId;
-			staticScene.renderEntities.add(entity);
+		// Upload sponza mesh to Renderer, only components with opaque albedo textures can be
+		// occluders
+		sfz::Array<strID> opaqueTextures;
+		opaqueTextures.init(textures.size(), loadAllocator, sfz_dbg(""));
+		for (const ImageAndPath& item : textures) {
+			addIfOpaqueAlbedo(mesh, item.globalPathId, item.image, opaqueTextures);
 		}
+		bool sponzaUploadSuccess = state.mMeshes.uploadMeshBlocking(
+			sponzaId, mesh, lods.data(), opaqueTextures.data(), opaqueTextures.size());
+		sfz_assert(sponzaUploadSuccess);
+		const float uploadSecs = std::chrono::duration_cast<std::chrono::duration<float>>(
+			std::chrono::high_resolution_clock::now() - uploadStart).count();
+		SFZ_INFO("PhantasyTestbed",
+			"Loaded \"res/sponza.gltf\" (%u textures): parse %.2f s, decode %.2f s (%u threads), "
+			"upload %.2f s", textures.size(), timings.parseSecs, timings.decodeSecs,
+			numDecodeThreads, uploadSecs);
+
+		addStaticRenderEntity(state, sponzaId);
+	}
 
-		// Add a static light
+	// Add a static light
+	{
 		phSphereLight tmpLight;
 		tmpLight.pos = vec3(0.0f, 3.0f, 0.0f);
 		tmpLight.range = 70.0f;
@@ -302,9 +1154,6 @@ static void onInit(void* userPtr)
 	state.mCam.far = 200.0f;
 	state.mCam.vertFovDeg = 60.0f;
 
-	// Common game state stuff
-	GameStateHeader* ecs = state.mGameStateContainer.getHeader();
-
 	// Add dynamic light entities
 	vec3_u8 lightColors[] = {
 		vec3_u8(255, 0, 255),
@@ -321,20 +1170,79 @@ static void onInit(void* userPtr)
 		light.radius = 0.5f;
 		light.bitmaskFlags = SPHERE_LIGHT_STATIC_SHADOWS_BIT | SPHERE_LIGHT_DYNAMIC_SHADOWS_BIT;
 
-		Entity lightEntity = ecs->createEntity();
-		ecs->addComponent(lightEntity, SPHERE_LIGHT_TYPE, light);
+		EntityHandle lightEntity = state.mEntities.createEntity();
+		state.mSphereLights.add(lightEntity.idx, light);
 	}
 
 	// Add a box entity
 	{
-		Entity entity = ecs->createEntity();
+		EntityHandle entity = state.mEntities.createEntity();
 		RenderEntity renderEntity;
 		renderEntity.meshId = cubeMeshId;
-		ecs->addComponent(entity, RENDER_ENTITY_TYPE, renderEntity);
+		renderEntity.mesh = state.mMeshes.resolve(cubeMeshId);
+		state.mTransforms.add(entity.idx, Transform());
+		state.mRenderEntities.add(entity.idx, renderEntity);
 	}
 
-	GlobalConfig& cfg = sfz::getGlobalConfig();
 	state.mShowImguiDemo = cfg.sanitizeBool("PhantasyTestbed", "showImguiDemo", true, false);
+	state.mProfilerEnabled = cfg.sanitizeBool("PhantasyTestbed", "profiler", true, false);
+	state.mParallelRecording =
+		cfg.sanitizeBool("PhantasyTestbed", "parallelRecording", true, true);
+	state.mLodBiasCamera =
+		cfg.sanitizeFloat("PhantasyTestbed", "lodBiasCamera", true, 1.0f, 0.0f, 64.0f);
+	state.mLodBiasShadows =
+		cfg.sanitizeFloat("PhantasyTestbed", "lodBiasShadows", true, 2.0f, 0.0f, 64.0f);
+	state.mCacheShadowCascades =
+		cfg.sanitizeBool("PhantasyTestbed", "cacheShadowCascades", true, true);
+	state.mOcclusionCulling =
+		cfg.sanitizeBool("PhantasyTestbed", "occlusionCulling", true, true);
+	state.mOcclusionBuffer.init(memory(state, MemorySubsystem::RENDERING));
+	state.mStaticComponentRefs.init(1024, memory(state, MemorySubsystem::RENDERING),
+		sfz_dbg("PhantasyTestbedState::mStaticComponentRefs"));
+	state.mDynamicResolutionEnabled =
+		cfg.sanitizeBool("PhantasyTestbed", "dynamicResolution", true, false);
+	state.mDynamicResolutionTargetMs = cfg.sanitizeFloat(
+		"PhantasyTestbed", "dynamicResolutionTargetMs", true, 16.667f, 1.0f, 100.0f);
+	state.mDynamicResolutionMinScale =
+		cfg.sanitizeFloat("PhantasyTestbed", "dynamicResolutionMinScale", true, 0.5f, 0.1f, 4.0f);
+	state.mDynamicResolutionMaxScale =
+		cfg.sanitizeFloat("PhantasyTestbed", "dynamicResolutionMaxScale", true, 1.0f, 0.1f, 4.0f);
+	state.mDynamicResolutionMinResizeFrames = cfg.sanitizeInt(
+		"PhantasyTestbed", "dynamicResolutionMinResizeFrames", true, 30, 1, 600);
+
+	// Benchmarks run without vsync or UI, the changed settings are restored in onQuit()
+	if (state.mBenchmark) {
+		Setting* vsyncSetting = cfg.getSetting("Renderer", "vsync");
+		if (vsyncSetting != nullptr) {
+			state.mBenchmarkPrevVsync = vsyncSetting->boolValue();
+			vsyncSetting->setBool(false);
+		}
+		Setting* consoleActiveSetting = cfg.getSetting("Console", "active");
+		if (consoleActiveSetting != nullptr) {
+			state.mBenchmarkPrevConsoleActive = consoleActiveSetting->boolValue();
+			consoleActiveSetting->setBool(false);
+		}
+
+		if (state.mBenchmarkCameraPathFile == nullptr) {
+			state.mBenchmarkCameraPath = createDefaultCameraPath(getDefaultAllocator());
+		}
+		else {
+			loadCameraPath(state.mBenchmarkCameraPathFile,
+				state.mBenchmarkCameraPath, getDefaultAllocator());
+		}
+		state.mBenchmarkRecorder.init(
+			state.mBenchmarkNumFrames, BENCHMARK_DELTA_SECS, getDefaultAllocator());
+		SFZ_INFO("PhantasyTestbed", "Benchmarking %u frames (after %u warmup frames)",
+			state.mBenchmarkNumFrames, BENCHMARK_NUM_WARMUP_FRAMES);
+	}
+
+	// Start worker threads, number of threads is only read on startup
+	const int32_t defaultNumWorkers =
+		sfz::max(int32_t(std::thread::hardware_concurrency()) - 1, 0);
+	Setting* numWorkersSetting = cfg.sanitizeInt("PhantasyTestbed", "numWorkerThreads", true,
+		defaultNumWorkers, 0, int32_t(WORKER_POOL_MAX_NUM_THREADS));
+	state.mWorkerPool.init(
+		uint32_t(numWorkersSetting->intValue()), memory(state, MemorySubsystem::RENDERING));
 	Setting* internalResSetting = cfg.sanitizeFloat("Renderer", "internalResolutionScale", true, 1.0f, 0.01, 4.0f);
 #if defined(SFZ_IOS)
 	cfg.getSetting("Console", "active")->setBool(true);
@@ -406,13 +1314,13 @@ static void onInit(void* userPtr)
 		sfz::TextureResource::createFixedSize(
 			"ShadowMapCascaded1",
 			ZG_TEXTURE_FORMAT_DEPTH_F32,
-			vec2_u32(2048, 2048),
+			vec2_u32(SHADOW_MAP_CASCADE_RES[0]),
 			1,
 			ZG_TEXTURE_USAGE_DEPTH_BUFFER,
 			true));
 	resources.addFramebuffer(
 		sfz::FramebufferResourceBuilder("ShadowMapCascaded1_fb")
-		.setFixedRes(vec2_u32(2048, 2048))
+		.setFixedRes(vec2_u32(SHADOW_MAP_CASCADE_RES[0]))
 		.setDepthBuffer("ShadowMapCascaded1")
 		.build(screenRes));
 
@@ -420,13 +1328,13 @@ static void onInit(void* userPtr)
 		sfz::TextureResource::createFixedSize(
 			"ShadowMapCascaded2",
 			ZG_TEXTURE_FORMAT_DEPTH_F32,
-			vec2_u32(2048, 2048),
+			vec2_u32(SHADOW_MAP_CASCADE_RES[1]),
 			1,
 			ZG_TEXTURE_USAGE_DEPTH_BUFFER,
 			true));
 	resources.addFramebuffer(
 		sfz::FramebufferResourceBuilder("ShadowMapCascaded2_fb")
-		.setFixedRes(vec2_u32(2048, 2048))
+		.setFixedRes(vec2_u32(SHADOW_MAP_CASCADE_RES[1]))
 		.setDepthBuffer("ShadowMapCascaded2")
 		.build(screenRes));
 
@@ -434,13 +1342,13 @@ static void onInit(void* userPtr)
 		sfz::TextureResource::createFixedSize(
 			"ShadowMapCascaded3",
 			ZG_TEXTURE_FORMAT_DEPTH_F32,
-			vec2_u32(1024, 1024),
+			vec2_u32(SHADOW_MAP_CASCADE_RES[2]),
 			1,
 			ZG_TEXTURE_USAGE_DEPTH_BUFFER,
 			true));
 	resources.addFramebuffer(
 		sfz::FramebufferResourceBuilder("ShadowMapCascaded3_fb")
-		.setFixedRes(vec2_u32(1024, 1024))
+		.setFixedRes(vec2_u32(SHADOW_MAP_CASCADE_RES[2]))
 		.setDepthBuffer("ShadowMapCascaded3")
 		.build(screenRes));
 
@@ -463,8 +1371,19 @@ static void onInit(void* userPtr)
 	// Constant buffers
 	resources.addBuffer(
 		sfz::BufferResource::createStreaming("Directional Light Const Buffer", 1, 256, 3));
-	resources.addBuffer(
-		sfz::BufferResource::createStreaming("Point Lights Buffer", 1, 4112, 3));
+	static_assert(sizeof(sfz::ForwardShaderPointLightsBuffer) == 4112, "");
+	resources.addBuffer(sfz::BufferResource::createStreaming(
+		pointLightsBufferName(0).str, 1, sizeof(sfz::ForwardShaderPointLightsBuffer),
+		POINT_LIGHTS_BUFFER_NUM_COPIES));
+	state.mNumPointLightsBuffers = 1;
+
+	// Point lights
+	sfz::Allocator* renderingAllocator = memory(state, MemorySubsystem::RENDERING);
+	state.mLightList.init(256, renderingAllocator);
+	state.mPointLightBatches.init(
+		4, renderingAllocator, sfz_dbg("PhantasyTestbedState::mPointLightBatches"));
+	state.mPointLightBatchUploads.init(
+		4, renderingAllocator, sfz_dbg("PhantasyTestbedState::mPointLightBatchUploads"));
 }
 
 static sfz::UpdateOp onUpdate(
@@ -478,6 +1397,31 @@ static sfz::UpdateOp onUpdate(
 	sfz::Renderer& renderer = sfz::getRenderer();
 	sfz::ResourceManager& resources = sfz::getResourceManager();
 
+	// Only cooking or the transform kernel microbenchmark, which is already done
+	if (state.mCookGltfPath != nullptr || state.mTransformBenchmarkSize != 0) {
+		return UpdateOp::QUIT;
+	}
+
+	// Benchmarks use a fixed time step and ignore all input
+	BenchmarkRecorder* bench = nullptr;
+	sfz::RawInputState benchmarkInput = {};
+	if (state.mBenchmark) {
+		if (state.mBenchmarkCameraPath.keyframes.isEmpty()) return UpdateOp::QUIT;
+		bench = &state.mBenchmarkRecorder;
+		bench->beginFrame();
+		deltaSecs = BENCHMARK_DELTA_SECS;
+		numEvents = 0;
+		benchmarkInput.windowDims = rawFrameInput->windowDims;
+		rawFrameInput = &benchmarkInput;
+	}
+	BenchmarkScope frameScope(bench, BenchmarkPhase::FRAME);
+
+	// Profile this frame if enabled
+	Profiler& profiler = getProfiler();
+	profiler.setEnabled(state.mProfilerEnabled->boolValue());
+	profiler.beginFrame();
+	BenchmarkScope inputScope(bench, BenchmarkPhase::INPUT);
+
 	// Enable/disable console if console key is pressed
 	for (uint32_t i = 0; i < numEvents; i++) {
 		const SDL_Event& event = events[i];
@@ -493,6 +1437,7 @@ static sfz::UpdateOp onUpdate(
 	// Update imgui
 	updateImgui(vec2_i32(rawFrameInput->windowDims), *rawFrameInput, events, numEvents);
 	ImGui::NewFrame();
+	inputScope.stop();
 
 	// Only update stuff if console is not active
 	if (!state.console.active()) {
@@ -505,6 +1450,8 @@ static sfz::UpdateOp onUpdate(
 		}
 
 		// Run fixed timestep updates
+		BenchmarkScope fixedUpdateScope(bench, BenchmarkPhase::FIXED_UPDATE);
+		ProfilerScope profilerScope("runTickUpdates");
 		state.fixedTimeStepper.runTickUpdates(deltaSecs, [&](float tickTimeSecs) {
 
 			float delta = tickTimeSecs;
@@ -551,21 +1498,77 @@ static sfz::UpdateOp onUpdate(
 		});
 	}
 
-	// Begin renderer frame
-	renderer.frameBegin();
+	// Benchmarks move the camera along the path, which starts after the warmup frames
+	if (bench != nullptr) {
+		const uint32_t pathFrameIdx =
+			sfz::max(state.mBenchmarkFrameIdx, BENCHMARK_NUM_WARMUP_FRAMES) -
+			BENCHMARK_NUM_WARMUP_FRAMES;
+		vec3 camPos, camDir;
+		state.mBenchmarkCameraPath.evaluate(
+			float(pathFrameIdx) * BENCHMARK_DELTA_SECS, camPos, camDir);
+		state.mCam.pos = camPos;
+		setDir(state.mCam, camDir, vec3(0.0f, 1.0f, 0.0f));
+	}
 
-	// Grab common ECS stuff
-	GameStateHeader* gameState = state.mGameStateContainer.getHeader();
-	CompMask* masks = gameState->componentMasks();
+	// Upload whatever parts of the level have finished loading, within this frame's budget
+	BenchmarkScope streamingScope(bench, BenchmarkPhase::STREAMING);
+	const uint64_t uploadBudgetBytes =
+		uint64_t(state.mStreamingUploadBudgetMiB->intValue()) * 1024 * 1024;
+	if (state.mLevelStreamer.update(state.mMeshes, uploadBudgetBytes)) {
+		addStaticRenderEntity(state, state.mLevelStreamer.meshId());
+	}
+	const bool levelStreaming = state.mLevelStreamer.isStreaming();
+	streamingScope.stop();
+
+	// Adjust the internal resolution scale to the frame time. The renderer does not expose GPU
+	// timings, so the CPU frame time (which includes waiting for the GPU and present) is used.
+	// Benchmarks (fixed time step) and level streaming (not representative) are excluded, and so
+	// is vsync since the frame time then never drops below the refresh interval. The user's own
+	// scale is restored when the controller is turned off, and it is also kept within the
+	// controller's bounds so that taking over never changes the scale by itself.
+	GlobalConfig& cfg = getGlobalConfig();
+	Setting* internalResScaleSetting = cfg.getSetting("Renderer", "internalResolutionScale");
+	Setting* vsyncSetting = cfg.getSetting("Renderer", "vsync");
+	const bool vsync = vsyncSetting != nullptr && vsyncSetting->boolValue();
+	const bool dynamicResolution =
+		state.mDynamicResolutionEnabled->boolValue() && bench == nullptr && !vsync;
+	if (dynamicResolution) {
+		// Taking over, or the user changed the scale while the controller owned it
+		const float currentScale = internalResScaleSetting->floatValue();
+		if (!state.mDynamicResolutionActive || currentScale != state.mDynamicResolution.scale()) {
+			state.mDynamicResolutionUserScale = currentScale;
+			state.mDynamicResolution.reset(currentScale);
+		}
+	}
+	else if (state.mDynamicResolutionActive) {
+		internalResScaleSetting->setFloat(state.mDynamicResolutionUserScale);
+	}
+	state.mDynamicResolutionActive = dynamicResolution;
+	if (dynamicResolution && !levelStreaming) {
+		const float userScale = state.mDynamicResolutionUserScale;
+		DynamicResolutionParams params;
+		params.targetFrameMs = state.mDynamicResolutionTargetMs->floatValue();
+		params.minScale = sfz::min(state.mDynamicResolutionMinScale->floatValue(), userScale);
+		params.maxScale = sfz::max(state.mDynamicResolutionMaxScale->floatValue(), userScale);
+		params.minFramesBetweenResizes =
+			uint32_t(state.mDynamicResolutionMinResizeFrames->intValue());
+		if (state.mDynamicResolution.update(deltaSecs * 1000.0f, params)) {
+			internalResScaleSetting->setFloat(state.mDynamicResolution.scale());
+		}
+	}
+
+	// Begin renderer frame, the frame arena reuses the buffer of the oldest frame in flight
+	state.mAllocator.beginFrame();
+	checkMemoryBudgets(state);
+	state.mFrameArena.beginFrame();
+	renderer.frameBegin();
 
 	// Calculate view and projection matrices
 	const vec2_i32 windowRes = renderer.windowResolution();
 	const float aspect = float(windowRes.x) / float(windowRes.y);
 
 	// Calculate internal resolution
-	GlobalConfig& cfg = getGlobalConfig();
-	const float internalResScale =
-		cfg.getSetting("Renderer", "internalResolutionScale")->floatValue();
+	const float internalResScale = internalResScaleSetting->floatValue();
 	const vec2_u32 internalRes = vec2_u32(
 		std::round(windowRes.x * internalResScale), std::round(windowRes.y * internalResScale));
 
@@ -583,38 +1586,216 @@ static sfz::UpdateOp onUpdate(
 	const mat4 invProjMatrix = sfz::inverse(projMatrix);
 
 	// Create list of point lights
-	sfz::ForwardShaderPointLightsBuffer shaderPointLights;
-	for (const phSphereLight& sphereLight : state.mStaticScene.sphereLights) {
+	BenchmarkScope lightListScope(bench, BenchmarkPhase::LIGHT_LIST);
+	ProfilerScope lightListProfilerScope("Light list");
+	LightList& lightList = state.mLightList;
+	auto setPointLight = [&](uint32_t idx, const phSphereLight& sphereLight) {
+		const vec3 strength = vec3(sphereLight.color) * (1.0f / 255.0f) * sphereLight.strength;
+		lightList.set(idx, vec3(sphereLight.pos), sphereLight.range, strength);
+	};
+
+	// Sync lights with the scene, static lights only need to be set when they are (re)loaded
+	const uint32_t numStaticLights = state.mStaticScene.sphereLights.size();
+	lightList.resize(numStaticLights + state.mSphereLights.size());
+	if (state.mNumStaticLightsSynced != numStaticLights) {
+		for (uint32_t i = 0; i < numStaticLights; i++) {
+			setPointLight(i, state.mStaticScene.sphereLights[i]);
+		}
+		state.mNumStaticLightsSynced = numStaticLights;
+	}
+	uint32_t dynamicLightIdx = numStaticLights;
+	for (const phSphereLight& sphereLight : state.mSphereLights) {
+		setPointLight(dynamicLightIdx, sphereLight);
+		dynamicLightIdx += 1;
+	}
+
+	// Cull and transform lights, if nothing changed the batches from the last frame are still
+	// valid
+	state.mLightStats.numUploadedBatches = 0;
+	if (lightList.update(viewMatrix, projMatrix)) {
+
+		// Split the lights inside the view frustum into batches, one streaming buffer (and
+		// dispatch) per batch. Only batches whose contents changed need to be uploaded again.
+		const sfz::Array<uint32_t>& visibleLights = lightList.visibleLights();
+		const uint32_t numVisibleLights = visibleLights.size();
+		const uint32_t batchSize = MAX_NUM_POINT_LIGHTS_PER_BATCH;
+		const uint32_t numPointLightBatches = (numVisibleLights + batchSize - 1) / batchSize;
+		while (state.mPointLightBatches.size() > numPointLightBatches) {
+			state.mPointLightBatches.pop();
+			state.mPointLightBatchUploads.pop();
+		}
+		while (state.mPointLightBatches.size() < numPointLightBatches) {
+			state.mPointLightBatches.add(sfz::ForwardShaderPointLightsBuffer());
+			state.mPointLightBatchUploads.add(POINT_LIGHTS_BUFFER_NUM_COPIES);
+		}
+		for (uint32_t batchIdx = 0; batchIdx < numPointLightBatches; batchIdx++) {
+			sfz::ForwardShaderPointLightsBuffer batch = sfz::ForwardShaderPointLightsBuffer();
+			const uint32_t firstLight = batchIdx * batchSize;
+			batch.numPointLights =
+				sfz::min(numVisibleLights - firstLight, batchSize);
+			for (uint32_t i = 0; i < batch.numPointLights; i++) {
+				batch.pointLights[i] = lightList.pointLight(visibleLights[firstLight + i]);
+			}
+			if (memcmp(&batch, &state.mPointLightBatches[batchIdx], sizeof(batch)) != 0) {
+				state.mPointLightBatches[batchIdx] = batch;
+				state.mPointLightBatchUploads[batchIdx] = POINT_LIGHTS_BUFFER_NUM_COPIES;
+			}
+		}
+
+		// Grow the number of point lights buffers if needed
+		while (state.mNumPointLightsBuffers < numPointLightBatches) {
+			resources.addBuffer(sfz::BufferResource::createStreaming(
+				pointLightsBufferName(state.mNumPointLightsBuffers).str,
+				1, sizeof(sfz::ForwardShaderPointLightsBuffer), POINT_LIGHTS_BUFFER_NUM_COPIES));
+			state.mNumPointLightsBuffers += 1;
+		}
 
-		sfz::ShaderPointLight& pointLight =
-			shaderPointLights.pointLights[shaderPointLights.numPointLights];
-		shaderPointLights.numPointLights += 1;
+		state.mLightStats.numVisibleLights = numVisibleLights;
+		state.mLightStats.numBatches = numPointLightBatches;
+	}
+	state.mLightStats.numLights = lightList.size();
+	state.mLightStats.numTransformed = lightList.numTransformed();
+	lightListScope.stop();
+	lightListProfilerScope.stop();
+
+	// Gather render entities
+	// --------------------------------------------------------------------------------------------
 
-		pointLight.posVS = transformPoint(viewMatrix, vec3(sphereLight.pos));
-		pointLight.range = sphereLight.range;
-		pointLight.strength = vec3(sphereLight.color) * (1.0f / 255.0f) * sphereLight.strength;
+	// Model matrices and world space bounds of all static and dynamic render entities are
+	// calculated once here and then shared between all geometry passes.
+	BenchmarkScope renderListScope(bench, BenchmarkPhase::RENDER_LIST);
+	FrameRenderList& renderList = state.mFrameRenderList;
+	initFrameArray(renderList.items, 256, state.mFrameArena);
+	initFrameArray(renderList.componentBounds, 1024, state.mFrameArena);
+	initFrameArray(renderList.groups, 64, state.mFrameArena);
+	for (PassStats& stats : state.mPassStats) stats = {};
+
+	// Storage for each pass' draws, created here since the passes may be recorded in parallel
+	for (uint32_t i = 0; i < NUM_GEOMETRY_PASSES; i++) {
+		initFrameArray(state.mPassDrawItems[i], 1024, state.mFrameArena);
+		initFrameArray(state.mPassDrawMatrices[i], 256, state.mFrameArena);
+		initFrameArray(state.mPassInstances[i], 1024, state.mFrameArena);
+		initFrameArray(state.mPassVisibleItems[i], 256, state.mFrameArena);
+		initFrameArray(state.mPassVisibleModels[i], 256, state.mFrameArena);
+		initFrameArray(state.mPassInstanceLods[i], 256, state.mFrameArena);
+		initFrameArray(state.mPassStaticQueries[i], 1024, state.mFrameArena);
+		initFrameArray(state.mPassStaticItemMatrices[i], 64, state.mFrameArena);
 	}
-	phSphereLight* sphereLights = gameState->components<phSphereLight>(SPHERE_LIGHT_TYPE);
-	CompMask sphereLightyMask =
-		CompMask::activeMask() | CompMask::fromType(SPHERE_LIGHT_TYPE);
-	for (uint32_t entity = 0; entity < gameState->maxNumEntities; entity++) {
-		if (!masks[entity].fulfills(sphereLightyMask)) continue;
 
-		const phSphereLight& sphereLight = sphereLights[entity];
+	// Only the world matrices of transforms modified since last frame (and their descendants)
+	// are recomputed, the static scene's model matrices never change
+	state.mNumTransformsUpdated = state.mTransforms.update();
+	const StaticScene& staticScene = state.mStaticScene;
+	const uint32_t numRenderEntities =
+		staticScene.renderEntities.size() + state.mRenderEntities.size();
+	initFrameArray(renderList.modelMatrices, numRenderEntities, state.mFrameArena);
+
+	auto addRenderItem = [&](RenderEntity& entity, uint32_t modelMatrixIdx) {
+		state.mMeshes.refresh(entity.meshId, entity.mesh);
+		const MeshInfo* meshInfo = entity.mesh.info;
+		sfz_assert(meshInfo != nullptr);
+		FrameRenderItem item;
+		item.modelMatrixIdx = modelMatrixIdx;
+		const mat34& transform = renderList.modelMatrices[item.modelMatrixIdx];
+
+		item.maxScale = sfz::max(sfz::length(transform.column(0)),
+			sfz::max(sfz::length(transform.column(1)), sfz::length(transform.column(2))));
+		item.meshHandle = entity.mesh.handle;
+		item.meshInfo = meshInfo;
+		item.worldBounds = transformBoundingBox(transform, meshInfo->bounds);
+		item.firstComponentBounds = renderList.componentBounds.size();
+		item.numComponents = meshInfo->componentBounds.size();
+		for (const BoundingBox& compBounds : meshInfo->componentBounds) {
+			renderList.componentBounds.add(transformBoundingBox(transform, compBounds));
+		}
+		renderList.items.add(item);
+	};
+
+	// Static scene
+	const uint32_t firstStaticMatrixIdx = renderList.modelMatrices.size();
+	renderList.modelMatrices.add(
+		staticScene.modelMatrices.data(), staticScene.modelMatrices.size());
+	for (uint32_t i = 0; i < staticScene.renderEntities.size(); i++) {
+		addRenderItem(state.mStaticScene.renderEntities[i], firstStaticMatrixIdx + i);
+	}
+	renderList.numStaticItems = renderList.items.size();
+	renderList.numStaticComponents = renderList.componentBounds.size();
+
+	// Rebuild the static scene BVH if any of its meshes were (re)loaded
+	if (state.mStaticBvhGeneration != state.mMeshes.generation ||
+		state.mStaticBvh.numPrimitives() != renderList.numStaticComponents) {
+		ProfilerScope profilerScope("Static BVH");
+		auto buildStart = std::chrono::high_resolution_clock::now();
+		state.mStaticBvh.build(renderList.componentBounds.data(), renderList.numStaticComponents,
+			memory(state, MemorySubsystem::RENDERING));
+		state.mStaticComponentRefs.clear();
+		for (uint32_t itemIdx = 0; itemIdx < renderList.numStaticItems; itemIdx++) {
+			const FrameRenderItem& item = renderList.items[itemIdx];
+			for (uint32_t compIdx = 0; compIdx < item.numComponents; compIdx++) {
+				StaticComponentRef ref;
+				ref.itemIdx = itemIdx;
+				ref.compIdx = compIdx;
+				state.mStaticComponentRefs.add(ref);
+			}
+		}
+		state.mStaticBvhGeneration = state.mMeshes.generation;
+		const float buildSecs = std::chrono::duration_cast<std::chrono::duration<float>>(
+			std::chrono::high_resolution_clock::now() - buildStart).count();
+		state.mStaticBvhBuildMs = buildSecs * 1000.0f;
+	}
 
-		sfz::ShaderPointLight& pointLight =
-			shaderPointLights.pointLights[shaderPointLights.numPointLights];
-		shaderPointLights.numPointLights += 1;
+	// Dynamic objects
+	for (uint32_t i = 0; i < state.mRenderEntities.size(); i++) {
+		const uint32_t modelMatrixIdx = renderList.modelMatrices.size();
+		renderList.modelMatrices.add(state.mTransforms.world(state.mRenderEntities.entities()[i]));
+		addRenderItem(state.mRenderEntities.data()[i], modelMatrixIdx);
+	}
 
-		pointLight.posVS = transformPoint(viewMatrix, vec3(sphereLight.pos));
-		pointLight.range = sphereLight.range;
-		pointLight.strength = vec3(sphereLight.color) * (1.0f / 255.0f) * sphereLight.strength;
+	// Group dynamic items by mesh so each pass can draw all entities sharing a mesh as one batch.
+	// The static items are batched per pass from the components found in the static BVH.
+	std::stable_sort(renderList.items.begin() + renderList.numStaticItems, renderList.items.end(),
+		[](const FrameRenderItem& lhs, const FrameRenderItem& rhs) {
+		return lhs.meshHandle.bits < rhs.meshHandle.bits;
+	});
+	for (uint32_t i = renderList.numStaticItems; i < renderList.items.size(); i++) {
+		const FrameRenderItem& item = renderList.items[i];
+		if (renderList.groups.isEmpty() || renderList.groups.last().meshHandle != item.meshHandle) {
+			MeshGroup group;
+			group.meshHandle = item.meshHandle;
+			group.meshInfo = item.meshInfo;
+			group.firstItem = i;
+			renderList.groups.add(group);
+		}
+		renderList.groups.last().numItems += 1;
 	}
+	renderListScope.stop();
+
+	// Rasterize the occluders in view into the occlusion buffer, tested in the GBuffer pass
+	const bool occlusionCulling = state.mOcclusionCulling->boolValue();
+	state.mOcclusionStats = {};
+	if (occlusionCulling) {
+		ProfilerScope profilerScope("Occluders");
+		auto rasterizeStart = std::chrono::high_resolution_clock::now();
+		OcclusionStats& occlusionStats = state.mOcclusionStats;
+		const mat4 projViewMatrix = projMatrix * viewMatrix;
+		const FrustumPlanes frustum = frustumFromMatrix(projViewMatrix);
+		state.mOcclusionBuffer.clear(projViewMatrix);
+		for (const FrameRenderItem& item : renderList.items) {
+			const sfz::Array<vec3>& triangles = item.meshInfo->occluderTriangles;
+			if (triangles.isEmpty() || !intersects(frustum, item.worldBounds)) continue;
+			occlusionStats.numOccluderTriangles += state.mOcclusionBuffer.rasterizeTriangles(
+				projViewMatrix * mat4(renderList.modelMatrices[item.modelMatrixIdx]),
+				triangles.data(), triangles.size());
+		}
+		const float rasterizeSecs = std::chrono::duration_cast<std::chrono::duration<float>>(
+			std::chrono::high_resolution_clock::now() - rasterizeStart).count();
+		occlusionStats.rasterizeMs = rasterizeSecs * 1000.0f;
+	}
+
 
-	strID fullscreenTriangleId = strID("FullscreenTriangle");
-	sfz::PoolHandle fullscreenTriangleHandle = resources.getMeshHandle(fullscreenTriangleId);
-	sfz_assert(fullscreenTriangleHandle != NULL_HANDLE);
-	sfz::MeshResource* fullscreenTriangleMesh = resources.getMesh(fullscreenTriangleHandle);
+	state.mMeshes.refresh(state.mFullscreenTriangleId, state.mFullscreenTriangle);
+	sfz_assert(state.mFullscreenTriangle.handle != NULL_HANDLE);
+	sfz::MeshResource* fullscreenTriangleMesh = resources.getMesh(state.mFullscreenTriangle.handle);
 
 	auto drawFullscreenTriangle = [&](sfz::HighLevelCmdList& cmdList) {
 		cmdList.setIndexBuffer(fullscreenTriangleMesh->indexBuffer, ZG_INDEX_BUFFER_TYPE_UINT32);
@@ -635,95 +1816,279 @@ static sfz::UpdateOp onUpdate(
 		uint32_t emissive = ~0u;
 	};
 
-	auto drawMesh = [&](sfz::HighLevelCmdList& cmdList, strID id, MeshRegisters registers) {
-		sfz::PoolHandle meshHandle = resources.getMeshHandle(id);
-		sfz_assert(meshHandle != NULL_HANDLE);
-		sfz::MeshResource* mesh = resources.getMesh(meshHandle);
-
-		cmdList.setVertexBuffer(0, mesh->vertexBuffer);
-		cmdList.setIndexBuffer(mesh->indexBuffer, ZG_INDEX_BUFFER_TYPE_UINT32);
+	const MeshRegisters noRegisters;
 
-		sfz::Bindings commonBindings;
-		if (registers.materialsArray != ~0u) {
-			commonBindings.addConstBuffer(mesh->materialsBuffer, registers.materialsArray);
-		}
 
-		for (sfz::MeshComponent& comp : mesh->components) {
+	// Lambda for rendering all geometry
+	// --------------------------------------------------------------------------------------------
 
+	auto renderGeometry = [&](
+		sfz::HighLevelCmdList& cmdList,
+		const MeshRegisters& registers,
+		mat4 viewMatrix,
+		const mat4& projMatrix,
+		const LodSelection& lodSelection,
+		const OcclusionBuffer* occlusionBuffer,
+		uint32_t passIdx) {
+
+		ProfilerScope profilerScope(GEOMETRY_PASS_NAMES[passIdx]);
+		PassStats& stats = state.mPassStats[passIdx];
+		sfz::Array<DrawItem>& drawItems = state.mPassDrawItems[passIdx];
+		sfz::Array<DrawMatrices>& drawMatrices = state.mPassDrawMatrices[passIdx];
+		sfz::Array<uint32_t>& instances = state.mPassInstances[passIdx];
+		sfz::Array<uint32_t>& visibleItems = state.mPassVisibleItems[passIdx];
+		sfz::Array<uint32_t>& visibleModels = state.mPassVisibleModels[passIdx];
+		sfz::Array<InstanceLod>& instanceLods = state.mPassInstanceLods[passIdx];
+		sfz::Array<uint32_t>& staticQuery = state.mPassStaticQueries[passIdx];
+		sfz::Array<uint32_t>& staticItemMatrices = state.mPassStaticItemMatrices[passIdx];
+
+		const FrustumPlanes frustum = frustumFromMatrix(projMatrix * viewMatrix);
+		const bool useMaterialIdx = registers.materialIdxPushConstant != ~0u;
+		const bool useTextures = registers.albedo != ~0u ||
+			registers.metallicRoughness != ~0u || registers.emissive != ~0u;
+
+		// Adds the visible instances of a component in instanceLods as one batch per LOD
+		auto addComponentDraws = [&](
+			sfz::MeshResource* mesh,
+			sfz::PoolHandle meshHandle,
+			uint32_t compIdx,
+			const ComponentLods& compLods) {
+
+			const sfz::MeshComponent& comp = mesh->components[compIdx];
 			sfz_assert(comp.materialIdx < mesh->cpuMaterials.size());
 			const sfz::Material& material = mesh->cpuMaterials[comp.materialIdx];
 
-			// Set material index push constant
-			if (registers.materialIdxPushConstant != ~0u) {
-				sfz::vec4_u32 tmp = sfz::vec4_u32(0u);
-				tmp.x = comp.materialIdx;
-				cmdList.setPushConstant(registers.materialIdxPushConstant, tmp);
+			for (uint32_t lodIdx = 0; lodIdx < compLods.numLods; lodIdx++) {
+				const uint32_t firstInstance = instances.size();
+				for (const InstanceLod& instanceLod : instanceLods) {
+					if (instanceLod.lodIdx == lodIdx) instances.add(instanceLod.matricesIdx);
+				}
+				if (instances.size() == firstInstance) continue;
+
+				DrawItem draw;
+				draw.key = createDrawKey(
+					passIdx,
+					meshHandle,
+					useTextures ? textureSetHash(material) : 0u,
+					useMaterialIdx ? comp.materialIdx : 0u);
+				draw.mesh = mesh;
+				draw.compIdx = compIdx;
+				draw.lod = compLods.lods[lodIdx];
+				draw.firstInstance = firstInstance;
+				draw.numInstances = instances.size() - firstInstance;
+				drawItems.add(draw);
+				stats.numTriangles += draw.numInstances * (draw.lod.numIndices / 3);
 			}
+		};
 
-			// Create texture bindings
-			sfz::Bindings bindings = commonBindings;
-			auto bindTexture = [&](uint32_t texRegister, strID texID) {
-				if (texRegister != ~0u && texID.isValid()) {
-					bindings.addTexture(texID, texRegister);
-				}
-			};
-			bindTexture(registers.albedo, material.albedoTex);
-			bindTexture(registers.metallicRoughness, material.metallicRoughnessTex);
-			bindTexture(registers.emissive, material.emissiveTex);
+		// Static components in the frustum are found through the BVH and sorted by mesh and
+		// component, so that each run of equal mesh and component becomes one batch
+		const sfz::Array<StaticComponentRef>& staticRefs = state.mStaticComponentRefs;
+		state.mStaticBvh.queryFrustum(frustum, staticQuery);
+		stats.numCulledComponents += renderList.numStaticComponents - staticQuery.size();
+		std::sort(staticQuery.begin(), staticQuery.end(), [&](uint32_t lhs, uint32_t rhs) {
+			const StaticComponentRef& l = staticRefs[lhs];
+			const StaticComponentRef& r = staticRefs[rhs];
+			const uint32_t lMesh = renderList.items[l.itemIdx].meshHandle.bits;
+			const uint32_t rMesh = renderList.items[r.itemIdx].meshHandle.bits;
+			if (lMesh != rMesh) return lMesh < rMesh;
+			if (l.compIdx != r.compIdx) return l.compIdx < r.compIdx;
+			return l.itemIdx < r.itemIdx;
+		});
 
-			cmdList.setBindings(bindings);
-			cmdList.drawTrianglesIndexed(comp.firstIndex, comp.numIndices);
+		// Calculate matrices for the static items with components in the frustum
+		staticItemMatrices.add(~0u, renderList.numStaticItems);
+		visibleModels.clear();
+		const uint32_t firstStaticMatricesIdx = drawMatrices.size();
+		for (uint32_t compBoundsIdx : staticQuery) {
+			const uint32_t itemIdx = staticRefs[compBoundsIdx].itemIdx;
+			if (staticItemMatrices[itemIdx] != ~0u) continue;
+			staticItemMatrices[itemIdx] = firstStaticMatricesIdx + visibleModels.size();
+			visibleModels.add(renderList.items[itemIdx].modelMatrixIdx);
+		}
+		computeDrawMatrices(viewMatrix, renderList.modelMatrices.data(),
+			visibleModels.data(), visibleModels.size(), drawMatrices);
+
+		for (uint32_t runBegin = 0; runBegin < staticQuery.size();) {
+			const StaticComponentRef& runRef = staticRefs[staticQuery[runBegin]];
+			const FrameRenderItem& runItem = renderList.items[runRef.itemIdx];
+			sfz_assert(runItem.meshHandle != NULL_HANDLE);
+			sfz::MeshResource* mesh = resources.getMesh(runItem.meshHandle);
+			sfz_assert(runItem.meshInfo->componentLods.size() == mesh->components.size());
+			const ComponentLods& compLods = runItem.meshInfo->componentLods[runRef.compIdx];
+
+			instanceLods.clear();
+			uint32_t runEnd = runBegin;
+			for (; runEnd < staticQuery.size(); runEnd++) {
+				const uint32_t compBoundsIdx = staticQuery[runEnd];
+				const StaticComponentRef& ref = staticRefs[compBoundsIdx];
+				const FrameRenderItem& item = renderList.items[ref.itemIdx];
+				if (item.meshHandle != runItem.meshHandle || ref.compIdx != runRef.compIdx) break;
+
+				const BoundingBox& compBounds = renderList.componentBounds[compBoundsIdx];
+				if (occlusionBuffer != nullptr && occlusionBuffer->isOccluded(compBounds)) {
+					stats.numOccludedComponents += 1;
+					continue;
+				}
+				stats.numDrawnComponents += 1;
+
+				InstanceLod instanceLod;
+				instanceLod.matricesIdx = staticItemMatrices[ref.itemIdx];
+				instanceLod.lodIdx = selectLod(compLods,
+					lodErrorScale(lodSelection, viewMatrix, compBounds, item.maxScale),
+					lodSelection.maxError);
+				instanceLods.add(instanceLod);
+			}
+			if (!instanceLods.isEmpty()) {
+				addComponentDraws(mesh, runItem.meshHandle, runRef.compIdx, compLods);
+			}
+			runBegin = runEnd;
 		}
-	};
-
-	const MeshRegisters noRegisters;
-
-
-	// Lambda for rendering all geometry
-	// --------------------------------------------------------------------------------------------
-
-	auto renderGeometry = [&](sfz::HighLevelCmdList& cmdList, const MeshRegisters& registers, mat4 viewMatrix) {
-		// Static scene
-		for (const RenderEntity& entity : state.mStaticScene.renderEntities) {
-
-			mat4 modelMatrix = mat4(entity.transform());
-
-			// Calculate modelView and normal matrix
-			struct {
-				mat4 modelViewMatrix;
-				mat4 normalMatrix;
-			} dynMatrices;
-
-			dynMatrices.modelViewMatrix = viewMatrix * modelMatrix;
-			dynMatrices.normalMatrix = sfz::inverse(sfz::transpose(dynMatrices.modelViewMatrix));
 
-			// Render mesh
-			cmdList.setPushConstant(1, dynMatrices);
-			drawMesh(cmdList, entity.meshId, registers);
+		// Gather visible dynamic components, batched per mesh group
+		for (const MeshGroup& group : renderList.groups) {
+			sfz_assert(group.meshHandle != NULL_HANDLE);
+			sfz::MeshResource* mesh = resources.getMesh(group.meshHandle);
+			sfz_assert(group.meshInfo->componentLods.size() == mesh->components.size());
+
+			// Cull entire entities outside the frustum, calculate matrices for the rest
+			visibleItems.clear();
+			visibleModels.clear();
+			for (uint32_t i = 0; i < group.numItems; i++) {
+				const uint32_t itemIdx = group.firstItem + i;
+				const FrameRenderItem& item = renderList.items[itemIdx];
+				sfz_assert(mesh->components.size() == item.numComponents);
+				if (!intersects(frustum, item.worldBounds)) {
+					stats.numCulledComponents += item.numComponents;
+					continue;
+				}
+				if (occlusionBuffer != nullptr && occlusionBuffer->isOccluded(item.worldBounds)) {
+					stats.numOccludedComponents += item.numComponents;
+					continue;
+				}
+				visibleItems.add(itemIdx);
+				visibleModels.add(item.modelMatrixIdx);
+			}
+			if (visibleItems.isEmpty()) continue;
+			const uint32_t firstMatricesIdx = drawMatrices.size();
+			computeDrawMatrices(viewMatrix, renderList.modelMatrices.data(),
+				visibleModels.data(), visibleModels.size(), drawMatrices);
+
+			// Create one batch per component and LOD containing all instances where it is
+			// visible with that LOD
+			for (uint32_t compIdx = 0; compIdx < mesh->components.size(); compIdx++) {
+				const ComponentLods& compLods = group.meshInfo->componentLods[compIdx];
+				instanceLods.clear();
+				for (uint32_t i = 0; i < visibleItems.size(); i++) {
+					const FrameRenderItem& item = renderList.items[visibleItems[i]];
+					const uint32_t compBoundsIdx = item.firstComponentBounds + compIdx;
+					const BoundingBox& compBounds = renderList.componentBounds[compBoundsIdx];
+
+					// Skip components outside the pass' frustum
+					if (!intersects(frustum, compBounds)) {
+						stats.numCulledComponents += 1;
+						continue;
+					}
+					if (occlusionBuffer != nullptr && occlusionBuffer->isOccluded(compBounds)) {
+						stats.numOccludedComponents += 1;
+						continue;
+					}
+					stats.numDrawnComponents += 1;
+
+					InstanceLod instanceLod;
+					instanceLod.matricesIdx = firstMatricesIdx + i;
+					instanceLod.lodIdx = selectLod(compLods,
+						lodErrorScale(lodSelection, viewMatrix, compBounds, item.maxScale),
+						lodSelection.maxError);
+					instanceLods.add(instanceLod);
+				}
+				if (instanceLods.isEmpty()) continue;
+				addComponentDraws(mesh, group.meshHandle, compIdx, compLods);
+			}
 		}
+		stats.numBatches = drawItems.size();
 
-		// Dynamic objects
-		RenderEntity* renderEntities = gameState->components<RenderEntity>(RENDER_ENTITY_TYPE);
-		CompMask renderEntityMask =
-			CompMask::activeMask() | CompMask::fromType(RENDER_ENTITY_TYPE);
-		for (uint32_t entityId = 0; entityId < gameState->maxNumEntities; entityId++) {
-			if (!masks[entityId].fulfills(renderEntityMask)) continue;
-			const RenderEntity& entity = renderEntities[entityId];
+		// Sort so that draws sharing state end up next to each other
+		std::sort(drawItems.begin(), drawItems.end(), [](const DrawItem& lhs, const DrawItem& rhs) {
+			return lhs.key < rhs.key;
+		});
 
-			mat4 modelMatrix = mat4(entity.transform());
+		// Record draws, skipping state changes that would not change anything
+		const sfz::MeshResource* currMesh = nullptr;
+		const sfz::MeshResource* currBindingsMesh = nullptr;
+		const sfz::Material* currBindingsMaterial = nullptr;
+		uint32_t currMatricesIdx = ~0u;
+		uint32_t currMaterialIdx = ~0u;
+		for (const DrawItem& draw : drawItems) {
+			sfz::MeshResource* mesh = draw.mesh;
+			const sfz::MeshComponent& comp = mesh->components[draw.compIdx];
+			const sfz::Material& material = mesh->cpuMaterials[comp.materialIdx];
 
-			// Calculate modelView and normal matrix
-			struct {
-				mat4 modelViewMatrix;
-				mat4 normalMatrix;
-			} dynMatrices;
+			// Set vertex and index buffer
+			if (mesh != currMesh) {
+				cmdList.setVertexBuffer(0, mesh->vertexBuffer);
+				cmdList.setIndexBuffer(mesh->indexBuffer, ZG_INDEX_BUFFER_TYPE_UINT32);
+				currMesh = mesh;
+			}
+			else {
+				stats.numSkippedStateChanges += 2;
+			}
+
+			// Set material index push constant
+			if (useMaterialIdx) {
+				if (comp.materialIdx != currMaterialIdx) {
+					sfz::vec4_u32 tmp = sfz::vec4_u32(0u);
+					tmp.x = comp.materialIdx;
+					cmdList.setPushConstant(registers.materialIdxPushConstant, tmp);
+					currMaterialIdx = comp.materialIdx;
+				}
+				else {
+					stats.numSkippedStateChanges += 1;
+				}
+			}
 
-			dynMatrices.modelViewMatrix = viewMatrix * modelMatrix;
-			dynMatrices.normalMatrix = sfz::inverse(sfz::transpose(dynMatrices.modelViewMatrix));
+			// Set bindings, only if the materials buffer or any of the bound textures changed
+			const bool meshBindingsChanged =
+				registers.materialsArray != ~0u && mesh != currBindingsMesh;
+			const bool texturesChanged = useTextures &&
+				(currBindingsMaterial == nullptr || !sameTextures(material, *currBindingsMaterial));
+			if (currBindingsMaterial == nullptr || meshBindingsChanged || texturesChanged) {
+				sfz::Bindings bindings;
+				if (registers.materialsArray != ~0u) {
+					bindings.addConstBuffer(mesh->materialsBuffer, registers.materialsArray);
+				}
+				auto bindTexture = [&](uint32_t texRegister, strID texID, strID placeholderID) {
+					if (texRegister != ~0u && texID.isValid()) {
+						if (levelStreaming && !renderer.textureLoaded(texID)) texID = placeholderID;
+						bindings.addTexture(texID, texRegister);
+					}
+				};
+				const PlaceholderTextures& placeholders = state.mPlaceholderTextures;
+				bindTexture(registers.albedo, material.albedoTex, placeholders.albedo);
+				bindTexture(registers.metallicRoughness,
+					material.metallicRoughnessTex, placeholders.metallicRoughness);
+				bindTexture(registers.emissive, material.emissiveTex, placeholders.emissive);
+				cmdList.setBindings(bindings);
+				currBindingsMesh = mesh;
+				currBindingsMaterial = &material;
+			}
+			else {
+				stats.numSkippedStateChanges += 1;
+			}
 
-			// Render mesh
-			cmdList.setPushConstant(1, dynMatrices);
-			drawMesh(cmdList, entity.meshId, registers);
+			// Draw all instances of the batch, one draw each since the renderer has no instanced
+			// draws (and the shaders read their matrices from a push constant)
+			for (uint32_t i = 0; i < draw.numInstances; i++) {
+				const uint32_t matricesIdx = instances[draw.firstInstance + i];
+				if (matricesIdx != currMatricesIdx) {
+					cmdList.setPushConstant(1, drawMatrices[matricesIdx]);
+					currMatricesIdx = matricesIdx;
+				}
+				else {
+					stats.numSkippedStateChanges += 1;
+				}
+				cmdList.drawTrianglesIndexed(draw.lod.firstIndex, draw.lod.numIndices);
+			}
 		}
 	};
 
@@ -755,11 +2120,14 @@ static sfz::UpdateOp onUpdate(
 			LEVEL_DISTS);
 	}
 
-	{
-		sfz::HighLevelCmdList cmdList = renderer.beginCommandList("GBuffer + Cascaded Shadows");
+	// Records the specified geometry pass into the command list. Each pass only writes to its own
+	// PassStats, so different passes can be recorded on different threads at the same time.
+	auto recordGeometryPass = [&](sfz::HighLevelCmdList& cmdList, uint32_t passIdx) {
+		BenchmarkScope passScope(
+			bench, BenchmarkPhase(uint32_t(BenchmarkPhase::PASS_GBUFFER) + passIdx));
 
 		// GBuffer pass
-		{
+		if (passIdx == GBUFFER_PASS_IDX) {
 			cmdList.setShader("GBuffer Generation");
 			cmdList.setFramebuffer("GBuffer_fb");
 			cmdList.clearDepthBufferOptimal();
@@ -774,32 +2142,86 @@ static sfz::UpdateOp onUpdate(
 			registers.metallicRoughness = 1;
 			registers.emissive = 2;
 
-			renderGeometry(cmdList, registers, viewMatrix);
+			const LodSelection lodSelection = createLodSelection(
+				projMatrix, float(internalRes.y), state.mLodBiasCamera->floatValue());
+			const OcclusionBuffer* occlusionBuffer =
+				occlusionCulling ? &state.mOcclusionBuffer : nullptr;
+			renderGeometry(cmdList, registers, viewMatrix, projMatrix, lodSelection,
+				occlusionBuffer, passIdx);
 		}
 
 		// Shadows
-		{
-			cmdList.setShader("Shadow Map Generation");
-			cmdList.setFramebuffer("ShadowMapCascaded1_fb");
-			cmdList.clearDepthBufferOptimal();
-			cmdList.setPushConstant(0, cascadedInfo.projMatrices[0]);
-			renderGeometry(cmdList, noRegisters, cascadedInfo.viewMatrices[0]);
-		}
-		{
+		else {
+			const uint32_t cascadeIdx = passIdx - 1;
+			const mat4& cascadeViewMatrix = cascadedInfo.viewMatrices[cascadeIdx];
+			const mat4& cascadeProjMatrix = cascadedInfo.projMatrices[cascadeIdx];
+
+			// Skip the cascade if it already contains exactly what would be rendered. The shadow
+			// pass binds no textures, so only the meshes, their transforms and the LOD selection
+			// (which only depends on the projection for orthographic cascades) matter.
+			const FrustumPlanes frustum = frustumFromMatrix(cascadeProjMatrix * cascadeViewMatrix);
+			const float lodBias = state.mLodBiasShadows->floatValue();
+			uint64_t contentsHash = 0xCBF29CE484222325ull;
+			contentsHash = hashBytes(contentsHash, &state.mMeshes.generation, sizeof(uint32_t));
+			contentsHash = hashBytes(contentsHash, &lodBias, sizeof(float));
+			for (const FrameRenderItem& item : renderList.items) {
+				if (!intersects(frustum, item.worldBounds)) continue;
+				contentsHash = hashBytes(contentsHash, &item.meshHandle, sizeof(sfz::PoolHandle));
+				const mat34& modelMatrix = renderList.modelMatrices[item.modelMatrixIdx];
+				contentsHash = hashBytes(contentsHash, modelMatrix.data(), sizeof(mat34));
+			}
+			ShadowCascadeCache& cache = state.mShadowCascadeCaches[cascadeIdx];
+			if (state.mCacheShadowCascades->boolValue() && cache.valid &&
+				cache.contentsHash == contentsHash &&
+				sameMatrix(cache.viewMatrix, cascadeViewMatrix) &&
+				sameMatrix(cache.projMatrix, cascadeProjMatrix)) {
+				state.mPassStats[passIdx].cached = true;
+				return;
+			}
+			cache.valid = true;
+			cache.viewMatrix = cascadeViewMatrix;
+			cache.projMatrix = cascadeProjMatrix;
+			cache.contentsHash = contentsHash;
+
 			cmdList.setShader("Shadow Map Generation");
-			cmdList.setFramebuffer("ShadowMapCascaded2_fb");
+			cmdList.setFramebuffer(SHADOW_MAP_CASCADE_FRAMEBUFFERS[cascadeIdx]);
 			cmdList.clearDepthBufferOptimal();
-			cmdList.setPushConstant(0, cascadedInfo.projMatrices[1]);
-			renderGeometry(cmdList, noRegisters, cascadedInfo.viewMatrices[1]);
+			cmdList.setPushConstant(0, cascadedInfo.projMatrices[cascadeIdx]);
+			const LodSelection lodSelection = createLodSelection(
+				cascadedInfo.projMatrices[cascadeIdx], float(SHADOW_MAP_CASCADE_RES[cascadeIdx]),
+				state.mLodBiasShadows->floatValue());
+			renderGeometry(cmdList, noRegisters, cascadedInfo.viewMatrices[cascadeIdx],
+				cascadedInfo.projMatrices[cascadeIdx], lodSelection, nullptr, passIdx);
 		}
-		{
-			cmdList.setShader("Shadow Map Generation");
-			cmdList.setFramebuffer("ShadowMapCascaded3_fb");
-			cmdList.clearDepthBufferOptimal();
-			cmdList.setPushConstant(0, cascadedInfo.projMatrices[2]);
-			renderGeometry(cmdList, noRegisters, cascadedInfo.viewMatrices[2]);
+	};
+
+	if (state.mParallelRecording->boolValue() && state.mWorkerPool.numThreads() > 0) {
+
+		// Begin one command list per pass on the main thread, record them in parallel on the
+		// worker threads and then execute them in order.
+		sfz::HighLevelCmdList cmdLists[NUM_GEOMETRY_PASSES];
+		for (uint32_t i = 0; i < NUM_GEOMETRY_PASSES; i++) {
+			cmdLists[i] = renderer.beginCommandList(GEOMETRY_PASS_NAMES[i]);
 		}
 
+		auto recordTask = [&](uint32_t passIdx) {
+			recordGeometryPass(cmdLists[passIdx], passIdx);
+		};
+		state.mWorkerPool.parallelFor(NUM_GEOMETRY_PASSES, recordTask);
+
+		BenchmarkScope submitScope(bench, BenchmarkPhase::SUBMIT);
+		for (uint32_t i = 0; i < NUM_GEOMETRY_PASSES; i++) {
+			ProfilerScope profilerScope("executeCommandList");
+			renderer.executeCommandList(std::move(cmdLists[i]));
+		}
+	}
+	else {
+		sfz::HighLevelCmdList cmdList = renderer.beginCommandList("GBuffer + Cascaded Shadows");
+		for (uint32_t i = 0; i < NUM_GEOMETRY_PASSES; i++) {
+			recordGeometryPass(cmdList, i);
+		}
+		BenchmarkScope submitScope(bench, BenchmarkPhase::SUBMIT);
+		ProfilerScope profilerScope("executeCommandList");
 		renderer.executeCommandList(std::move(cmdList));
 	}
 
@@ -807,6 +2229,7 @@ static sfz::UpdateOp onUpdate(
 	// --------------------------------------------------------------------------------------------
 
 	{
+		BenchmarkScope shadingScope(bench, BenchmarkPhase::SHADING);
 		sfz::HighLevelCmdList cmdList = renderer.beginCommandList("Shading");
 
 		// Directional shading
@@ -857,17 +2280,25 @@ static sfz::UpdateOp onUpdate(
 			cmdList.unorderedBarrierTexture("LightAccumulation1");
 		}
 
-		// Point lights
-		{
+		// Point lights, one dispatch per batch
+		for (uint32_t batchIdx = 0; batchIdx < state.mPointLightBatches.size(); batchIdx++) {
 			cmdList.setShader("Point Light Shading");
 
 			cmdList.setPushConstant(0, invProjMatrix);
 
-			cmdList.uploadToStreamingBuffer(
-				"Point Lights Buffer", (const uint8_t*)&shaderPointLights, sizeof(shaderPointLights));
+			// Skip the upload if all copies of the streaming buffer already contain the batch
+			const sfz::ForwardShaderPointLightsBuffer& batch = state.mPointLightBatches[batchIdx];
+			const PointLightsBufferName bufferName = pointLightsBufferName(batchIdx);
+			uint32_t& uploadsLeft = state.mPointLightBatchUploads[batchIdx];
+			if (uploadsLeft > 0) {
+				cmdList.uploadToStreamingBuffer(
+					bufferName.str, (const uint8_t*)&batch, sizeof(batch));
+				uploadsLeft -= 1;
+				state.mLightStats.numUploadedBatches += 1;
+			}
 
 			sfz::Bindings bindings;
-			bindings.addConstBuffer("Point Lights Buffer", 1);
+			bindings.addConstBuffer(bufferName.str, 1);
 			bindings.addTexture("GBuffer_albedo", 0);
 			bindings.addTexture("GBuffer_metallic_roughness", 1);
 			bindings.addTexture("GBuffer_normal", 2);
@@ -883,6 +2314,9 @@ static sfz::UpdateOp onUpdate(
 			cmdList.unorderedBarrierTexture("LightAccumulation1");
 		}
 
+		shadingScope.stop();
+		BenchmarkScope submitScope(bench, BenchmarkPhase::SUBMIT);
+		ProfilerScope profilerScope("executeCommandList");
 		renderer.executeCommandList(std::move(cmdList));
 	}
 
@@ -891,6 +2325,7 @@ static sfz::UpdateOp onUpdate(
 	// --------------------------------------------------------------------------------------------
 
 	{
+		BenchmarkScope shadingScope(bench, BenchmarkPhase::SHADING);
 		sfz::HighLevelCmdList cmdList = renderer.beginCommandList("Copy Out");
 
 		// Copy out
@@ -909,35 +2344,137 @@ static sfz::UpdateOp onUpdate(
 			drawFullscreenTriangle(cmdList);
 		}
 
+		shadingScope.stop();
+		BenchmarkScope submitScope(bench, BenchmarkPhase::SUBMIT);
+		ProfilerScope profilerScope("executeCommandList");
 		renderer.executeCommandList(std::move(cmdList));
 	}
 
-	// Update console and inject testbed specific windows
-	state.console.render(windowRes);
+	// Update console and inject testbed specific windows, benchmarks show no UI
+	if (bench == nullptr) state.console.render(windowRes);
 	if (state.console.active()) {
 
-		// View of ECS system
-		sfz::GameStateHeader* gameStateTmp = state.mGameStateContainer.getHeader();
+		// View of entities, clicking outside the console windows picks the entity under the mouse
+		const ImGuiIO& io = ImGui::GetIO();
+		if (ImGui::IsMouseClicked(0) && !io.WantCaptureMouse) {
+			pickEntity(state, vec2(io.MousePos.x, io.MousePos.y), vec2(windowRes));
+		}
 		ImGui::SetNextWindowPos(vec2(700.0f, 00.0f), ImGuiCond_FirstUseEver);
-		state.mGameStateEditor.render(gameStateTmp);
+		renderEntityEditorWindow(state);
+
+		// Render stats
+		ImGui::Begin("Render Stats", nullptr, ImGuiWindowFlags_NoFocusOnAppearing);
+		for (uint32_t i = 0; i < NUM_GEOMETRY_PASSES; i++) {
+			const PassStats& stats = state.mPassStats[i];
+			ImGui::Text("%s%s", GEOMETRY_PASS_NAMES[i], stats.cached ? " (cached)" : "");
+			ImGui::Text("  Drawn components: %u", stats.numDrawnComponents);
+			ImGui::Text("  Culled components: %u", stats.numCulledComponents);
+			ImGui::Text("  Occluded components: %u", stats.numOccludedComponents);
+			ImGui::Text("  Batches: %u", stats.numBatches);
+			ImGui::Text("  Triangles: %u", stats.numTriangles);
+			ImGui::Text("  Skipped state changes: %u", stats.numSkippedStateChanges);
+		}
+
+		ImGui::Text("Transforms");
+		ImGui::Text("  Updated: %u / %u", state.mNumTransformsUpdated, state.mTransforms.size());
+
+		const LightStats& lightStats = state.mLightStats;
+		ImGui::Text("Point lights");
+		ImGui::Text("  Total: %u", lightStats.numLights);
+		ImGui::Text("  Visible: %u", lightStats.numVisibleLights);
+		ImGui::Text("  Batches: %u (%u uploaded)", lightStats.numBatches,
+			lightStats.numUploadedBatches);
+		ImGui::Text("  Transformed: %u", lightStats.numTransformed);
+
+		const OcclusionStats& occlusionStats = state.mOcclusionStats;
+		ImGui::Text("Occlusion culling%s", occlusionCulling ? "" : " (disabled)");
+		ImGui::Text("  Occluder triangles: %u", occlusionStats.numOccluderTriangles);
+		ImGui::Text("  Rasterization: %.3f ms", occlusionStats.rasterizeMs);
+
+		const DynamicResolution& dynRes = state.mDynamicResolution;
+		ImGui::Text("Dynamic resolution%s", state.mDynamicResolutionActive ? "" :
+			(vsync && state.mDynamicResolutionEnabled->boolValue()) ? " (off with vsync)" :
+			" (disabled)");
+		ImGui::Text("  Scale: %.2f (%u x %u)", internalResScale, internalRes.x, internalRes.y);
+		ImGui::Text("  Frame time: %.2f ms (target %.2f ms)",
+			dynRes.averageFrameMs(), state.mDynamicResolutionTargetMs->floatValue());
+		ImGui::Text("  Resizes: %u (last %u frames ago)",
+			dynRes.numResizes(), dynRes.framesSinceResize());
+
+		ImGui::Text("Static BVH");
+		ImGui::Text("  Nodes: %u", state.mStaticBvh.numNodes());
+		ImGui::Text("  Components: %u", state.mStaticBvh.numPrimitives());
+		ImGui::Text("  Last build: %.3f ms", state.mStaticBvhBuildMs);
+
+		const FrameArena& arena = state.mFrameArena;
+		ImGui::Text("Memory");
+		ImGui::Text("  Default allocator calls: %u allocs, %u frees",
+			state.mAllocator.numAllocationsLastFrame(),
+			state.mAllocator.numDeallocationsLastFrame());
+		ImGui::Text("  Frame arena: %.1f / %.1f KiB (peak %.1f KiB)",
+			float(arena.bytesUsed()) / 1024.0f, float(arena.bytesPerFrame()) / 1024.0f,
+			float(arena.peakBytesUsed()) / 1024.0f);
+		ImGui::Text("  Frame arena overflows: %u", arena.numOverflows());
+		ImGui::End();
+
+		// Memory usage per subsystem
+		renderMemoryWindow(state);
+
+		// Profiler
+		renderProfilerWindow(state);
 	}
-	else {
+	else if (bench == nullptr) {
 		if (state.mShowImguiDemo->boolValue()) ImGui::ShowDemoWindow();
 	}
 
+	// Show loading progress while the level is streamed in
+	if (levelStreaming) {
+		const StreamingProgress& progress = state.mLevelStreamer.progress();
+		ImGui::SetNextWindowPos(vec2(10.0f, 10.0f), ImGuiCond_Always);
+		ImGui::Begin("Loading", nullptr, ImGuiWindowFlags_NoFocusOnAppearing |
+			ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_AlwaysAutoResize);
+		ImGui::Text("Loading level...");
+		ImGui::ProgressBar(progress.fraction(), vec2(200.0f, 0.0f));
+		ImGui::Text("Textures: %u / %u (%u decoded)",
+			progress.numTexturesResident, progress.numTextures, progress.numTexturesDecoded);
+		ImGui::End();
+	}
+
 	// Finish rendering frame
-	renderer.frameFinish();
+	{
+		BenchmarkScope submitScope(bench, BenchmarkPhase::SUBMIT);
+		ProfilerScope profilerScope("frameFinish");
+		renderer.frameFinish();
+	}
 
 	// Store input as previous input
 	state.prevInput = *rawFrameInput;
 
+	// Store the benchmark timings of this frame, quit once all frames are recorded
+	if (bench != nullptr) {
+		frameScope.stop();
+		if (!finishBenchmarkFrame(state)) return sfz::UpdateOp::QUIT;
+	}
+
 	return sfz::UpdateOp::NO_OP;
 }
 
 static void onQuit(void* userPtr)
 {
 	PhantasyTestbedState* state = static_cast<PhantasyTestbedState*>(userPtr);
+	if (state->mBenchmark) {
+		GlobalConfig& cfg = sfz::getGlobalConfig();
+		Setting* vsyncSetting = cfg.getSetting("Renderer", "vsync");
+		if (vsyncSetting != nullptr) vsyncSetting->setBool(state->mBenchmarkPrevVsync);
+		Setting* consoleActiveSetting = cfg.getSetting("Console", "active");
+		if (consoleActiveSetting != nullptr) {
+			consoleActiveSetting->setBool(state->mBenchmarkPrevConsoleActive);
+		}
+	}
 	sfz::getDefaultAllocator()->deleteObject(state);
+
+	// After the state (and its worker threads) is gone
+	getProfiler().destroy();
 }
 
 
@@ -946,8 +2483,71 @@ static void onQuit(void* userPtr)
 
 sfz::InitOptions PhantasyEngineUserMain(int argc, char* argv[])
 {
-	(void)argc;
-	(void)argv;
+	PhantasyTestbedState* state = sfz::getDefaultAllocator()->
+		newObject<PhantasyTestbedState>(sfz_dbg("PhantasyTestbedState"));
+
+	// "--cook [gltf path] [package path]", cooks sponza by default. The package path defaults to
+	// the gltf path with its extension replaced by ".phscene".
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--cook") == 0) {
+			state->mCookGltfPath = "res/sponza.gltf";
+			state->mCookPackagePath = SPONZA_PACKAGE_PATH;
+			if ((i + 1) < argc && argv[i + 1][0] != '-') {
+				state->mCookGltfPath = argv[i + 1];
+				i += 1;
+				if ((i + 1) < argc && argv[i + 1][0] != '-') {
+					state->mCookPackagePath = argv[i + 1];
+					i += 1;
+				}
+				else {
+					const char* extension = strrchr(state->mCookGltfPath, '.');
+					const char* dirEnd = strrchr(state->mCookGltfPath, '/');
+					if (extension != nullptr && dirEnd != nullptr && extension < dirEnd) {
+						extension = nullptr;
+					}
+					const int baseLen = extension != nullptr ?
+						int(extension - state->mCookGltfPath) : int(strlen(state->mCookGltfPath));
+					snprintf(state->mCookPackagePathBuffer, sizeof(state->mCookPackagePathBuffer),
+						"%.*s.phscene", baseLen, state->mCookGltfPath);
+					state->mCookPackagePath = state->mCookPackagePathBuffer;
+				}
+			}
+		}
+	}
+
+	// "--bench-transforms [num transforms]", 10000 transforms by default
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--bench-transforms") == 0) {
+			state->mTransformBenchmarkSize = TRANSFORM_BENCHMARK_DEFAULT_SIZE;
+			if ((i + 1) < argc && argv[i + 1][0] != '-') {
+				const int numTransforms = atoi(argv[i + 1]);
+				if (numTransforms > 0) state->mTransformBenchmarkSize = uint32_t(numTransforms);
+				i += 1;
+			}
+		}
+	}
+
+	// "--benchmark [num frames] [output path]", output is JSON if the path ends with ".json" and
+	// CSV otherwise. "--camera-path [path]" replaces the default camera path of the benchmark.
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--benchmark") == 0) {
+			state->mBenchmark = true;
+			if ((i + 1) < argc && argv[i + 1][0] != '-') {
+				const int numFrames = atoi(argv[i + 1]);
+				if (numFrames > 0) state->mBenchmarkNumFrames = uint32_t(numFrames);
+				i += 1;
+			}
+			if ((i + 1) < argc && argv[i + 1][0] != '-') {
+				state->mBenchmarkOutputPath = argv[i + 1];
+				i += 1;
+			}
+		}
+		else if (strcmp(argv[i], "--camera-path") == 0 && (i + 1) < argc) {
+			state->mBenchmarkCameraPathFile = argv[i + 1];
+			i += 1;
+		}
+	}
+
 	sfz::InitOptions options;
 	options.appName = "PhantasyTestbed";
 #ifdef __EMSCRIPTEN__
@@ -955,8 +2555,7 @@ sfz::InitOptions PhantasyEngineUserMain(int argc, char* argv[])
 #else
 	options.iniLocation = sfz::IniLocation::MY_GAMES_DIR;
 #endif
-	options.userPtr = sfz::getDefaultAllocator()->
-		newObject<PhantasyTestbedState>(sfz_dbg("PhantasyTestbedState"));
+	options.userPtr = state;
 	options.initFunc = onInit;
 	options.updateFunc = onUpdate;
 	options.quitFunc = onQuit;
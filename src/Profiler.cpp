@@ -0,0 +1,263 @@
+#include "Profiler.hpp"
+
+#include <cstdio>
+
+#include <sfz/Logging.hpp>
+
+// Statics
+// ------------------------------------------------------------------------------------------------
+
+constexpr uint64_t PROFILER_RING_MASK = PROFILER_RING_SIZE - 1;
+
+// Incremented each time a profiler is initialized, so threads re-register with a new profiler
+// instead of using a ring buffer freed by the old one.
+static std::atomic_uint32_t profilerGeneration{0};
+
+struct ThreadRegistration final {
+	Profiler::ThreadRing* ring = nullptr;
+	uint32_t generation = ~0u;
+};
+static thread_local ThreadRegistration threadRegistration;
+
+// Profiler::ThreadRing
+// ------------------------------------------------------------------------------------------------
+
+struct Profiler::ThreadRing final {
+	// Number of events written so far, the last PROFILER_RING_SIZE of them are in events
+	std::atomic_uint64_t numWritten{0};
+	uint32_t depth = 0; // Only accessed by the owning thread
+	uint32_t idx = 0;
+	char name[32] = {};
+	ProfilerEvent events[PROFILER_RING_SIZE];
+};
+
+// Profiler: Constructors & destructors
+// ------------------------------------------------------------------------------------------------
+
+void Profiler::init(sfz::Allocator* allocator) noexcept
+{
+	this->destroy();
+	mAllocator = allocator;
+	mEpoch = std::chrono::steady_clock::now();
+	mNumRegisteredThreads.store(0);
+	for (std::atomic<ThreadRing*>& thread : mThreads) thread.store(nullptr);
+	profilerGeneration.fetch_add(1);
+}
+
+void Profiler::destroy() noexcept
+{
+	if (mAllocator != nullptr) {
+		const uint32_t numRegistered =
+			sfz::min(mNumRegisteredThreads.load(), PROFILER_MAX_NUM_THREADS);
+		for (uint32_t i = 0; i < numRegistered; i++) {
+			ThreadRing* thread = mThreads[i].exchange(nullptr);
+			if (thread != nullptr) mAllocator->deleteObject(thread);
+		}
+		profilerGeneration.fetch_add(1);
+	}
+	mAllocator = nullptr;
+	mEnabled.store(false);
+	mNumRegisteredThreads.store(0);
+	mNumFrames = 0;
+	mMainThread = nullptr;
+}
+
+// Profiler: Methods
+// ------------------------------------------------------------------------------------------------
+
+void Profiler::beginFrame() noexcept
+{
+	if (mAllocator == nullptr) return;
+
+	// Nothing is registered or allocated while disabled. The frame history restarts when the
+	// profiler is enabled again, so no frame spans the time it was disabled.
+	if (!isEnabled()) {
+		mNumFrames = 0;
+		return;
+	}
+	if (mMainThread == nullptr) {
+		mMainThread = currentThread();
+		if (mMainThread != nullptr) {
+			snprintf(mMainThread->name, sizeof(mMainThread->name), "Main");
+		}
+	}
+	mFrameBeginsNs[mNumFrames % PROFILER_MAX_NUM_FRAMES] = nowNs();
+	mNumFrames += 1;
+}
+
+uint64_t Profiler::frameBeginNs(uint64_t frameIdx) const noexcept
+{
+	sfz_assert(frameIdx < mNumFrames && (mNumFrames - frameIdx) <= PROFILER_MAX_NUM_FRAMES);
+	return mFrameBeginsNs[frameIdx % PROFILER_MAX_NUM_FRAMES];
+}
+
+uint64_t Profiler::frameEndNs(uint64_t frameIdx) const noexcept
+{
+	if ((frameIdx + 1) < mNumFrames) return frameBeginNs(frameIdx + 1);
+	return nowNs();
+}
+
+uint32_t Profiler::numThreads() const noexcept
+{
+	return sfz::min(mNumRegisteredThreads.load(), PROFILER_MAX_NUM_THREADS);
+}
+
+const char* Profiler::threadName(uint32_t threadIdx) const noexcept
+{
+	const ThreadRing* thread = mThreads[threadIdx].load(std::memory_order_acquire);
+	return thread != nullptr ? thread->name : "";
+}
+
+void Profiler::copyEvents(
+	uint32_t threadIdx,
+	uint64_t beginNs,
+	uint64_t endNs,
+	sfz::Array<ProfilerEvent>& eventsOut) const noexcept
+{
+	const ThreadRing* thread = mThreads[threadIdx].load(std::memory_order_acquire);
+	if (thread == nullptr) return;
+
+	// Copy everything in the ring
+	const uint32_t firstOut = eventsOut.size();
+	const uint64_t numWritten = thread->numWritten.load(std::memory_order_acquire);
+	const uint64_t first = numWritten > PROFILER_RING_SIZE ? numWritten - PROFILER_RING_SIZE : 0;
+	for (uint64_t i = first; i < numWritten; i++) {
+		eventsOut.add(thread->events[i & PROFILER_RING_MASK]);
+	}
+
+	// The owning thread might have wrapped around and overwritten the oldest copied events while
+	// copying. The slot of event i is reused by event i + PROFILER_RING_SIZE, which is written
+	// before numWritten is incremented past it.
+	std::atomic_thread_fence(std::memory_order_acquire);
+	const uint64_t numWrittenAfter = thread->numWritten.load(std::memory_order_relaxed);
+	const uint64_t firstValid = (numWrittenAfter + 1) > PROFILER_RING_SIZE ?
+		(numWrittenAfter + 1) - PROFILER_RING_SIZE : 0;
+
+	// Keep the valid events overlapping the time range
+	uint32_t numKept = 0;
+	for (uint64_t i = first; i < numWritten; i++) {
+		const ProfilerEvent event = eventsOut[firstOut + uint32_t(i - first)];
+		if (i < firstValid) continue;
+		if (event.beginNs >= endNs || (event.beginNs + event.durationNs) < beginNs) continue;
+		eventsOut[firstOut + numKept] = event;
+		numKept += 1;
+	}
+	const uint32_t numCopied = uint32_t(numWritten - first);
+	if (numKept < numCopied) eventsOut.remove(firstOut + numKept, numCopied - numKept);
+}
+
+bool Profiler::writeChromeTrace(const char* path, uint32_t numFrames) const noexcept
+{
+	// The frame being recorded is not complete
+	const uint64_t numCompleteFrames = mNumFrames > 0 ? mNumFrames - 1 : 0;
+	const uint64_t numDumped = sfz::min(sfz::min(uint64_t(numFrames), numCompleteFrames),
+		uint64_t(PROFILER_MAX_NUM_FRAMES - 1));
+	if (numDumped == 0) {
+		SFZ_ERROR("Profiler", "%s", "No complete frames to write");
+		return false;
+	}
+	const uint64_t firstFrame = numCompleteFrames - numDumped;
+	const uint64_t beginNs = frameBeginNs(firstFrame);
+	const uint64_t endNs = frameBeginNs(numCompleteFrames);
+
+	FILE* file = fopen(path, "w");
+	if (file == nullptr) {
+		SFZ_ERROR("Profiler", "Could not open \"%s\" for writing", path);
+		return false;
+	}
+
+	// Timestamps are in microseconds
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	bool firstEvent = true;
+	auto writeEvent = [&](const char* name, uint32_t tid, uint64_t eventBeginNs, uint64_t durNs) {
+		fprintf(file, "%s{\"name\":\"%s\",\"cat\":\"testbed\",\"ph\":\"X\",\"pid\":0,"
+			"\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", firstEvent ? "" : ",\n", name, tid,
+			double(eventBeginNs) * 0.001, double(durNs) * 0.001);
+		firstEvent = false;
+	};
+
+	const uint32_t numRegistered = numThreads();
+	for (uint32_t i = 0; i < numRegistered; i++) {
+		fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,"
+			"\"args\":{\"name\":\"%s\"}}", firstEvent ? "" : ",\n", i, threadName(i));
+		firstEvent = false;
+	}
+
+	if (mMainThread != nullptr) {
+		for (uint64_t frameIdx = firstFrame; frameIdx < numCompleteFrames; frameIdx++) {
+			const uint64_t frameBegin = frameBeginNs(frameIdx);
+			writeEvent("Frame", mMainThread->idx, frameBegin, frameEndNs(frameIdx) - frameBegin);
+		}
+	}
+
+	sfz::Array<ProfilerEvent> events;
+	events.init(PROFILER_RING_SIZE, mAllocator, sfz_dbg(""));
+	for (uint32_t i = 0; i < numRegistered; i++) {
+		events.clear();
+		copyEvents(i, beginNs, endNs, events);
+		for (const ProfilerEvent& event : events) {
+			writeEvent(event.name, i, event.beginNs, event.durationNs);
+		}
+	}
+	fprintf(file, "\n]}\n");
+
+	const bool success = ferror(file) == 0;
+	fclose(file);
+	if (!success) SFZ_ERROR("Profiler", "Failed to write \"%s\"", path);
+	return success;
+}
+
+// Profiler: Recording
+// ------------------------------------------------------------------------------------------------
+
+uint64_t Profiler::nowNs() const noexcept
+{
+	return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - mEpoch).count());
+}
+
+Profiler::ThreadRing* Profiler::currentThread() noexcept
+{
+	ThreadRegistration& registration = threadRegistration;
+	const uint32_t generation = profilerGeneration.load(std::memory_order_relaxed);
+	if (registration.generation == generation) return registration.ring;
+	registration.generation = generation;
+	registration.ring = nullptr;
+	if (mAllocator == nullptr) return nullptr;
+
+	const uint32_t idx = mNumRegisteredThreads.fetch_add(1);
+	if (idx >= PROFILER_MAX_NUM_THREADS) return nullptr;
+	ThreadRing* thread = mAllocator->newObject<ThreadRing>(sfz_dbg("Profiler::ThreadRing"));
+	thread->idx = idx;
+	snprintf(thread->name, sizeof(thread->name), "Thread %u", idx);
+	mThreads[idx].store(thread, std::memory_order_release);
+	registration.ring = thread;
+	return thread;
+}
+
+void Profiler::pushScope(ThreadRing* thread) noexcept
+{
+	thread->depth += 1;
+}
+
+void Profiler::popScope(
+	ThreadRing* thread, const char* name, uint64_t beginNs, uint64_t endNs) noexcept
+{
+	thread->depth -= 1;
+	const uint64_t idx = thread->numWritten.load(std::memory_order_relaxed);
+	ProfilerEvent& event = thread->events[idx & PROFILER_RING_MASK];
+	event.name = name;
+	event.beginNs = beginNs;
+	event.durationNs = uint32_t(sfz::min(endNs - beginNs, uint64_t(UINT32_MAX)));
+	event.depth = thread->depth;
+	thread->numWritten.store(idx + 1, std::memory_order_release);
+}
+
+// Global profiler
+// ------------------------------------------------------------------------------------------------
+
+Profiler& getProfiler() noexcept
+{
+	static Profiler profiler;
+	return profiler;
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+#include <skipifzero.hpp>
+#include <skipifzero_arrays.hpp>
+
+// Profiler constants
+// ------------------------------------------------------------------------------------------------
+
+// Threads beyond this many (over the lifetime of the profiler) are not profiled
+constexpr uint32_t PROFILER_MAX_NUM_THREADS = 128;
+
+// Number of events each thread's ring buffer holds before overwriting the oldest ones
+constexpr uint32_t PROFILER_RING_SIZE = 8192;
+static_assert((PROFILER_RING_SIZE & (PROFILER_RING_SIZE - 1)) == 0, "Must be a power of two");
+
+// Number of frames whose begin times are remembered, the most frames that can be dumped
+constexpr uint32_t PROFILER_MAX_NUM_FRAMES = 256;
+
+// ProfilerEvent
+// ------------------------------------------------------------------------------------------------
+
+struct ProfilerEvent final {
+	const char* name = nullptr; // Must be a string literal (or otherwise outlive the profiler)
+	uint64_t beginNs = 0; // Since the profiler was initialized
+	uint32_t durationNs = 0;
+	uint32_t depth = 0; // Number of enclosing scopes on the same thread
+};
+static_assert(sizeof(ProfilerEvent) == 24, "ProfilerEvent is padded");
+
+// Profiler
+// ------------------------------------------------------------------------------------------------
+
+// Hierarchical CPU profiler. Each thread records its scopes into its own ring buffer, which only
+// that thread writes to, so recording takes no locks. Readers (the flame view and trace dumps on
+// the main thread) copy events out and discard those that may have been overwritten meanwhile.
+//
+// When disabled a ProfilerScope costs a single relaxed atomic load.
+class Profiler final {
+public:
+	// Constructors & destructors
+	// --------------------------------------------------------------------------------------------
+
+	Profiler() noexcept = default;
+	Profiler(const Profiler&) = delete;
+	Profiler& operator= (const Profiler&) = delete;
+	Profiler(Profiler&&) = delete;
+	Profiler& operator= (Profiler&&) = delete;
+	~Profiler() noexcept { this->destroy(); }
+
+	void init(sfz::Allocator* allocator) noexcept;
+
+	// Must not be called while other threads might be recording
+	void destroy() noexcept;
+
+	// Methods
+	// --------------------------------------------------------------------------------------------
+
+	bool isEnabled() const { return mEnabled.load(std::memory_order_relaxed); }
+	void setEnabled(bool enabled) { mEnabled.store(enabled, std::memory_order_relaxed); }
+
+	// Marks the beginning of a new frame, called by the main thread (which is named "Main").
+	// Does nothing except clearing the frame history while the profiler is disabled.
+	void beginFrame() noexcept;
+
+	// Number of frames begun so far, frame i is complete once frame i + 1 has begun.
+	uint64_t numFrames() const { return mNumFrames; }
+
+	// Time range of a frame that is within the last PROFILER_MAX_NUM_FRAMES frames.
+	uint64_t frameBeginNs(uint64_t frameIdx) const noexcept;
+	uint64_t frameEndNs(uint64_t frameIdx) const noexcept;
+
+	uint32_t numThreads() const noexcept;
+	const char* threadName(uint32_t threadIdx) const noexcept;
+
+	// Appends the events of a thread that overlap [beginNs, endNs), sorted by end time.
+	void copyEvents(
+		uint32_t threadIdx,
+		uint64_t beginNs,
+		uint64_t endNs,
+		sfz::Array<ProfilerEvent>& eventsOut) const noexcept;
+
+	// Writes the last numFrames complete frames in Chrome's trace event format, can be opened
+	// in chrome://tracing or Perfetto.
+	bool writeChromeTrace(const char* path, uint32_t numFrames) const noexcept;
+
+	// Recording, use ProfilerScope instead of calling these directly
+	// --------------------------------------------------------------------------------------------
+
+	struct ThreadRing;
+
+	uint64_t nowNs() const noexcept;
+	ThreadRing* currentThread() noexcept; // nullptr if too many threads
+	static void pushScope(ThreadRing* thread) noexcept;
+	static void popScope(
+		ThreadRing* thread, const char* name, uint64_t beginNs, uint64_t endNs) noexcept;
+
+private:
+	sfz::Allocator* mAllocator = nullptr;
+	std::chrono::steady_clock::time_point mEpoch;
+	std::atomic_bool mEnabled{false};
+
+	// Threads register themselves the first time they record something
+	std::atomic_uint32_t mNumRegisteredThreads{0};
+	std::atomic<ThreadRing*> mThreads[PROFILER_MAX_NUM_THREADS];
+
+	// Only accessed by the main thread
+	uint64_t mNumFrames = 0;
+	uint64_t mFrameBeginsNs[PROFILER_MAX_NUM_FRAMES] = {};
+	ThreadRing* mMainThread = nullptr;
+};
+
+// The profiler shared by all threads, initialized on startup.
+Profiler& getProfiler() noexcept;
+
+// ProfilerScope
+// ------------------------------------------------------------------------------------------------
+
+// Records the time from construction until stop() (or destruction) as an event on the calling
+// thread, unless the profiler is disabled. The name must be a string literal.
+class ProfilerScope final {
+public:
+	ProfilerScope(const ProfilerScope&) = delete;
+	ProfilerScope& operator= (const ProfilerScope&) = delete;
+	ProfilerScope(ProfilerScope&&) = delete;
+	ProfilerScope& operator= (ProfilerScope&&) = delete;
+
+	explicit ProfilerScope(const char* name) noexcept
+	{
+		Profiler& profiler = getProfiler();
+		if (!profiler.isEnabled()) return;
+		mThread = profiler.currentThread();
+		if (mThread == nullptr) return;
+		mName = name;
+		Profiler::pushScope(mThread);
+		mBeginNs = profiler.nowNs();
+	}
+
+	~ProfilerScope() noexcept { this->stop(); }
+
+	void stop() noexcept
+	{
+		if (mThread == nullptr) return;
+		Profiler::popScope(mThread, mName, mBeginNs, getProfiler().nowNs());
+		mThread = nullptr;
+	}
+
+private:
+	Profiler::ThreadRing* mThread = nullptr;
+	const char* mName = nullptr;
+	uint64_t mBeginNs = 0;
+};
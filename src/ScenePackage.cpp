@@ -0,0 +1,377 @@
+#include "ScenePackage.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include <sfz/Logging.hpp>
+#include <sfz/util/GltfLoader.hpp>
+
+#include "GltfStreamer.hpp"
+
+// Statics
+// ------------------------------------------------------------------------------------------------
+
+static uint64_t alignUp(uint64_t offset) noexcept
+{
+	return (offset + SCENE_PACKAGE_ALIGNMENT - 1) & ~(SCENE_PACKAGE_ALIGNMENT - 1);
+}
+
+// Places a section of the given size at the next aligned offset
+static ScenePackageSection allocSection(uint64_t& offset, uint64_t numBytes) noexcept
+{
+	ScenePackageSection section;
+	section.offset = alignUp(offset);
+	section.numBytes = numBytes;
+	offset = section.offset + numBytes;
+	return section;
+}
+
+static bool sectionInBounds(const ScenePackageSection& section, uint64_t fileSize) noexcept
+{
+	return section.offset <= fileSize && section.numBytes <= (fileSize - section.offset) &&
+		(section.offset % SCENE_PACKAGE_ALIGNMENT) == 0;
+}
+
+// 64-bit FNV-1a, continuing from the given hash
+static uint64_t hashBytes(uint64_t hash, const void* data, uint64_t numBytes) noexcept
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	for (uint64_t i = 0; i < numBytes; i++) {
+		hash ^= bytes[i];
+		hash *= 0x100000001B3ull;
+	}
+	return hash;
+}
+
+static uint64_t hashFileStamp(uint64_t hash, const char* path) noexcept
+{
+	FileStamp stamp;
+	fileStamp(path, stamp);
+	hash = hashBytes(hash, path, strlen(path));
+	hash = hashBytes(hash, &stamp.size, sizeof(stamp.size));
+	return hashBytes(hash, &stamp.modifiedTime, sizeof(stamp.modifiedTime));
+}
+
+static uint64_t hashLoadOptions(uint64_t hash, const GltfLoadOptions& options) noexcept
+{
+	const bool optionFlags[] = {
+		options.blockCompressTextures,
+		options.optimizeMesh,
+		options.generateLods,
+		options.packVertices
+	};
+	return hashBytes(hash, optionFlags, sizeof(optionFlags));
+}
+
+constexpr uint64_t SOURCE_HASH_SEED = 0xCBF29CE484222325ull;
+
+// Writes data at the given offset, zero padding from the current position
+static bool writeAt(
+	FILE* file,
+	uint64_t& currentOffset,
+	const ScenePackageSection& section,
+	const void* data) noexcept
+{
+	sfz_assert(section.offset >= currentOffset);
+	const uint8_t zeroes[SCENE_PACKAGE_ALIGNMENT] = {};
+	const size_t numPadding = size_t(section.offset - currentOffset);
+	if (numPadding > 0 && fwrite(zeroes, 1, numPadding, file) != numPadding) return false;
+	const size_t numBytes = size_t(section.numBytes);
+	if (numBytes > 0 && fwrite(data, 1, numBytes, file) != numBytes) return false;
+	currentOffset = section.offset + section.numBytes;
+	return true;
+}
+
+// Cooking
+// ------------------------------------------------------------------------------------------------
+
+uint64_t scenePackageSourceHash(
+	const char* gltfPath,
+	const char* const* texturePaths,
+	uint32_t numTextures,
+	const GltfLoadOptions& options) noexcept
+{
+	uint64_t hash = hashFileStamp(SOURCE_HASH_SEED, gltfPath);
+	for (uint32_t i = 0; i < numTextures; i++) hash = hashFileStamp(hash, texturePaths[i]);
+	return hashLoadOptions(hash, options);
+}
+
+bool cookScenePackage(
+	const char* gltfPath,
+	const char* packagePath,
+	WorkerPool& decodePool,
+	const GltfLoadOptions& options,
+	sfz::Allocator* allocator) noexcept
+{
+	auto loadStart = std::chrono::high_resolution_clock::now();
+	sfz::Mesh mesh;
+	sfz::Array<ComponentLods> lods;
+	sfz::Array<sfz::strID> textureIds;
+	textureIds.init(128, allocator, sfz_dbg(""));
+	if (!parseGltfDeferTextures(gltfPath, mesh, lods, textureIds, options, allocator)) {
+		SFZ_ERROR("PhantasyTestbed", "Failed to load gltf for cooking: %s", gltfPath);
+		return false;
+	}
+
+	// Load (and compress) textures in parallel
+	sfz::Array<CompressedTexture> textures;
+	textures.init(textureIds.size(), allocator, sfz_dbg(""));
+	for (uint32_t i = 0; i < textureIds.size(); i++) textures.add(CompressedTexture());
+	std::atomic_uint32_t numFailed(0);
+	auto loadTask = [&](uint32_t idx) {
+		const sfz::strID id = textureIds[idx];
+		bool success = loadCompressedTexture(id, textureUsageInMesh(mesh, id),
+			options.blockCompressTextures, allocator, textures[idx]);
+		if (!success) numFailed += 1;
+	};
+	decodePool.parallelFor(textureIds.size(), loadTask);
+	if (numFailed.load() != 0) {
+		SFZ_ERROR("PhantasyTestbed", "Failed to load %u textures for cooking", numFailed.load());
+		return false;
+	}
+	const float loadSecs = std::chrono::duration_cast<std::chrono::duration<float>>(
+		std::chrono::high_resolution_clock::now() - loadStart).count();
+
+	// Vertices are packed one to one, the indices and LODs stay the same
+	sfz::Array<PackedVertex> packedVertices;
+	PackedBounds packedBounds;
+	const void* vertexData = mesh.vertices.data();
+	if (options.packVertices) {
+		packedBounds = calculatePackedBounds(mesh.vertices.data(), mesh.vertices.size());
+		packedVertices.init(mesh.vertices.size(), allocator, sfz_dbg(""));
+		packedVertices.add(PackedVertex(), mesh.vertices.size());
+		packVertices(mesh.vertices.data(), mesh.vertices.size(),
+			packedBounds, packedVertices.data());
+		vertexData = packedVertices.data();
+	}
+
+	// Lay out the package. Materials are stored as is, the texture strIDs in them are recreated
+	// from the texture paths stored in the texture table when the package is loaded.
+	ScenePackageHeader header;
+	header.numVertices = mesh.vertices.size();
+	header.numIndices = mesh.indices.size();
+	header.numComponents = mesh.components.size();
+	header.numMaterials = mesh.materials.size();
+	header.numTextures = textures.size();
+	header.vertexLayout =
+		uint32_t(options.packVertices ? VertexLayout::PACKED : VertexLayout::FULL_FLOAT);
+	header.sizeofVertex =
+		uint32_t(options.packVertices ? sizeof(PackedVertex) : sizeof(sfz::Vertex));
+	header.packedBounds = packedBounds;
+	sfz::Array<const char*> texturePaths;
+	texturePaths.init(textureIds.size(), allocator, sfz_dbg(""));
+	for (sfz::strID id : textureIds) texturePaths.add(id.str());
+	header.sourceHash =
+		scenePackageSourceHash(gltfPath, texturePaths.data(), texturePaths.size(), options);
+
+	uint64_t offset = sizeof(ScenePackageHeader);
+	header.vertices = allocSection(offset, uint64_t(header.sizeofVertex) * header.numVertices);
+	header.indices = allocSection(offset, sizeof(uint32_t) * header.numIndices);
+	header.components = allocSection(offset, sizeof(sfz::MeshComponent) * header.numComponents);
+	header.lods = allocSection(offset, sizeof(ComponentLods) * header.numComponents);
+	header.materials = allocSection(offset, sizeof(sfz::Material) * header.numMaterials);
+	header.textures = allocSection(offset, sizeof(ScenePackageTexture) * header.numTextures);
+
+	sfz::Array<ScenePackageTexture> textureTable;
+	textureTable.init(textures.size(), allocator, sfz_dbg(""));
+	uint64_t numUncompressedBytes = 0;
+	for (uint32_t i = 0; i < textures.size(); i++) {
+		ScenePackageTexture& entry = textureTable.add(ScenePackageTexture());
+		const int pathLen = snprintf(
+			entry.globalPath, SCENE_PACKAGE_PATH_MAX_LEN, "%s", textureIds[i].str());
+		if (pathLen < 0 || uint32_t(pathLen) >= SCENE_PACKAGE_PATH_MAX_LEN) {
+			SFZ_ERROR("PhantasyTestbed", "Texture path too long for scene package: %s",
+				textureIds[i].str());
+			return false;
+		}
+		entry.desc = textures[i].desc;
+		entry.data = allocSection(offset, textures[i].data.size());
+		numUncompressedBytes += uint64_t(entry.desc.width) * uint64_t(entry.desc.height) *
+			uint64_t(entry.desc.bytesPerPixel);
+	}
+
+	// Write package, textures are streamed straight from the loaded textures
+	FILE* file = fopen(packagePath, "wb");
+	if (file == nullptr) {
+		SFZ_ERROR("PhantasyTestbed", "Failed to open \"%s\" for writing", packagePath);
+		return false;
+	}
+	uint64_t currentOffset = 0;
+	ScenePackageSection headerSection;
+	headerSection.numBytes = sizeof(ScenePackageHeader);
+	bool success = writeAt(file, currentOffset, headerSection, &header);
+	success = success && writeAt(file, currentOffset, header.vertices, vertexData);
+	success = success && writeAt(file, currentOffset, header.indices, mesh.indices.data());
+	success = success && writeAt(file, currentOffset, header.components, mesh.components.data());
+	success = success && writeAt(file, currentOffset, header.lods, lods.data());
+	success = success && writeAt(file, currentOffset, header.materials, mesh.materials.data());
+	success = success && writeAt(file, currentOffset, header.textures, textureTable.data());
+	uint64_t numTextureBytes = 0;
+	for (uint32_t i = 0; i < textures.size(); i++) {
+		success = success &&
+			writeAt(file, currentOffset, textureTable[i].data, textures[i].data.data());
+		numTextureBytes += textures[i].data.size();
+	}
+	success = (fclose(file) == 0) && success;
+	if (!success) {
+		SFZ_ERROR("PhantasyTestbed", "Failed to write scene package: %s", packagePath);
+		return false;
+	}
+
+	SFZ_INFO("PhantasyTestbed", "Cooked \"%s\" into \"%s\" (%.1f MiB) in %.2f s",
+		gltfPath, packagePath, float(currentOffset) / (1024.0f * 1024.0f), loadSecs);
+	SFZ_INFO("PhantasyTestbed", "  %u vertices (%s): %.1f MiB (%.1f MiB as sfz::Vertex)",
+		header.numVertices, toString(VertexLayout(header.vertexLayout)),
+		float(header.vertices.numBytes) / (1024.0f * 1024.0f),
+		float(sizeof(sfz::Vertex) * header.numVertices) / (1024.0f * 1024.0f));
+	SFZ_INFO("PhantasyTestbed", "  %u textures: %.1f MiB (%.1f MiB uncompressed)",
+		header.numTextures, float(numTextureBytes) / (1024.0f * 1024.0f),
+		float(numUncompressedBytes) / (1024.0f * 1024.0f));
+	return true;
+}
+
+// ScenePackage: Constructors & destructors
+// ------------------------------------------------------------------------------------------------
+
+bool ScenePackage::init(const char* packagePath, sfz::Allocator* allocator) noexcept
+{
+	this->destroy();
+	if (!mFile.init(packagePath, allocator)) return false;
+
+	// Validate package before handing out any pointers into it
+	const uint64_t fileSize = mFile.size();
+	auto fail = [&](const char* reason) {
+		SFZ_ERROR("PhantasyTestbed", "Invalid scene package \"%s\": %s", packagePath, reason);
+		mFile.destroy();
+		return false;
+	};
+	if (fileSize < sizeof(ScenePackageHeader)) return fail("file too small");
+	const ScenePackageHeader& header = *reinterpret_cast<const ScenePackageHeader*>(mFile.data());
+	if (header.magic != SCENE_PACKAGE_MAGIC) return fail("wrong magic number");
+	if (header.version != SCENE_PACKAGE_VERSION) return fail("wrong version, needs re-cooking");
+	const bool packed = header.vertexLayout == uint32_t(VertexLayout::PACKED);
+	if (!packed && header.vertexLayout != uint32_t(VertexLayout::FULL_FLOAT)) {
+		return fail("unknown vertex layout");
+	}
+	const uint64_t sizeofVertex = packed ? sizeof(PackedVertex) : sizeof(sfz::Vertex);
+	if (header.sizeofVertex != sizeofVertex || header.sizeofMaterial != sizeof(sfz::Material)) {
+		return fail("struct layouts differ, needs re-cooking");
+	}
+
+	const bool sectionsValid =
+		sectionInBounds(header.vertices, fileSize) &&
+		header.vertices.numBytes == sizeofVertex * uint64_t(header.numVertices) &&
+		sectionInBounds(header.indices, fileSize) &&
+		header.indices.numBytes == sizeof(uint32_t) * uint64_t(header.numIndices) &&
+		sectionInBounds(header.components, fileSize) &&
+		header.components.numBytes ==
+			sizeof(sfz::MeshComponent) * uint64_t(header.numComponents) &&
+		sectionInBounds(header.lods, fileSize) &&
+		header.lods.numBytes == sizeof(ComponentLods) * uint64_t(header.numComponents) &&
+		sectionInBounds(header.materials, fileSize) &&
+		header.materials.numBytes == sizeof(sfz::Material) * uint64_t(header.numMaterials) &&
+		sectionInBounds(header.textures, fileSize) &&
+		header.textures.numBytes == sizeof(ScenePackageTexture) * uint64_t(header.numTextures);
+	if (!sectionsValid) return fail("section out of bounds");
+
+	const ComponentLods* lods = this->section<ComponentLods>(header.lods);
+	for (uint32_t i = 0; i < header.numComponents; i++) {
+		if (lods[i].numLods == 0 || lods[i].numLods > MAX_NUM_MESH_LODS) {
+			return fail("invalid LODs");
+		}
+		for (uint32_t j = 0; j < lods[i].numLods; j++) {
+			const MeshLod& lod = lods[i].lods[j];
+			if (lod.firstIndex > header.numIndices ||
+				lod.numIndices > (header.numIndices - lod.firstIndex)) {
+				return fail("invalid LODs");
+			}
+		}
+	}
+
+	const ScenePackageTexture* textures = this->section<ScenePackageTexture>(header.textures);
+	for (uint32_t i = 0; i < header.numTextures; i++) {
+		const ScenePackageTexture& tex = textures[i];
+		const bool validFormat = uint32_t(tex.desc.format) <= uint32_t(BlockFormat::BC5);
+		if (!validFormat || !sectionInBounds(tex.data, fileSize) ||
+			tex.data.numBytes != tex.desc.dataSize() ||
+			tex.globalPath[SCENE_PACKAGE_PATH_MAX_LEN - 1] != '\0') {
+			return fail("invalid texture");
+		}
+	}
+
+	mHeader = &header;
+	return true;
+}
+
+void ScenePackage::destroy() noexcept
+{
+	mHeader = nullptr;
+	mFile.destroy();
+}
+
+// ScenePackage: Methods
+// ------------------------------------------------------------------------------------------------
+
+bool ScenePackage::isUpToDate(const char* gltfPath, const GltfLoadOptions& options) const noexcept
+{
+	// Same as scenePackageSourceHash(), with the texture paths from the texture table
+	uint64_t hash = hashFileStamp(SOURCE_HASH_SEED, gltfPath);
+	for (uint32_t i = 0; i < mHeader->numTextures; i++) {
+		hash = hashFileStamp(hash, texture(i).globalPath);
+	}
+	return hashLoadOptions(hash, options) == mHeader->sourceHash;
+}
+
+sfz::Mesh ScenePackage::createMesh(sfz::Allocator* allocator) const noexcept
+{
+	sfz_assert(isValid());
+	sfz::Mesh mesh;
+	mesh.vertices.init(mHeader->numVertices, allocator, sfz_dbg(""));
+	if (vertexLayout() == VertexLayout::PACKED) {
+		mesh.vertices.add(sfz::Vertex(), mHeader->numVertices);
+		unpackVertices(section<PackedVertex>(mHeader->vertices), mHeader->numVertices,
+			mHeader->packedBounds, mesh.vertices.data());
+	}
+	else {
+		mesh.vertices.add(section<sfz::Vertex>(mHeader->vertices), mHeader->numVertices);
+	}
+	mesh.indices.init(mHeader->numIndices, allocator, sfz_dbg(""));
+	mesh.indices.add(section<uint32_t>(mHeader->indices), mHeader->numIndices);
+	mesh.components.init(mHeader->numComponents, allocator, sfz_dbg(""));
+	mesh.components.add(section<sfz::MeshComponent>(mHeader->components), mHeader->numComponents);
+	mesh.materials.init(mHeader->numMaterials, allocator, sfz_dbg(""));
+	mesh.materials.add(section<sfz::Material>(mHeader->materials), mHeader->numMaterials);
+	return mesh;
+}
+
+const ScenePackageTexture& ScenePackage::texture(uint32_t idx) const
+{
+	sfz_assert(isValid());
+	sfz_assert(idx < mHeader->numTextures);
+	return section<ScenePackageTexture>(mHeader->textures)[idx];
+}
+
+bool ScenePackage::textureIsCompressed(uint32_t idx) const
+{
+	return this->texture(idx).desc.format != BlockFormat::NONE;
+}
+
+sfz::ImageViewConst ScenePackage::textureView(uint32_t idx) const
+{
+	const ScenePackageTexture& tex = this->texture(idx);
+	sfz_assert(tex.desc.format == BlockFormat::NONE);
+	sfz::ImageViewConst view;
+	view.rawData = mFile.data() + tex.data.offset;
+	view.type = tex.desc.type;
+	view.width = tex.desc.width;
+	view.height = tex.desc.height;
+	return view;
+}
+
+sfz::Image ScenePackage::decompressTexture(uint32_t idx, sfz::Allocator* allocator) const noexcept
+{
+	const ScenePackageTexture& tex = this->texture(idx);
+	return ::decompressTexture(tex.desc, mFile.data() + tex.data.offset, allocator);
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <skipifzero.hpp>
+#include <skipifzero_arrays.hpp>
+
+#include <sfz/rendering/Image.hpp>
+#include <sfz/rendering/Mesh.hpp>
+
+#include "CompressedTexture.hpp"
+#include "GltfStreamer.hpp"
+#include "MappedFile.hpp"
+#include "VertexPacking.hpp"
+#include "WorkerPool.hpp"
+
+// Scene package format
+// ------------------------------------------------------------------------------------------------
+
+// A scene package is a cooked version of a gltf file: a single binary file containing the mesh
+// and all textures already decoded (and possibly block compressed), so it can be memory mapped
+// and handed straight to the upload path. All sections are aligned to SCENE_PACKAGE_ALIGNMENT
+// bytes from the start of the file.
+//
+// The vertices are stored either as sfz::Vertex or as PackedVertex (quantized according to
+// packedBounds), depending on the vertexLayout field in the header. Packed vertices only make the
+// package smaller, they are unpacked to sfz::Vertex when the package is loaded.
+//
+// Everything is stored in native (little-endian) layout, packages are not meant to be portable
+// between platforms with different struct layouts and should simply be re-cooked.
+//
+// The header contains a hash of the source files' stamps and the load options (see
+// scenePackageSourceHash()), a package is stale if the gltf file, any of its textures or the
+// options have changed since it was cooked.
+
+constexpr uint32_t SCENE_PACKAGE_MAGIC = 0x43535850; // "PXSC"
+constexpr uint32_t SCENE_PACKAGE_VERSION = 6;
+constexpr uint64_t SCENE_PACKAGE_ALIGNMENT = 256;
+constexpr uint32_t SCENE_PACKAGE_PATH_MAX_LEN = 192;
+
+struct ScenePackageSection final {
+	uint64_t offset = 0;
+	uint64_t numBytes = 0;
+};
+
+struct ScenePackageHeader final {
+	uint32_t magic = SCENE_PACKAGE_MAGIC;
+	uint32_t version = SCENE_PACKAGE_VERSION;
+	uint32_t numVertices = 0;
+	uint32_t numIndices = 0;
+	uint32_t numComponents = 0;
+	uint32_t numMaterials = 0;
+	uint32_t numTextures = 0;
+	uint32_t sizeofVertex = sizeof(sfz::Vertex); // Sanity checks for the struct layouts
+	uint32_t sizeofMaterial = sizeof(sfz::Material);
+	uint32_t vertexLayout = uint32_t(VertexLayout::FULL_FLOAT);
+	uint64_t sourceHash = 0;
+	PackedBounds packedBounds; // Only used if packed
+	ScenePackageSection vertices; // sfz::Vertex or PackedVertex [numVertices]
+	ScenePackageSection indices; // uint32_t[numIndices]
+	ScenePackageSection components; // sfz::MeshComponent[numComponents]
+	ScenePackageSection lods; // ComponentLods[numComponents]
+	ScenePackageSection materials; // sfz::Material[numMaterials]
+	ScenePackageSection textures; // ScenePackageTexture[numTextures]
+};
+
+struct ScenePackageTexture final {
+	char globalPath[SCENE_PACKAGE_PATH_MAX_LEN] = {}; // The texture's strID is created from this
+	CompressedTextureDesc desc;
+	ScenePackageSection data;
+};
+
+// Cooking
+// ------------------------------------------------------------------------------------------------
+
+// Hash of the stamps (size and modification time) of the gltf file and its textures, together
+// with the load options. Missing files are hashed as empty stamps.
+uint64_t scenePackageSourceHash(
+	const char* gltfPath,
+	const char* const* texturePaths,
+	uint32_t numTextures,
+	const GltfLoadOptions& options) noexcept;
+
+// Loads a gltf file (decoding its images on the given worker pool) and writes it as a scene
+// package to the given path. The mesh and textures are processed according to the given options,
+// textures are block compressed if options.blockCompressTextures is set.
+bool cookScenePackage(
+	const char* gltfPath,
+	const char* packagePath,
+	WorkerPool& decodePool,
+	const GltfLoadOptions& options,
+	sfz::Allocator* allocator) noexcept;
+
+// ScenePackage
+// ------------------------------------------------------------------------------------------------
+
+// A memory mapped scene package. Uncompressed textures are accessed as image views pointing
+// directly into the mapped file, so they are only valid as long as the package is. Compressed
+// textures need to be decompressed before they can be uploaded.
+class ScenePackage final {
+public:
+	// Constructors & destructors
+	// --------------------------------------------------------------------------------------------
+
+	ScenePackage() noexcept = default;
+	ScenePackage(const ScenePackage&) = delete;
+	ScenePackage& operator= (const ScenePackage&) = delete;
+	ScenePackage(ScenePackage&&) = delete;
+	ScenePackage& operator= (ScenePackage&&) = delete;
+	~ScenePackage() noexcept { this->destroy(); }
+
+	// Maps and validates the package, returns false if it is missing or invalid.
+	bool init(const char* packagePath, sfz::Allocator* allocator) noexcept;
+	void destroy() noexcept;
+
+	// Methods
+	// --------------------------------------------------------------------------------------------
+
+	bool isValid() const { return mHeader != nullptr; }
+	const ScenePackageHeader& header() const { return *mHeader; }
+
+	// Whether the package was cooked from the current versions of the gltf file and its textures,
+	// with the given options.
+	bool isUpToDate(const char* gltfPath, const GltfLoadOptions& options) const noexcept;
+
+	// Copies the mesh out of the package, the renderer's upload path takes a sfz::Mesh. Packed
+	// vertices are unpacked.
+	sfz::Mesh createMesh(sfz::Allocator* allocator) const noexcept;
+	VertexLayout vertexLayout() const { return VertexLayout(mHeader->vertexLayout); }
+
+	// One entry per component, points into the mapped file
+	const ComponentLods* lods() const { return section<ComponentLods>(mHeader->lods); }
+
+	uint32_t numTextures() const { return mHeader->numTextures; }
+	const ScenePackageTexture& texture(uint32_t idx) const;
+	bool textureIsCompressed(uint32_t idx) const;
+	sfz::ImageViewConst textureView(uint32_t idx) const; // Only for uncompressed textures
+	sfz::Image decompressTexture(uint32_t idx, sfz::Allocator* allocator) const noexcept;
+
+private:
+	template<typename T>
+	const T* section(const ScenePackageSection& section) const
+	{
+		return reinterpret_cast<const T*>(mFile.data() + section.offset);
+	}
+
+	MappedFile mFile;
+	const ScenePackageHeader* mHeader = nullptr;
+};
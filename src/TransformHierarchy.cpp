@@ -0,0 +1,184 @@
+#include "TransformHierarchy.hpp"
+
+using sfz::mat34;
+using sfz::vec4;
+
+// Statics
+// ------------------------------------------------------------------------------------------------
+
+// Returns lhs * rhs, both treated as affine 4x4 matrices with bottom row 0, 0, 0, 1
+static mat34 multiplyAffine(const mat34& lhs, const mat34& rhs) noexcept
+{
+	mat34 result;
+	for (uint32_t r = 0; r < 3; r++) {
+		const vec4 lhsRow = lhs.row(r);
+		result.row(r) = lhsRow.x * rhs.row(0) + lhsRow.y * rhs.row(1) + lhsRow.z * rhs.row(2) +
+			vec4(0.0f, 0.0f, 0.0f, lhsRow.w);
+	}
+	return result;
+}
+
+// TransformHierarchy: Methods
+// ------------------------------------------------------------------------------------------------
+
+void TransformHierarchy::init(uint32_t capacity, sfz::Allocator* allocator) noexcept
+{
+	mNodes.init(capacity, allocator);
+	mDirty.init(capacity, allocator, sfz_dbg("TransformHierarchy::mDirty"));
+	mStack.init(64, allocator, sfz_dbg("TransformHierarchy::mStack"));
+	mUpdateOrder.init(capacity, allocator, sfz_dbg("TransformHierarchy::mUpdateOrder"));
+	mUpdateTransforms.init(capacity, allocator);
+	mUpdateLocals.init(capacity, allocator, sfz_dbg("TransformHierarchy::mUpdateLocals"));
+}
+
+void TransformHierarchy::add(uint32_t entityIdx, const Transform& transform) noexcept
+{
+	if (Transform* existing = this->edit(entityIdx)) {
+		*existing = transform;
+		return;
+	}
+	Node node;
+	node.local = transform;
+	node.world = transform.matrix();
+	markDirty(entityIdx, mNodes.add(entityIdx, node));
+}
+
+bool TransformHierarchy::remove(uint32_t entityIdx) noexcept
+{
+	Node* node = mNodes.get(entityIdx);
+	if (node == nullptr) return false;
+	detach(*node);
+	while (node->firstChild != ~0u) {
+		const uint32_t childIdx = node->firstChild;
+		Node& child = *mNodes.get(childIdx);
+		detach(child);
+		markDirty(childIdx, child);
+	}
+	return mNodes.remove(entityIdx);
+}
+
+const Transform* TransformHierarchy::get(uint32_t entityIdx) const
+{
+	const Node* node = mNodes.get(entityIdx);
+	return node != nullptr ? &node->local : nullptr;
+}
+
+Transform* TransformHierarchy::edit(uint32_t entityIdx) noexcept
+{
+	Node* node = mNodes.get(entityIdx);
+	if (node == nullptr) return nullptr;
+	markDirty(entityIdx, *node);
+	return &node->local;
+}
+
+uint32_t TransformHierarchy::parent(uint32_t entityIdx) const
+{
+	const Node* node = mNodes.get(entityIdx);
+	return node != nullptr ? node->parent : ~0u;
+}
+
+bool TransformHierarchy::setParent(uint32_t entityIdx, uint32_t parentIdx) noexcept
+{
+	Node* node = mNodes.get(entityIdx);
+	if (node == nullptr) return false;
+	if (node->parent == parentIdx) return true;
+	if (parentIdx != ~0u) {
+		if (!mNodes.has(parentIdx)) return false;
+		for (uint32_t idx = parentIdx; idx != ~0u; idx = mNodes.get(idx)->parent) {
+			if (idx == entityIdx) return false;
+		}
+	}
+
+	detach(*node);
+	if (parentIdx != ~0u) {
+		Node& parentNode = *mNodes.get(parentIdx);
+		node->parent = parentIdx;
+		node->nextSibling = parentNode.firstChild;
+		if (parentNode.firstChild != ~0u) {
+			mNodes.get(parentNode.firstChild)->prevSibling = entityIdx;
+		}
+		parentNode.firstChild = entityIdx;
+	}
+	markDirty(entityIdx, *node);
+	return true;
+}
+
+mat34 TransformHierarchy::world(uint32_t entityIdx) const
+{
+	const Node* node = mNodes.get(entityIdx);
+	return node != nullptr ? node->world : Transform().matrix();
+}
+
+uint32_t TransformHierarchy::update() noexcept
+{
+	// Find the transforms to recompute, each dirty subtree in depth first order so that parents
+	// come before their children
+	mUpdateOrder.clear();
+	for (uint32_t entityIdx : mDirty) {
+
+		// Skip removed transforms and those already added as part of a dirty ancestor's subtree
+		const Node* node = mNodes.get(entityIdx);
+		if (node == nullptr || !node->dirty) continue;
+
+		// Start from the topmost dirty ancestor, its parent's world matrix is up to date
+		uint32_t rootIdx = entityIdx;
+		for (uint32_t idx = node->parent; idx != ~0u; idx = mNodes.get(idx)->parent) {
+			if (mNodes.get(idx)->dirty) rootIdx = idx;
+		}
+
+		mStack.clear();
+		mStack.add(rootIdx);
+		while (!mStack.isEmpty()) {
+			const uint32_t idx = mStack.pop();
+			Node& subtreeNode = *mNodes.get(idx);
+			subtreeNode.dirty = false;
+			mUpdateOrder.add(idx);
+			for (uint32_t child = subtreeNode.firstChild; child != ~0u;
+				child = mNodes.get(child)->nextSibling) {
+				mStack.add(child);
+			}
+		}
+	}
+	mDirty.clear();
+	if (mUpdateOrder.isEmpty()) return 0;
+
+	// Local matrices are calculated in batches, then combined with the parents' world matrices
+	mUpdateTransforms.clear();
+	for (uint32_t idx : mUpdateOrder) {
+		const Transform& local = mNodes.get(idx)->local;
+		mUpdateTransforms.add(local.rotation, local.scale, local.translation);
+	}
+	mUpdateLocals.clear();
+	computeModelMatrices(mUpdateTransforms, mUpdateLocals);
+	for (uint32_t i = 0; i < mUpdateOrder.size(); i++) {
+		Node& node = *mNodes.get(mUpdateOrder[i]);
+		node.world = node.parent == ~0u ?
+			mUpdateLocals[i] : multiplyAffine(mNodes.get(node.parent)->world, mUpdateLocals[i]);
+	}
+	return mUpdateOrder.size();
+}
+
+// TransformHierarchy: Private methods
+// ------------------------------------------------------------------------------------------------
+
+void TransformHierarchy::markDirty(uint32_t entityIdx, Node& node) noexcept
+{
+	if (node.dirty) return;
+	node.dirty = true;
+	mDirty.add(entityIdx);
+}
+
+void TransformHierarchy::detach(Node& node) noexcept
+{
+	if (node.parent == ~0u) return;
+	if (node.prevSibling != ~0u) {
+		mNodes.get(node.prevSibling)->nextSibling = node.nextSibling;
+	}
+	else {
+		mNodes.get(node.parent)->firstChild = node.nextSibling;
+	}
+	if (node.nextSibling != ~0u) mNodes.get(node.nextSibling)->prevSibling = node.prevSibling;
+	node.parent = ~0u;
+	node.prevSibling = ~0u;
+	node.nextSibling = ~0u;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <skipifzero.hpp>
+#include <skipifzero_arrays.hpp>
+#include <skipifzero_math.hpp>
+
+#include "EntityStore.hpp"
+#include "TransformKernels.hpp"
+
+// Transform
+// ------------------------------------------------------------------------------------------------
+
+// Transform of an entity relative to its parent (or the world if it has none)
+struct Transform final {
+	sfz::quat rotation = sfz::quat::identity();
+	sfz::vec3 scale = sfz::vec3(1.0f);
+	sfz::vec3 translation = sfz::vec3(0.0f);
+
+	sfz::mat34 matrix() const
+	{
+		// Apply rotation first
+		sfz::mat34 tmp = rotation.toMat34();
+
+		// Matrix multiply in scale (order does not matter)
+		sfz::vec4 scaleVec = sfz::vec4(scale, 1.0f);
+		tmp.row(0) *= scaleVec;
+		tmp.row(1) *= scaleVec;
+		tmp.row(2) *= scaleVec;
+
+		// Add translation (last)
+		tmp.setColumn(3, translation);
+
+		return tmp;
+	}
+};
+
+// TransformHierarchy
+// ------------------------------------------------------------------------------------------------
+
+// The Transform components of entities, each with an optional parent, together with their cached
+// world matrices. Changing a transform (or its parent) marks it as dirty, update() then
+// recomputes the world matrices of the dirty transforms and all their descendants. Transforms
+// that don't change are never recomputed.
+class TransformHierarchy final {
+public:
+	void init(uint32_t capacity, sfz::Allocator* allocator) noexcept;
+
+	uint32_t size() const { return mNodes.size(); }
+	bool has(uint32_t entityIdx) const { return mNodes.has(entityIdx); }
+
+	// Adds (or overwrites) the transform of the specified entity. New transforms have no parent.
+	void add(uint32_t entityIdx, const Transform& transform) noexcept;
+
+	// Removes the transform of the specified entity, its children are detached and become roots.
+	bool remove(uint32_t entityIdx) noexcept;
+
+	// Returns nullptr if the entity has no transform. edit() marks the transform as dirty.
+	const Transform* get(uint32_t entityIdx) const;
+	Transform* edit(uint32_t entityIdx) noexcept;
+
+	// Entity index of the parent, ~0u if none (or no transform).
+	uint32_t parent(uint32_t entityIdx) const;
+
+	// Sets the parent (~0u to detach it), which must also have a transform. Fails if the parent
+	// is the entity itself or one of its descendants.
+	bool setParent(uint32_t entityIdx, uint32_t parentIdx) noexcept;
+
+	// The world matrix as of the last update(), identity if the entity has no transform.
+	sfz::mat34 world(uint32_t entityIdx) const;
+
+	// Recomputes the world matrices of all dirty transforms and their descendants, parents before
+	// children. Returns the number of world matrices recomputed.
+	uint32_t update() noexcept;
+
+private:
+	struct Node final {
+		Transform local;
+		sfz::mat34 world;
+		uint32_t parent = ~0u;
+		uint32_t firstChild = ~0u;
+		uint32_t prevSibling = ~0u;
+		uint32_t nextSibling = ~0u;
+		bool dirty = false;
+	};
+
+	void markDirty(uint32_t entityIdx, Node& node) noexcept;
+	void detach(Node& node) noexcept;
+
+	ComponentArray<Node> mNodes;
+	sfz::Array<uint32_t> mDirty; // Entities marked dirty since the last update()
+
+	// Temp storage for update()
+	sfz::Array<uint32_t> mStack;
+	sfz::Array<uint32_t> mUpdateOrder;
+	TransformArrays mUpdateTransforms;
+	sfz::Array<sfz::mat34> mUpdateLocals;
+};
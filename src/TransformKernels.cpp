@@ -0,0 +1,391 @@
+#include "TransformKernels.hpp"
+
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+
+#include <sfz/Logging.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TRANSFORM_KERNELS_USE_SSE2 1
+#include <emmintrin.h>
+#else
+#define TRANSFORM_KERNELS_USE_SSE2 0
+#endif
+
+using sfz::mat34;
+using sfz::mat4;
+using sfz::quat;
+using sfz::vec3;
+using sfz::vec4;
+
+// Statics
+// ------------------------------------------------------------------------------------------------
+
+// Number of times each version is run by the microbenchmark, the fastest run is reported
+constexpr uint32_t TRANSFORM_BENCHMARK_NUM_ITERATIONS = 100;
+
+// Scalar versions of the kernels, used for the transforms that don't fill a SIMD batch (and for
+// all of them without SSE2). Same math as the SIMD versions.
+
+static void computeModelMatrixScalar(
+	const TransformArrays& transforms, uint32_t idx, mat34& modelMatrixOut) noexcept
+{
+	const float x = transforms.rotation[0][idx];
+	const float y = transforms.rotation[1][idx];
+	const float z = transforms.rotation[2][idx];
+	const float w = transforms.rotation[3][idx];
+	const float sx = transforms.scale[0][idx];
+	const float sy = transforms.scale[1][idx];
+	const float sz = transforms.scale[2][idx];
+	modelMatrixOut.row(0) = vec4(
+		(1.0f - 2.0f * (y * y + z * z)) * sx,
+		2.0f * (x * y - z * w) * sy,
+		2.0f * (x * z + y * w) * sz,
+		transforms.translation[0][idx]);
+	modelMatrixOut.row(1) = vec4(
+		2.0f * (x * y + z * w) * sx,
+		(1.0f - 2.0f * (x * x + z * z)) * sy,
+		2.0f * (y * z - x * w) * sz,
+		transforms.translation[1][idx]);
+	modelMatrixOut.row(2) = vec4(
+		2.0f * (x * z - y * w) * sx,
+		2.0f * (y * z + x * w) * sy,
+		(1.0f - 2.0f * (x * x + y * y)) * sz,
+		transforms.translation[2][idx]);
+}
+
+static void computeDrawMatricesScalar(
+	const mat4& viewMatrix, const mat34& modelMatrix, DrawMatrices& matricesOut) noexcept
+{
+	// modelView = view * model, the bottom row of both is 0, 0, 0, 1
+	mat4& mv = matricesOut.modelViewMatrix;
+	for (uint32_t r = 0; r < 3; r++) {
+		const vec4 viewRow = viewMatrix.row(r);
+		mv.row(r) = viewRow.x * modelMatrix.row(0) + viewRow.y * modelMatrix.row(1) +
+			viewRow.z * modelMatrix.row(2) + vec4(0.0f, 0.0f, 0.0f, viewRow.w);
+	}
+	mv.row(3) = vec4(0.0f, 0.0f, 0.0f, 1.0f);
+
+	// The inverse transpose of the upper 3x3 part is its cofactor matrix divided by its
+	// determinant. The translation only ends up in the bottom row.
+	const vec4 a0 = mv.row(0);
+	const vec4 a1 = mv.row(1);
+	const vec4 a2 = mv.row(2);
+	const vec3 c0 = vec3(
+		a1.y * a2.z - a1.z * a2.y, a1.z * a2.x - a1.x * a2.z, a1.x * a2.y - a1.y * a2.x);
+	const vec3 c1 = vec3(
+		a0.z * a2.y - a0.y * a2.z, a0.x * a2.z - a0.z * a2.x, a0.y * a2.x - a0.x * a2.y);
+	const vec3 c2 = vec3(
+		a0.y * a1.z - a0.z * a1.y, a0.z * a1.x - a0.x * a1.z, a0.x * a1.y - a0.y * a1.x);
+	const float invDet = 1.0f / (a0.x * c0.x + a0.y * c0.y + a0.z * c0.z);
+	const vec3 n0 = c0 * invDet;
+	const vec3 n1 = c1 * invDet;
+	const vec3 n2 = c2 * invDet;
+	mat4& normal = matricesOut.normalMatrix;
+	normal.row(0) = vec4(n0, 0.0f);
+	normal.row(1) = vec4(n1, 0.0f);
+	normal.row(2) = vec4(n2, 0.0f);
+	normal.row(3) = vec4(-(n0 * a0.w + n1 * a1.w + n2 * a2.w), 1.0f);
+}
+
+// TransformArrays
+// ------------------------------------------------------------------------------------------------
+
+void TransformArrays::init(uint32_t capacity, sfz::Allocator* allocator) noexcept
+{
+	for (sfz::Array<float>& array : rotation) array.init(capacity, allocator, sfz_dbg(""));
+	for (sfz::Array<float>& array : scale) array.init(capacity, allocator, sfz_dbg(""));
+	for (sfz::Array<float>& array : translation) array.init(capacity, allocator, sfz_dbg(""));
+}
+
+void TransformArrays::clear() noexcept
+{
+	for (sfz::Array<float>& array : rotation) array.clear();
+	for (sfz::Array<float>& array : scale) array.clear();
+	for (sfz::Array<float>& array : translation) array.clear();
+}
+
+void TransformArrays::add(const quat& rotationIn, vec3 scaleIn, vec3 translationIn) noexcept
+{
+	for (uint32_t i = 0; i < 4; i++) rotation[i].add(rotationIn.vector[i]);
+	for (uint32_t i = 0; i < 3; i++) scale[i].add(scaleIn[i]);
+	for (uint32_t i = 0; i < 3; i++) translation[i].add(translationIn[i]);
+}
+
+// Transform kernels
+// ------------------------------------------------------------------------------------------------
+
+void computeModelMatrices(
+	const TransformArrays& transforms, sfz::Array<mat34>& modelMatricesOut) noexcept
+{
+	const uint32_t numTransforms = transforms.size();
+	if (numTransforms == 0) return;
+	const uint32_t firstOut = modelMatricesOut.size();
+	modelMatricesOut.add(mat34(), numTransforms);
+	mat34* out = modelMatricesOut.data() + firstOut;
+
+	uint32_t i = 0;
+#if TRANSFORM_KERNELS_USE_SSE2
+	// 4 transforms at a time, with one transform per SIMD lane
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 two = _mm_set1_ps(2.0f);
+	for (; (i + 4) <= numTransforms; i += 4) {
+		const __m128 x = _mm_loadu_ps(transforms.rotation[0].data() + i);
+		const __m128 y = _mm_loadu_ps(transforms.rotation[1].data() + i);
+		const __m128 z = _mm_loadu_ps(transforms.rotation[2].data() + i);
+		const __m128 w = _mm_loadu_ps(transforms.rotation[3].data() + i);
+		const __m128 sx = _mm_loadu_ps(transforms.scale[0].data() + i);
+		const __m128 sy = _mm_loadu_ps(transforms.scale[1].data() + i);
+		const __m128 sz = _mm_loadu_ps(transforms.scale[2].data() + i);
+
+		const __m128 xx = _mm_mul_ps(x, x);
+		const __m128 yy = _mm_mul_ps(y, y);
+		const __m128 zz = _mm_mul_ps(z, z);
+		const __m128 xy = _mm_mul_ps(x, y);
+		const __m128 xz = _mm_mul_ps(x, z);
+		const __m128 yz = _mm_mul_ps(y, z);
+		const __m128 xw = _mm_mul_ps(x, w);
+		const __m128 yw = _mm_mul_ps(y, w);
+		const __m128 zw = _mm_mul_ps(z, w);
+
+		// rows[r][c], element (r, c) of the 4 matrices
+		__m128 rows[3][4];
+		rows[0][0] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx);
+		rows[0][1] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, zw)), sy);
+		rows[0][2] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, yw)), sz);
+		rows[1][0] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, zw)), sx);
+		rows[1][1] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy);
+		rows[1][2] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, xw)), sz);
+		rows[2][0] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, yw)), sx);
+		rows[2][1] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, xw)), sy);
+		rows[2][2] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz);
+		for (uint32_t r = 0; r < 3; r++) {
+			rows[r][3] = _mm_loadu_ps(transforms.translation[r].data() + i);
+		}
+
+		// Transpose back to one matrix row per register
+		for (uint32_t r = 0; r < 3; r++) {
+			_MM_TRANSPOSE4_PS(rows[r][0], rows[r][1], rows[r][2], rows[r][3]);
+			for (uint32_t lane = 0; lane < 4; lane++) {
+				_mm_storeu_ps(out[i + lane].row(r).data(), rows[r][lane]);
+			}
+		}
+	}
+#endif
+	for (; i < numTransforms; i++) {
+		computeModelMatrixScalar(transforms, i, out[i]);
+	}
+}
+
+void computeDrawMatrices(
+	const mat4& viewMatrix,
+	const mat34* modelMatrices,
+	const uint32_t* indices,
+	uint32_t numIndices,
+	sfz::Array<DrawMatrices>& drawMatricesOut) noexcept
+{
+	if (numIndices == 0) return;
+	const uint32_t firstOut = drawMatricesOut.size();
+	drawMatricesOut.add(DrawMatrices(), numIndices);
+	DrawMatrices* out = drawMatricesOut.data() + firstOut;
+
+	uint32_t i = 0;
+#if TRANSFORM_KERNELS_USE_SSE2
+	__m128 view[3][4];
+	for (uint32_t r = 0; r < 3; r++) {
+		for (uint32_t c = 0; c < 4; c++) view[r][c] = _mm_set1_ps(viewMatrix.row(r)[c]);
+	}
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	// 4 matrices at a time, with one matrix per SIMD lane
+	for (; (i + 4) <= numIndices; i += 4) {
+
+		// model[r][c], element (r, c) of the 4 model matrices
+		__m128 model[3][4];
+		for (uint32_t r = 0; r < 3; r++) {
+			for (uint32_t lane = 0; lane < 4; lane++) {
+				model[r][lane] = _mm_loadu_ps(modelMatrices[indices[i + lane]].row(r).data());
+			}
+			_MM_TRANSPOSE4_PS(model[r][0], model[r][1], model[r][2], model[r][3]);
+		}
+
+		// modelView = view * model, the bottom row of both is 0, 0, 0, 1
+		__m128 mv[3][4];
+		for (uint32_t r = 0; r < 3; r++) {
+			for (uint32_t c = 0; c < 4; c++) {
+				__m128 sum = _mm_add_ps(
+					_mm_mul_ps(view[r][0], model[0][c]), _mm_mul_ps(view[r][1], model[1][c]));
+				sum = _mm_add_ps(sum, _mm_mul_ps(view[r][2], model[2][c]));
+				mv[r][c] = c == 3 ? _mm_add_ps(sum, view[r][3]) : sum;
+			}
+		}
+
+		// Normal matrix, see computeDrawMatricesScalar()
+		auto cofactor = [&](uint32_t r0, uint32_t c0, uint32_t r1, uint32_t c1) {
+			return _mm_sub_ps(
+				_mm_mul_ps(mv[r0][c0], mv[r1][c1]), _mm_mul_ps(mv[r0][c1], mv[r1][c0]));
+		};
+		__m128 normal[4][4];
+		normal[0][0] = cofactor(1, 1, 2, 2);
+		normal[0][1] = cofactor(1, 2, 2, 0);
+		normal[0][2] = cofactor(1, 0, 2, 1);
+		normal[1][0] = cofactor(0, 2, 2, 1);
+		normal[1][1] = cofactor(0, 0, 2, 2);
+		normal[1][2] = cofactor(0, 1, 2, 0);
+		normal[2][0] = cofactor(0, 1, 1, 2);
+		normal[2][1] = cofactor(0, 2, 1, 0);
+		normal[2][2] = cofactor(0, 0, 1, 1);
+		__m128 det = _mm_mul_ps(mv[0][0], normal[0][0]);
+		det = _mm_add_ps(det, _mm_mul_ps(mv[0][1], normal[0][1]));
+		det = _mm_add_ps(det, _mm_mul_ps(mv[0][2], normal[0][2]));
+		const __m128 invDet = _mm_div_ps(one, det);
+		for (uint32_t r = 0; r < 3; r++) {
+			for (uint32_t c = 0; c < 3; c++) normal[r][c] = _mm_mul_ps(normal[r][c], invDet);
+			normal[r][3] = zero;
+		}
+		for (uint32_t c = 0; c < 3; c++) {
+			__m128 sum = _mm_mul_ps(normal[0][c], mv[0][3]);
+			sum = _mm_add_ps(sum, _mm_mul_ps(normal[1][c], mv[1][3]));
+			sum = _mm_add_ps(sum, _mm_mul_ps(normal[2][c], mv[2][3]));
+			normal[3][c] = _mm_sub_ps(zero, sum);
+		}
+		normal[3][3] = one;
+
+		// Transpose back to one matrix row per register
+		for (uint32_t r = 0; r < 3; r++) {
+			_MM_TRANSPOSE4_PS(mv[r][0], mv[r][1], mv[r][2], mv[r][3]);
+			for (uint32_t lane = 0; lane < 4; lane++) {
+				_mm_storeu_ps(out[i + lane].modelViewMatrix.row(r).data(), mv[r][lane]);
+			}
+		}
+		for (uint32_t r = 0; r < 4; r++) {
+			_MM_TRANSPOSE4_PS(normal[r][0], normal[r][1], normal[r][2], normal[r][3]);
+			for (uint32_t lane = 0; lane < 4; lane++) {
+				_mm_storeu_ps(out[i + lane].normalMatrix.row(r).data(), normal[r][lane]);
+			}
+		}
+		for (uint32_t lane = 0; lane < 4; lane++) {
+			out[i + lane].modelViewMatrix.row(3) = vec4(0.0f, 0.0f, 0.0f, 1.0f);
+		}
+	}
+#endif
+	for (; i < numIndices; i++) {
+		computeDrawMatricesScalar(viewMatrix, modelMatrices[indices[i]], out[i]);
+	}
+}
+
+// Microbenchmark
+// ------------------------------------------------------------------------------------------------
+
+void benchmarkTransformKernels(uint32_t numTransforms, sfz::Allocator* allocator) noexcept
+{
+	// Random transforms, with a fixed seed so that runs are comparable
+	uint32_t seed = 1;
+	auto random = [&](float min, float max) {
+		seed = seed * 1664525u + 1013904223u;
+		return min + (max - min) * (float(seed >> 8) * (1.0f / 16777216.0f));
+	};
+	auto randomRotation = [&]() {
+		quat rotation;
+		rotation.vector = sfz::normalize(
+			vec4(random(-1.0f, 1.0f), random(-1.0f, 1.0f), random(-1.0f, 1.0f), 1.0f));
+		return rotation;
+	};
+	TransformArrays transforms;
+	transforms.init(numTransforms, allocator);
+	sfz::Array<uint32_t> indices(numTransforms, allocator, sfz_dbg(""));
+	for (uint32_t i = 0; i < numTransforms; i++) {
+		const vec3 scale = vec3(random(0.5f, 2.0f), random(0.5f, 2.0f), random(0.5f, 2.0f));
+		const vec3 translation =
+			vec3(random(-100.0f, 100.0f), random(-100.0f, 100.0f), random(-100.0f, 100.0f));
+		transforms.add(randomRotation(), scale, translation);
+		indices.add(i);
+	}
+	mat4 viewMatrix = mat4(randomRotation().toMat34());
+	viewMatrix.setColumn(3, vec4(random(-10.0f, 10.0f), random(-10.0f, 10.0f), -5.0f, 1.0f));
+
+	auto fastestMs = [](auto&& func) {
+		float bestMs = FLT_MAX;
+		for (uint32_t i = 0; i < TRANSFORM_BENCHMARK_NUM_ITERATIONS; i++) {
+			auto start = std::chrono::high_resolution_clock::now();
+			func();
+			const float secs = std::chrono::duration_cast<std::chrono::duration<float>>(
+				std::chrono::high_resolution_clock::now() - start).count();
+			bestMs = sfz::min(bestMs, secs * 1000.0f);
+		}
+		return bestMs;
+	};
+
+	// The scalar path, one transform at a time as RenderEntity::transform() and the geometry
+	// passes did before
+	sfz::Array<mat34> scalarModels(numTransforms, allocator, sfz_dbg(""));
+	sfz::Array<DrawMatrices> scalarDraws(numTransforms, allocator, sfz_dbg(""));
+	const float scalarModelMs = fastestMs([&]() {
+		scalarModels.clear();
+		for (uint32_t i = 0; i < numTransforms; i++) {
+			quat rotation;
+			for (uint32_t j = 0; j < 4; j++) rotation.vector[j] = transforms.rotation[j][i];
+			const vec4 scale = vec4(
+				transforms.scale[0][i], transforms.scale[1][i], transforms.scale[2][i], 1.0f);
+			mat34 model = rotation.toMat34();
+			model.row(0) *= scale;
+			model.row(1) *= scale;
+			model.row(2) *= scale;
+			model.setColumn(3, vec3(transforms.translation[0][i],
+				transforms.translation[1][i], transforms.translation[2][i]));
+			scalarModels.add(model);
+		}
+	});
+	const float scalarDrawMs = fastestMs([&]() {
+		scalarDraws.clear();
+		for (uint32_t i = 0; i < numTransforms; i++) {
+			DrawMatrices matrices;
+			matrices.modelViewMatrix = viewMatrix * mat4(scalarModels[indices[i]]);
+			matrices.normalMatrix = sfz::inverse(sfz::transpose(matrices.modelViewMatrix));
+			scalarDraws.add(matrices);
+		}
+	});
+
+	sfz::Array<mat34> kernelModels(numTransforms, allocator, sfz_dbg(""));
+	sfz::Array<DrawMatrices> kernelDraws(numTransforms, allocator, sfz_dbg(""));
+	const float kernelModelMs = fastestMs([&]() {
+		kernelModels.clear();
+		computeModelMatrices(transforms, kernelModels);
+	});
+	const float kernelDrawMs = fastestMs([&]() {
+		kernelDraws.clear();
+		computeDrawMatrices(
+			viewMatrix, kernelModels.data(), indices.data(), numTransforms, kernelDraws);
+	});
+
+	// Largest absolute difference between the results of the two paths
+	auto maxDifference = [](const float* lhs, const float* rhs, uint32_t numFloats) {
+		float maxDiff = 0.0f;
+		for (uint32_t i = 0; i < numFloats; i++) {
+			maxDiff = sfz::max(maxDiff, std::abs(lhs[i] - rhs[i]));
+		}
+		return maxDiff;
+	};
+	float modelDiff = 0.0f;
+	float modelViewDiff = 0.0f;
+	float normalDiff = 0.0f;
+	for (uint32_t i = 0; i < numTransforms; i++) {
+		modelDiff = sfz::max(modelDiff,
+			maxDifference(scalarModels[i].data(), kernelModels[i].data(), 12));
+		modelViewDiff = sfz::max(modelViewDiff, maxDifference(
+			scalarDraws[i].modelViewMatrix.data(), kernelDraws[i].modelViewMatrix.data(), 16));
+		normalDiff = sfz::max(normalDiff, maxDifference(
+			scalarDraws[i].normalMatrix.data(), kernelDraws[i].normalMatrix.data(), 16));
+	}
+
+	SFZ_INFO("TransformKernels", "%u transforms, fastest of %u runs (%s)", numTransforms,
+		TRANSFORM_BENCHMARK_NUM_ITERATIONS, TRANSFORM_KERNELS_USE_SSE2 ? "SSE2" : "scalar");
+	SFZ_INFO("TransformKernels", "  Model matrices: scalar %.3f ms, kernel %.3f ms (%.2fx)",
+		scalarModelMs, kernelModelMs, scalarModelMs / sfz::max(kernelModelMs, 1e-6f));
+	SFZ_INFO("TransformKernels", "  Draw matrices: scalar %.3f ms, kernel %.3f ms (%.2fx)",
+		scalarDrawMs, kernelDrawMs, scalarDrawMs / sfz::max(kernelDrawMs, 1e-6f));
+	SFZ_INFO("TransformKernels", "  Max difference: model %g, modelView %g, normal %g",
+		modelDiff, modelViewDiff, normalDiff);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <skipifzero.hpp>
+#include <skipifzero_arrays.hpp>
+#include <skipifzero_math.hpp>
+
+// TransformArrays
+// ------------------------------------------------------------------------------------------------
+
+// Rotations, scales and translations of a number of transforms, stored as a structure of arrays
+// so that the kernels below can process several transforms at a time. The transforms are applied
+// in the same order as RenderEntity::transform(), i.e. scale, rotation and then translation.
+struct TransformArrays final {
+	sfz::Array<float> rotation[4]; // x, y, z and w of unit quaternions
+	sfz::Array<float> scale[3];
+	sfz::Array<float> translation[3];
+
+	void init(uint32_t capacity, sfz::Allocator* allocator) noexcept;
+	void clear() noexcept;
+	void add(const sfz::quat& rotation, sfz::vec3 scale, sfz::vec3 translation) noexcept;
+	uint32_t size() const { return rotation[0].size(); }
+};
+
+// Transform kernels
+// ------------------------------------------------------------------------------------------------
+
+// The matrices of an instance as used by the geometry shaders
+struct DrawMatrices final {
+	sfz::mat4 modelViewMatrix;
+	sfz::mat4 normalMatrix; // Inverse transpose of modelViewMatrix
+};
+
+// Appends the model matrix of each transform.
+void computeModelMatrices(
+	const TransformArrays& transforms, sfz::Array<sfz::mat34>& modelMatricesOut) noexcept;
+
+// Appends the DrawMatrices of the model matrices at the given indices. The view matrix must be
+// affine (bottom row 0, 0, 0, 1), which allows the normal matrices to be calculated from the
+// inverse of the upper 3x3 part instead of a general 4x4 inverse.
+void computeDrawMatrices(
+	const sfz::mat4& viewMatrix,
+	const sfz::mat34* modelMatrices,
+	const uint32_t* indices,
+	uint32_t numIndices,
+	sfz::Array<DrawMatrices>& drawMatricesOut) noexcept;
+
+// Microbenchmark
+// ------------------------------------------------------------------------------------------------
+
+// Times the kernels above against the scalar per transform code they replace, using the given
+// number of random transforms. The timings and the largest difference between the results are
+// logged.
+void benchmarkTransformKernels(uint32_t numTransforms, sfz::Allocator* allocator) noexcept;
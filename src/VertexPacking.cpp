@@ -0,0 +1,196 @@
+#include "VertexPacking.hpp"
+
+#include <cmath>
+#include <cstring>
+
+#include "Culling.hpp"
+
+using sfz::vec2;
+using sfz::vec3;
+
+// Statics
+// ------------------------------------------------------------------------------------------------
+
+static float signNotZero(float value) noexcept
+{
+	return value >= 0.0f ? 1.0f : -1.0f;
+}
+
+static int16_t toSnorm16(float value) noexcept
+{
+	return int16_t(std::round(sfz::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+static float fromSnorm16(int16_t value) noexcept
+{
+	return sfz::max(float(value) * (1.0f / 32767.0f), -1.0f);
+}
+
+static uint16_t toUnorm16(float value) noexcept
+{
+	return uint16_t(std::round(sfz::clamp(value, 0.0f, 1.0f) * 65535.0f));
+}
+
+// Vertex layouts
+// ------------------------------------------------------------------------------------------------
+
+const char* toString(VertexLayout layout) noexcept
+{
+	switch (layout) {
+	case VertexLayout::FULL_FLOAT: return "FULL_FLOAT";
+	case VertexLayout::PACKED: return "PACKED";
+	}
+	return "<INVALID>";
+}
+
+// Half floats and octahedral normals
+// ------------------------------------------------------------------------------------------------
+
+uint16_t floatToHalf(float value) noexcept
+{
+	uint32_t bits = 0;
+	memcpy(&bits, &value, sizeof(float));
+	const uint32_t sign = (bits >> 16) & 0x8000u;
+	const uint32_t absBits = bits & 0x7FFFFFFFu;
+
+	// Infinity and NaN (NaNs stay NaNs)
+	if (absBits >= 0x7F800000u) {
+		return uint16_t(sign | 0x7C00u | (absBits > 0x7F800000u ? 0x0200u : 0u));
+	}
+
+	// Larger than the largest half (65504) after rounding
+	if (absBits >= 0x477FF000u) return uint16_t(sign | 0x7C00u);
+
+	// Subnormal halfs, the implicit bit is shifted into the mantissa
+	if (absBits < 0x38800000u) {
+		if (absBits < 0x33000000u) return uint16_t(sign);
+		const uint32_t exponent = absBits >> 23;
+		const uint32_t mantissa = (absBits & 0x7FFFFFu) | 0x800000u;
+		const uint32_t shift = 126 - exponent;
+		uint32_t half = mantissa >> shift;
+		const uint32_t remainder = mantissa & ((1u << shift) - 1u);
+		const uint32_t halfway = 1u << (shift - 1u);
+		if (remainder > halfway || (remainder == halfway && (half & 1u) != 0)) half += 1;
+		return uint16_t(sign | half);
+	}
+
+	// Normal halfs, rebias the exponent. Rounding might carry into the exponent, which is correct.
+	uint32_t half = (absBits - 0x38000000u) >> 13;
+	const uint32_t remainder = absBits & 0x1FFFu;
+	if (remainder > 0x1000u || (remainder == 0x1000u && (half & 1u) != 0)) half += 1;
+	return uint16_t(sign | half);
+}
+
+float halfToFloat(uint16_t half) noexcept
+{
+	const uint32_t sign = uint32_t(half & 0x8000u) << 16;
+	const uint32_t exponent = (half >> 10) & 0x1Fu;
+	const uint32_t mantissa = half & 0x3FFu;
+
+	uint32_t bits = 0;
+	if (exponent == 0x1F) {
+		bits = sign | 0x7F800000u | (mantissa << 13);
+	}
+	else if (exponent != 0) {
+		bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+	}
+	else {
+		// Zero or subnormal, value = mantissa * 2^-24
+		const float value = float(mantissa) * (1.0f / 16777216.0f);
+		memcpy(&bits, &value, sizeof(float));
+		bits |= sign;
+	}
+	float result = 0.0f;
+	memcpy(&result, &bits, sizeof(float));
+	return result;
+}
+
+vec2 octahedralEncode(vec3 normal) noexcept
+{
+	const float l1Norm = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+	if (l1Norm <= 0.0f) return vec2(0.0f);
+	vec2 p = vec2(normal.x, normal.y) / l1Norm;
+	if (normal.z < 0.0f) {
+		p = vec2(
+			(1.0f - std::abs(p.y)) * signNotZero(p.x),
+			(1.0f - std::abs(p.x)) * signNotZero(p.y));
+	}
+	return p;
+}
+
+vec3 octahedralDecode(vec2 encoded) noexcept
+{
+	vec3 n = vec3(encoded.x, encoded.y, 1.0f - std::abs(encoded.x) - std::abs(encoded.y));
+	if (n.z < 0.0f) {
+		n.x = (1.0f - std::abs(encoded.y)) * signNotZero(encoded.x);
+		n.y = (1.0f - std::abs(encoded.x)) * signNotZero(encoded.y);
+	}
+	return sfz::normalize(n);
+}
+
+// PackedVertex
+// ------------------------------------------------------------------------------------------------
+
+PackedVertex packVertex(const sfz::Vertex& vertex, const PackedBounds& bounds) noexcept
+{
+	PackedVertex packed = {};
+	for (uint32_t i = 0; i < 3; i++) {
+		const float extent = bounds.posExtent[i];
+		const float t = extent > 0.0f ? (vertex.pos[i] - bounds.posMin[i]) / extent : 0.0f;
+		packed.pos[i] = toUnorm16(t);
+	}
+	const vec2 octNormal = octahedralEncode(vertex.normal);
+	packed.normal[0] = toSnorm16(octNormal.x);
+	packed.normal[1] = toSnorm16(octNormal.y);
+	packed.texcoord[0] = floatToHalf(vertex.texcoord.x);
+	packed.texcoord[1] = floatToHalf(vertex.texcoord.y);
+	return packed;
+}
+
+sfz::Vertex unpackVertex(const PackedVertex& packed, const PackedBounds& bounds) noexcept
+{
+	sfz::Vertex vertex;
+	const vec3 t = vec3(float(packed.pos[0]), float(packed.pos[1]), float(packed.pos[2]));
+	vertex.pos = bounds.posMin + t * (1.0f / 65535.0f) * bounds.posExtent;
+	vertex.normal = octahedralDecode(
+		vec2(fromSnorm16(packed.normal[0]), fromSnorm16(packed.normal[1])));
+	vertex.texcoord = vec2(halfToFloat(packed.texcoord[0]), halfToFloat(packed.texcoord[1]));
+	return vertex;
+}
+
+// Vertex arrays
+// ------------------------------------------------------------------------------------------------
+
+PackedBounds calculatePackedBounds(const sfz::Vertex* vertices, uint32_t numVertices) noexcept
+{
+	BoundingBox box;
+	for (uint32_t i = 0; i < numVertices; i++) box.add(vertices[i].pos);
+	PackedBounds bounds;
+	if (!box.isEmpty()) {
+		bounds.posMin = box.min;
+		bounds.posExtent = box.max - box.min;
+	}
+	return bounds;
+}
+
+void packVertices(
+	const sfz::Vertex* vertices,
+	uint32_t numVertices,
+	const PackedBounds& bounds,
+	PackedVertex* verticesOut) noexcept
+{
+	for (uint32_t i = 0; i < numVertices; i++) {
+		verticesOut[i] = packVertex(vertices[i], bounds);
+	}
+}
+
+void unpackVertices(
+	const PackedVertex* vertices,
+	uint32_t numVertices,
+	const PackedBounds& bounds,
+	sfz::Vertex* verticesOut) noexcept
+{
+	for (uint32_t i = 0; i < numVertices; i++) {
+		verticesOut[i] = unpackVertex(vertices[i], bounds);
+	}
+}
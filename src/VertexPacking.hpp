@@ -0,0 +1,76 @@
+#pragma once
+
+#include <skipifzero.hpp>
+#include <skipifzero_math.hpp>
+
+#include <sfz/rendering/Mesh.hpp>
+
+// Vertex layouts
+// ------------------------------------------------------------------------------------------------
+
+enum class VertexLayout : uint32_t {
+	FULL_FLOAT = 0, // sfz::Vertex, 32 bytes
+	PACKED = 1 // PackedVertex, 16 bytes
+};
+
+const char* toString(VertexLayout layout) noexcept;
+
+// Half floats and octahedral normals
+// ------------------------------------------------------------------------------------------------
+
+// IEEE 754 binary16 conversions, rounds to nearest even. Values too large become infinity.
+uint16_t floatToHalf(float value) noexcept;
+float halfToFloat(uint16_t half) noexcept;
+
+// Maps a unit vector onto the octahedron unfolded into [-1, 1]^2 ("A Survey of Efficient
+// Representations for Independent Unit Vectors", Cigolle et al.).
+sfz::vec2 octahedralEncode(sfz::vec3 normal) noexcept;
+sfz::vec3 octahedralDecode(sfz::vec2 encoded) noexcept;
+
+// PackedVertex
+// ------------------------------------------------------------------------------------------------
+
+// Compact vertex, half the size of sfz::Vertex. Positions are quantized to 16 bits relative to the
+// bounds of the mesh (see PackedBounds).
+//
+// This is only a storage format for scene packages. The renderer takes sfz::Vertex, so packed
+// vertices are unpacked when a package is loaded. It makes packages smaller on disk, it does not
+// save any VRAM or vertex bandwidth (and the quantization loses some precision).
+struct PackedVertex final {
+	uint16_t pos[3]; // unorm16, see PackedBounds
+	uint16_t padding;
+	int16_t normal[2]; // Octahedral encoded, snorm16
+	uint16_t texcoord[2]; // Half floats
+};
+static_assert(sizeof(PackedVertex) == 16, "PackedVertex is padded");
+
+// How the positions of packed vertices are dequantized, one for all vertices of a mesh:
+// pos = posMin + (vec3(packed.pos) / 65535) * posExtent
+struct PackedBounds final {
+	sfz::vec3 posMin = sfz::vec3(0.0f);
+	uint32_t padding0 = 0;
+	sfz::vec3 posExtent = sfz::vec3(0.0f);
+	uint32_t padding1 = 0;
+};
+static_assert(sizeof(PackedBounds) == 32, "PackedBounds is padded");
+
+PackedVertex packVertex(const sfz::Vertex& vertex, const PackedBounds& bounds) noexcept;
+sfz::Vertex unpackVertex(const PackedVertex& vertex, const PackedBounds& bounds) noexcept;
+
+// Vertex arrays
+// ------------------------------------------------------------------------------------------------
+
+// The bounds of the positions of the given vertices.
+PackedBounds calculatePackedBounds(const sfz::Vertex* vertices, uint32_t numVertices) noexcept;
+
+// Packs (or unpacks) vertices one to one, so indices into the array remain valid.
+void packVertices(
+	const sfz::Vertex* vertices,
+	uint32_t numVertices,
+	const PackedBounds& bounds,
+	PackedVertex* verticesOut) noexcept;
+void unpackVertices(
+	const PackedVertex* vertices,
+	uint32_t numVertices,
+	const PackedBounds& bounds,
+	sfz::Vertex* verticesOut) noexcept;
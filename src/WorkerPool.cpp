@@ -0,0 +1,126 @@
+#include "WorkerPool.hpp"
+
+// WorkerPool: Constructors & destructors
+// ------------------------------------------------------------------------------------------------
+
+void WorkerPool::init(uint32_t numThreads, sfz::Allocator* allocator) noexcept
+{
+	this->destroy();
+#ifdef __EMSCRIPTEN__
+	(void)numThreads;
+	mNumThreads = 0;
+#else
+	mNumThreads = sfz::min(numThreads, WORKER_POOL_MAX_NUM_THREADS);
+#endif
+	mQueue.init(256, allocator, sfz_dbg("WorkerPool::mQueue"));
+	mQueueHead = 0;
+	mShutdown = false;
+	for (uint32_t i = 0; i < mNumThreads; i++) {
+		mThreads[i] = std::thread(workerMain, this);
+	}
+}
+
+void WorkerPool::destroy() noexcept
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mShutdown = true;
+	}
+	mJobAvailableCV.notify_all();
+	for (uint32_t i = 0; i < mNumThreads; i++) {
+		mThreads[i].join();
+	}
+	mNumThreads = 0;
+	mQueue.destroy();
+	mQueueHead = 0;
+}
+
+// WorkerPool: Methods
+// ------------------------------------------------------------------------------------------------
+
+void WorkerPool::parallelFor(uint32_t numTasks, WorkerJobFunc* func, void* userPtr) noexcept
+{
+	if (numTasks == 0) return;
+
+	// Run everything on the calling thread if there are no workers
+	if (mNumThreads == 0 || numTasks == 1) {
+		for (uint32_t i = 0; i < numTasks; i++) func(userPtr, i);
+		return;
+	}
+
+	std::atomic_uint32_t numRemaining(numTasks);
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		for (uint32_t i = 0; i < numTasks; i++) {
+			Job job;
+			job.func = func;
+			job.userPtr = userPtr;
+			job.taskIdx = i;
+			job.numRemaining = &numRemaining;
+			mQueue.add(job);
+		}
+	}
+	mJobAvailableCV.notify_all();
+
+	// Help out executing jobs (not necessarily our own) until all our tasks are finished
+	while (numRemaining.load() != 0) {
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			if (!tryPopJob(job)) {
+				mJobFinishedCV.wait(lock, [&]() {
+					return numRemaining.load() == 0 || mQueueHead < mQueue.size();
+				});
+				continue;
+			}
+		}
+		executeJob(job);
+	}
+}
+
+// WorkerPool: Private methods
+// ------------------------------------------------------------------------------------------------
+
+void WorkerPool::workerMain(WorkerPool* pool) noexcept
+{
+	while (true) {
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(pool->mMutex);
+			pool->mJobAvailableCV.wait(lock, [&]() {
+				return pool->mShutdown || pool->mQueueHead < pool->mQueue.size();
+			});
+			if (!pool->tryPopJob(job)) {
+				if (pool->mShutdown) return;
+				continue;
+			}
+		}
+		pool->executeJob(job);
+	}
+}
+
+bool WorkerPool::tryPopJob(Job& jobOut) noexcept
+{
+	if (mQueueHead >= mQueue.size()) return false;
+	jobOut = mQueue[mQueueHead];
+	mQueueHead += 1;
+
+	// Reset queue when it has been fully consumed so it doesn't grow forever
+	if (mQueueHead == mQueue.size()) {
+		mQueue.clear();
+		mQueueHead = 0;
+	}
+	return true;
+}
+
+void WorkerPool::executeJob(const Job& job) noexcept
+{
+	job.func(job.userPtr, job.taskIdx);
+	if (job.numRemaining->fetch_sub(1) == 1) {
+
+		// Take the lock so the waiting thread can't miss the notification between checking its
+		// predicate and going to sleep.
+		std::lock_guard<std::mutex> lock(mMutex);
+		mJobFinishedCV.notify_all();
+	}
+}
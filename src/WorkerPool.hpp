@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <skipifzero.hpp>
+#include <skipifzero_arrays.hpp>
+
+// WorkerPool
+// ------------------------------------------------------------------------------------------------
+
+constexpr uint32_t WORKER_POOL_MAX_NUM_THREADS = 64;
+
+using WorkerJobFunc = void(void* userPtr, uint32_t taskIdx);
+
+// A simple pool of worker threads executing jobs from a shared queue.
+//
+// Safe to use from several threads at the same time, e.g. the main thread can run a parallelFor()
+// while a background loading thread runs another one. With 0 worker threads (or on platforms
+// without threads) all jobs are executed on the calling thread.
+class WorkerPool final {
+public:
+	// Constructors & destructors
+	// --------------------------------------------------------------------------------------------
+
+	WorkerPool() noexcept = default;
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator= (const WorkerPool&) = delete;
+	WorkerPool(WorkerPool&&) = delete;
+	WorkerPool& operator= (WorkerPool&&) = delete;
+	~WorkerPool() noexcept { this->destroy(); }
+
+	void init(uint32_t numThreads, sfz::Allocator* allocator) noexcept;
+	void destroy() noexcept;
+
+	// Methods
+	// --------------------------------------------------------------------------------------------
+
+	uint32_t numThreads() const { return mNumThreads; }
+
+	// Runs func(userPtr, taskIdx) for every taskIdx in [0, numTasks). The calling thread helps out
+	// executing jobs and does not return until all tasks are finished.
+	void parallelFor(uint32_t numTasks, WorkerJobFunc* func, void* userPtr) noexcept;
+
+	// Convenience wrapper of the above taking a callable, e.g. a lambda with signature
+	// void(uint32_t taskIdx).
+	template<typename Func>
+	void parallelFor(uint32_t numTasks, Func& func) noexcept
+	{
+		this->parallelFor(numTasks, [](void* userPtr, uint32_t taskIdx) {
+			(*static_cast<Func*>(userPtr))(taskIdx);
+		}, &func);
+	}
+
+private:
+	struct Job final {
+		WorkerJobFunc* func = nullptr;
+		void* userPtr = nullptr;
+		uint32_t taskIdx = 0;
+		std::atomic_uint32_t* numRemaining = nullptr;
+	};
+
+	static void workerMain(WorkerPool* pool) noexcept;
+	bool tryPopJob(Job& jobOut) noexcept; // Must hold mMutex
+	void executeJob(const Job& job) noexcept;
+
+	uint32_t mNumThreads = 0;
+	std::thread mThreads[WORKER_POOL_MAX_NUM_THREADS];
+	std::mutex mMutex;
+	std::condition_variable mJobAvailableCV;
+	std::condition_variable mJobFinishedCV;
+	sfz::Array<Job> mQueue;
+	uint32_t mQueueHead = 0;
+	bool mShutdown = false;
+};